@@ -1,5 +1,7 @@
 /* _POSIX_C_SOURCE exposes clock_gettime / struct timespec under -std=c99 */
 #define _POSIX_C_SOURCE 199309L
+/* _DEFAULT_SOURCE exposes sysconf (_SC_NPROCESSORS_ONLN) under -std=c99 */
+#define _DEFAULT_SOURCE
 
 /*
  * bench_decode.c - standalone PNG decode benchmark harness
@@ -11,18 +13,52 @@
  *
  * Usage:
  *   bench_decode <image.png> [iterations]
+ *   bench_decode --sweep <max_threads> <iterations> <image.png>...
+ *   bench_decode --lowmem <budget_mib> <out.rgba> <image.png>
+ *   bench_decode --stream <image.png>
+ *   bench_decode --deadline <ms> <image.png>
+ *   bench_decode --batch <queue_depth> <image.png>...
+ *
+ * --sweep decodes every image with 1..max_threads decoder threads (the
+ * parallel cut-over thresholds are disabled while sweeping), prints the
+ * speedup and parallel efficiency per image size, and suggests the
+ * SLICER_PNG_THREADS / SLICER_PNG_MT_MIN_* settings the sweep supports:
+ * the size from which every larger image gained at least 10%.  That is
+ * only as precise as the spread of sizes given, so pass a ladder of
+ * sizes around the expected cut-over.
+ * It then decodes each PNG once more through the inflate/unfilter
+ * pipeline and suggests SLICER_PNG_PIPELINE_MIN_BYTES from the inflated
+ * sizes at which the pipeline beats the best non-pipelined decode (on
+ * hosts with at least two CPUs online, the only ones that run it).
+ *
+ * --lowmem runs one memory-bounded decode into <out.rgba> and reports
+ * its time and the process's peak RSS.  --stream hashes rows as
+ * png_decode_stream delivers them and reports the time to the first
+ * batch against the full decode.  --deadline decodes under a timeout
+ * and reports how long after the deadline the cancelled decode returned.
+ * --batch loads the images through the asynchronous file loader, keeping
+ * <queue_depth> reads in flight while the main thread decodes, and
+ * reports the aggregate throughput; drop the page cache first to measure
+ * cold storage, and set SLICER_IO=threads to compare the pread pool.
  *
  * Build (see Makefile targets: bench, bench-perf, bench-prof):
  *   cc -O2 -o build/bench_decode bench_decode.c image.c png_decoder.c -ldl
  * -pthread
  */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "file_loader.h"
 #include "image.h"
+#include "pixel_kernels.h"
 #include "png_decoder.h"
 
 /* ------------------------------------------------------------------ */
@@ -69,6 +105,610 @@ print_separator (void)
     puts ("--------------------------------------------------------------");
 }
 
+/* ------------------------------------------------------------------ */
+/* Thread-scaling sweep                                                 */
+/* ------------------------------------------------------------------ */
+
+/* Speedup over one thread below which parallel decode is not worth it. */
+#define SWEEP_MIN_SPEEDUP 1.10
+
+typedef struct
+{
+    const char *path;
+    int width;
+    int height;
+    double pixels;
+    int best_threads;
+    double best_speedup;
+    double inflated; /* IDAT bytes after inflate; 0 if not a PNG */
+    double pipeline_speedup;
+} sweep_result_t;
+
+/* A measured size and the speedup reached at it, for cut-over search. */
+typedef struct
+{
+    double size;
+    double speedup;
+} sweep_point_t;
+
+/* Inflated size (rows plus filter bytes) from the IHDR, or 0. */
+static double
+png_inflated_bytes (const char *path)
+{
+    uint8_t h[26];
+    FILE *f = fopen (path, "rb");
+    size_t n;
+    double width;
+    double height;
+
+    if (!f)
+        return 0.0;
+    n = fread (h, 1, sizeof (h), f);
+    fclose (f);
+    if (n != sizeof (h) || !png_is_signature (h, n)
+        || (h[25] != 2 && h[25] != 6))
+        return 0.0;
+    width = (double)(((uint32_t)h[16] << 24) | ((uint32_t)h[17] << 16)
+                     | ((uint32_t)h[18] << 8) | h[19]);
+    height = (double)(((uint32_t)h[20] << 24) | ((uint32_t)h[21] << 16)
+                      | ((uint32_t)h[22] << 8) | h[23]);
+    return height * (1.0 + width * (h[25] == 6 ? 4.0 : 3.0));
+}
+
+static int
+compare_points (const void *a, const void *b)
+{
+    double sa = ((const sweep_point_t *)a)->size;
+    double sb = ((const sweep_point_t *)b)->size;
+
+    return (sa > sb) - (sa < sb);
+}
+
+/*
+ * Sorts `pts` by size and returns the smallest size from which every
+ * larger measured size also reached SWEEP_MIN_SPEEDUP, or 0 when the
+ * largest did not.  *below gets the largest size under the cut-over
+ * that fell short (0 if none did): the true cut-over lies between the
+ * two, so a sparse size ladder only brackets it.
+ */
+static double
+sweep_cut_over (sweep_point_t *pts, int n, double *below)
+{
+    int i = n;
+
+    qsort (pts, (size_t)n, sizeof (*pts), compare_points);
+    while (i > 0 && pts[i - 1].speedup >= SWEEP_MIN_SPEEDUP)
+        i--;
+    if (i == n)
+        return 0.0;
+    *below = i > 0 ? pts[i - 1].size : 0.0;
+    return pts[i].size;
+}
+
+/* Decodes `path` `iterations` times; returns the fastest run in seconds,
+   or a negative value on decode failure. */
+static double
+time_decodes (const char *path, int iterations, double *mean)
+{
+    double best = 1e30;
+    double total = 0.0;
+    int i;
+
+    for (i = 0; i < iterations; i++)
+        {
+            image_t img = { 0 };
+            double t0 = now_seconds ();
+            double elapsed;
+
+            if (!image_load (path, &img))
+                return -1.0;
+            elapsed = now_seconds () - t0;
+            image_free (&img);
+
+            total += elapsed;
+            if (elapsed < best)
+                best = elapsed;
+        }
+    *mean = total / (double)iterations;
+    return best;
+}
+
+static int
+sweep_image (
+    const char *path,
+    int max_threads,
+    int iterations,
+    sweep_result_t *res
+)
+{
+    image_t warm = { 0 };
+    png_tuning_t tuning;
+    double base = 0.0;
+    double fastest = 1e30;
+    double mean = 0.0;
+    double best;
+    int t;
+
+    if (!image_load (path, &warm))
+        {
+            fprintf (stderr, "error: failed to decode '%s'\n", path);
+            return 0;
+        }
+    res->path = path;
+    res->width = warm.width;
+    res->height = warm.height;
+    res->pixels = (double)warm.width * (double)warm.height;
+    res->best_threads = 1;
+    res->best_speedup = 1.0;
+    res->inflated = png_inflated_bytes (path);
+    res->pipeline_speedup = 0.0;
+    image_free (&warm);
+
+    printf (
+        "image: %s  (%d x %d, %.2f Mpx)\n",
+        path,
+        res->width,
+        res->height,
+        res->pixels / 1e6
+    );
+    printf ("  threads   best ms   mean ms   speedup   efficiency\n");
+
+    for (t = 1; t <= max_threads; t++)
+        {
+            double speedup;
+
+            png_get_tuning (&tuning);
+            tuning.threads = t;
+            tuning.mt_min_rows = 0;
+            tuning.mt_min_pixels = 0;
+            tuning.pipeline_min_bytes = SIZE_MAX;
+            png_set_tuning (&tuning);
+
+            best = time_decodes (path, iterations, &mean);
+            if (best < 0.0)
+                {
+                    fprintf (stderr, "error: decode failed for '%s'\n", path);
+                    return 0;
+                }
+            if (t == 1)
+                base = best;
+            if (best < fastest)
+                fastest = best;
+            speedup = base / best;
+            if (speedup > res->best_speedup)
+                {
+                    res->best_speedup = speedup;
+                    res->best_threads = t;
+                }
+            printf (
+                "  %7d  %8.3f  %8.3f  %7.2fx  %9.0f%%\n",
+                t,
+                best * 1e3,
+                mean * 1e3,
+                speedup,
+                100.0 * speedup / (double)t
+            );
+        }
+
+    /* The pipeline replaces whichever decode the thread count picks, so
+       it has to beat the fastest of them.  The decoder never starts it
+       with only one CPU online. */
+    if (res->inflated > 0.0 && sysconf (_SC_NPROCESSORS_ONLN) >= 2)
+        {
+            png_get_tuning (&tuning);
+            tuning.pipeline_min_bytes = 0;
+            png_set_tuning (&tuning);
+            best = time_decodes (path, iterations, &mean);
+            if (best < 0.0)
+                {
+                    fprintf (stderr, "error: decode failed for '%s'\n", path);
+                    return 0;
+                }
+            res->pipeline_speedup = fastest / best;
+            printf (
+                "  pipeline %8.3f  %8.3f  %7.2fx  (vs fastest above, "
+                "%.1f MiB inflated)\n",
+                best * 1e3,
+                mean * 1e3,
+                res->pipeline_speedup,
+                res->inflated / (1024.0 * 1024.0)
+            );
+        }
+    print_separator ();
+    return 1;
+}
+
+static int
+run_sweep (int max_threads, int iterations, char **paths, int n_paths)
+{
+    png_tuning_t saved;
+    sweep_result_t *results;
+    sweep_point_t *points;
+    const sweep_result_t *largest = NULL;
+    double cut;
+    double below = 0.0;
+    int min_rows = 0;
+    int n_points = 0;
+    int i;
+
+    results = (sweep_result_t *)calloc ((size_t)n_paths, sizeof (*results));
+    points = (sweep_point_t *)calloc ((size_t)n_paths, sizeof (*points));
+    if (!results || !points)
+        {
+            fprintf (stderr, "error: out of memory for sweep results\n");
+            free (results);
+            free (points);
+            return 1;
+        }
+
+    png_get_tuning (&saved);
+    printf (
+        "thread sweep: 1..%d threads, %d iterations each, %s kernels\n",
+        max_threads,
+        iterations,
+        cpu_isa_name (pixel_kernels ()->isa)
+    );
+    print_separator ();
+    for (i = 0; i < n_paths; i++)
+        {
+            if (!sweep_image (paths[i], max_threads, iterations, &results[i]))
+                {
+                    png_set_tuning (&saved);
+                    free (results);
+                    free (points);
+                    return 1;
+                }
+        }
+    png_set_tuning (&saved);
+
+    /* Both thresholds must hold for a parallel decode, so the row
+       threshold is the shortest image at or above the pixel cut-over. */
+    for (i = 0; i < n_paths; i++)
+        {
+            points[i].size = results[i].pixels;
+            points[i].speedup = results[i].best_speedup;
+            if (!largest || results[i].pixels > largest->pixels)
+                largest = &results[i];
+        }
+    cut = sweep_cut_over (points, n_paths, &below);
+    for (i = 0; i < n_paths; i++)
+        {
+            if (cut > 0.0 && results[i].pixels >= cut
+                && (min_rows == 0 || results[i].height < min_rows))
+                min_rows = results[i].height;
+        }
+
+    printf ("calibration:\n");
+    if (cut == 0.0)
+        {
+            printf (
+                "  threads: the largest image was not %.0f%% faster with "
+                "extra threads\n",
+                (SWEEP_MIN_SPEEDUP - 1.0) * 100.0
+            );
+            printf ("  export SLICER_PNG_THREADS=1\n");
+        }
+    else
+        {
+            printf (
+                "  threads: %.0f%% faster from %.2f Mpx up",
+                (SWEEP_MIN_SPEEDUP - 1.0) * 100.0,
+                cut / 1e6
+            );
+            if (below > 0.0)
+                printf (
+                    "; cut-over lies between %.2f and %.2f Mpx\n",
+                    below / 1e6,
+                    cut / 1e6
+                );
+            else
+                printf (
+                    "; every size won, so this is only an upper bound\n"
+                );
+            printf (
+                "  export SLICER_PNG_THREADS=%d\n", largest->best_threads
+            );
+            printf ("  export SLICER_PNG_MT_MIN_PIXELS=%.0f\n", cut);
+            printf ("  export SLICER_PNG_MT_MIN_ROWS=%d\n", min_rows);
+        }
+
+    for (i = 0; i < n_paths; i++)
+        {
+            if (results[i].inflated > 0.0)
+                {
+                    points[n_points].size = results[i].inflated;
+                    points[n_points].speedup = results[i].pipeline_speedup;
+                    n_points++;
+                }
+        }
+    if (n_points > 0 && sysconf (_SC_NPROCESSORS_ONLN) < 2)
+        {
+            printf ("  pipeline: needs two online CPUs, not measured\n");
+        }
+    else if (n_points > 0)
+        {
+            cut = sweep_cut_over (points, n_points, &below);
+            if (cut == 0.0)
+                {
+                    printf (
+                        "  pipeline: the largest image was not %.0f%% "
+                        "faster; leave it off\n",
+                        (SWEEP_MIN_SPEEDUP - 1.0) * 100.0
+                    );
+                    printf (
+                        "  export SLICER_PNG_PIPELINE_MIN_BYTES=%ld\n",
+                        LONG_MAX
+                    );
+                }
+            else
+                {
+                    printf (
+                        "  pipeline: %.0f%% faster from %.1f MiB inflated "
+                        "up",
+                        (SWEEP_MIN_SPEEDUP - 1.0) * 100.0,
+                        cut / (1024.0 * 1024.0)
+                    );
+                    if (below > 0.0)
+                        printf (
+                            "; cut-over lies between %.1f and %.1f MiB\n",
+                            below / (1024.0 * 1024.0),
+                            cut / (1024.0 * 1024.0)
+                        );
+                    else
+                        printf (
+                            "; every size won, so this is only an upper "
+                            "bound\n"
+                        );
+                    printf (
+                        "  export SLICER_PNG_PIPELINE_MIN_BYTES=%.0f\n", cut
+                    );
+                }
+        }
+    print_separator ();
+
+    free (results);
+    free (points);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Low-memory decode                                                    */
+/* ------------------------------------------------------------------ */
+
+static int
+run_lowmem (long budget_mib, const char *out_path, const char *path)
+{
+    image_t img = { 0 };
+    struct rusage ru;
+    double t0;
+    double elapsed;
+    int fd;
+    int ok;
+
+    fd = open (out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        {
+            fprintf (stderr, "error: cannot create '%s'\n", out_path);
+            return 1;
+        }
+    t0 = now_seconds ();
+    ok = png_decode_file_to_fd (path, fd, (size_t)budget_mib << 20, &img);
+    elapsed = now_seconds () - t0;
+    close (fd);
+    if (!ok)
+        {
+            fprintf (
+                stderr, "error: low-memory decode of '%s' failed\n", path
+            );
+            return 1;
+        }
+    getrusage (RUSAGE_SELF, &ru);
+
+    printf ("image: %s\n", path);
+    printf (
+        "dimensions: %d x %d  has_alpha=%d\n",
+        img.width,
+        img.height,
+        img.has_alpha
+    );
+    printf ("budget: %ld MiB -> %s\n", budget_mib, out_path);
+    print_separator ();
+    printf ("decode time: %.3f ms\n", elapsed * 1e3);
+    printf ("peak RSS: %.2f MiB\n", (double)ru.ru_maxrss / 1024.0);
+    print_separator ();
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Progressive decode                                                   */
+/* ------------------------------------------------------------------ */
+
+typedef struct
+{
+    double t0;
+    double first_batch;
+    unsigned long batches;
+    uint64_t hash;
+} stream_stats_t;
+
+static int
+stream_rows (
+    void *ctx,
+    const image_t *info,
+    const uint8_t *rgba,
+    uint32_t y,
+    uint32_t count
+)
+{
+    stream_stats_t *st = (stream_stats_t *)ctx;
+    size_t n = (size_t)info->width * 4U * count;
+    size_t i;
+
+    (void)y;
+    if (st->batches++ == 0)
+        st->first_batch = now_seconds () - st->t0;
+    for (i = 0; i < n; i++)
+        st->hash = (st->hash ^ rgba[i]) * 1099511628211ULL;
+    return 1;
+}
+
+static int
+run_stream (const char *path)
+{
+    image_t img = { 0 };
+    stream_stats_t st = { 0.0, 0.0, 0, 1469598103934665603ULL };
+    double elapsed;
+
+    st.t0 = now_seconds ();
+    if (!png_decode_stream (path, stream_rows, &st, &img))
+        {
+            fprintf (stderr, "error: stream decode of '%s' failed\n", path);
+            return 1;
+        }
+    elapsed = now_seconds () - st.t0;
+
+    printf ("image: %s\n", path);
+    printf (
+        "dimensions: %d x %d  has_alpha=%d\n",
+        img.width,
+        img.height,
+        img.has_alpha
+    );
+    print_separator ();
+    printf ("batches: %lu\n", st.batches);
+    printf ("first batch: %.3f ms\n", st.first_batch * 1e3);
+    printf ("full decode: %.3f ms\n", elapsed * 1e3);
+    printf ("row hash: %016llx\n", (unsigned long long)st.hash);
+    print_separator ();
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Deadline cancellation                                                */
+/* ------------------------------------------------------------------ */
+
+static int
+run_deadline (long timeout_ms, const char *path)
+{
+    image_t img = { 0 };
+    png_cancel_t cancel;
+    double t0;
+    double elapsed;
+    int r;
+
+    t0 = now_seconds ();
+    png_cancel_init (&cancel, (unsigned long)timeout_ms);
+    r = png_decode_file_cancellable (path, &img, &cancel);
+    elapsed = now_seconds () - t0;
+
+    printf ("image: %s\n", path);
+    printf ("deadline: %ld ms\n", timeout_ms);
+    print_separator ();
+    if (r == PNG_DECODE_CANCELLED)
+        {
+            printf ("cancelled after %.3f ms\n", elapsed * 1e3);
+            printf (
+                "latency past deadline: %.3f ms\n",
+                elapsed * 1e3 - (double)timeout_ms
+            );
+        }
+    else if (r == 1)
+        {
+            printf ("finished in %.3f ms\n", elapsed * 1e3);
+            image_free (&img);
+        }
+    else
+        {
+            fprintf (stderr, "error: decode of '%s' failed\n", path);
+            return 1;
+        }
+    print_separator ();
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Batch decode over the async loader                                   */
+/* ------------------------------------------------------------------ */
+
+static int
+run_batch (long depth, char **paths, int n_paths)
+{
+    file_loader_t *loader;
+    file_load_t res;
+    double t0;
+    double elapsed;
+    double bytes = 0.0;
+    double pixels = 0.0;
+    int decoded = 0;
+    int failed = 0;
+    int i;
+
+    loader = file_loader_new ((unsigned int)depth);
+    if (!loader)
+        {
+            fprintf (stderr, "error: cannot start the file loader\n");
+            return 1;
+        }
+
+    t0 = now_seconds ();
+    for (i = 0; i < n_paths; i++)
+        {
+            if (!file_loader_submit (loader, paths[i], NULL))
+                {
+                    fprintf (stderr, "error: out of memory queueing reads\n");
+                    file_loader_free (loader);
+                    return 1;
+                }
+        }
+    while (file_loader_wait (loader, &res))
+        {
+            image_t img = { 0 };
+
+            if (res.error)
+                {
+                    fprintf (
+                        stderr,
+                        "error: cannot read '%s': %s\n",
+                        res.path,
+                        strerror (res.error)
+                    );
+                    failed++;
+                    continue;
+                }
+            bytes += (double)res.size;
+            if (png_decode_memory (res.data, res.size, res.path, &img, NULL))
+                {
+                    pixels += (double)img.width * (double)img.height;
+                    decoded++;
+                    image_free (&img);
+                }
+            else
+                {
+                    failed++;
+                }
+            free (res.data);
+        }
+    elapsed = now_seconds () - t0;
+
+    printf (
+        "batch: %d files, queue depth %ld, %s backend\n",
+        n_paths,
+        depth,
+        file_loader_backend (loader)
+    );
+    print_separator ();
+    printf ("decoded: %d  failed: %d\n", decoded, failed);
+    printf ("wall time: %.3f ms\n", elapsed * 1e3);
+    printf (
+        "file throughput: %.2f MB/s\n", bytes / elapsed / (1024.0 * 1024.0)
+    );
+    printf ("pixel throughput: %.2f MP/s\n", pixels / elapsed / 1e6);
+    print_separator ();
+
+    file_loader_free (loader);
+    return failed ? 1 : 0;
+}
+
 /* ------------------------------------------------------------------ */
 /* Main                                                                 */
 /* ------------------------------------------------------------------ */
@@ -88,11 +728,148 @@ main (int argc, char **argv)
     int i;
 
     /* ---- argument parsing ---- */
+    if (argc >= 2 && strcmp (argv[1], "--sweep") == 0)
+        {
+            char *end = NULL;
+            long max_threads;
+            long iters;
+
+            if (argc < 5)
+                {
+                    fprintf (
+                        stderr,
+                        "usage: %s --sweep <max_threads> <iterations> "
+                        "<image>...\n",
+                        argv[0]
+                    );
+                    return 1;
+                }
+            max_threads = strtol (argv[2], &end, 10);
+            if (!end || *end != '\0' || max_threads <= 0 || max_threads > 128)
+                {
+                    fprintf (stderr, "error: max_threads must be 1..128\n");
+                    return 1;
+                }
+            iters = strtol (argv[3], &end, 10);
+            if (!end || *end != '\0' || iters <= 0 || iters > 1000000L)
+                {
+                    fprintf (
+                        stderr,
+                        "error: iterations must be a positive integer\n"
+                    );
+                    return 1;
+                }
+            return run_sweep (
+                (int)max_threads, (int)iters, argv + 4, argc - 4
+            );
+        }
+
+    if (argc >= 2 && strcmp (argv[1], "--lowmem") == 0)
+        {
+            char *end = NULL;
+            long budget;
+
+            if (argc != 5)
+                {
+                    fprintf (
+                        stderr,
+                        "usage: %s --lowmem <budget_mib> <out.rgba> "
+                        "<image.png>\n",
+                        argv[0]
+                    );
+                    return 1;
+                }
+            budget = strtol (argv[2], &end, 10);
+            if (!end || *end != '\0' || budget <= 0 || budget > 4096)
+                {
+                    fprintf (stderr, "error: budget_mib must be 1..4096\n");
+                    return 1;
+                }
+            return run_lowmem (budget, argv[3], argv[4]);
+        }
+
+    if (argc >= 2 && strcmp (argv[1], "--stream") == 0)
+        {
+            if (argc != 3)
+                {
+                    fprintf (
+                        stderr, "usage: %s --stream <image.png>\n", argv[0]
+                    );
+                    return 1;
+                }
+            return run_stream (argv[2]);
+        }
+
+    if (argc >= 2 && strcmp (argv[1], "--deadline") == 0)
+        {
+            char *end = NULL;
+            long ms;
+
+            if (argc != 4)
+                {
+                    fprintf (
+                        stderr,
+                        "usage: %s --deadline <ms> <image.png>\n",
+                        argv[0]
+                    );
+                    return 1;
+                }
+            ms = strtol (argv[2], &end, 10);
+            if (!end || *end != '\0' || ms <= 0 || ms > 3600000L)
+                {
+                    fprintf (stderr, "error: ms must be 1..3600000\n");
+                    return 1;
+                }
+            return run_deadline (ms, argv[3]);
+        }
+
+    if (argc >= 2 && strcmp (argv[1], "--batch") == 0)
+        {
+            char *end = NULL;
+            long depth;
+
+            if (argc < 4)
+                {
+                    fprintf (
+                        stderr,
+                        "usage: %s --batch <queue_depth> <image.png>...\n",
+                        argv[0]
+                    );
+                    return 1;
+                }
+            depth = strtol (argv[2], &end, 10);
+            if (!end || *end != '\0' || depth <= 0 || depth > 256)
+                {
+                    fprintf (stderr, "error: queue_depth must be 1..256\n");
+                    return 1;
+                }
+            return run_batch (depth, argv + 3, argc - 3);
+        }
+
     if (argc < 2 || argc > 3)
         {
             fprintf (
                 stderr, "usage: %s <image.png|ppm> [iterations]\n", argv[0]
             );
+            fprintf (
+                stderr,
+                "       %s --sweep <max_threads> <iterations> <image>...\n",
+                argv[0]
+            );
+            fprintf (
+                stderr,
+                "       %s --lowmem <budget_mib> <out.rgba> <image.png>\n",
+                argv[0]
+            );
+            fprintf (stderr, "       %s --stream <image.png>\n", argv[0]);
+            fprintf (
+                stderr, "       %s --deadline <ms> <image.png>\n", argv[0]
+            );
+            fprintf (
+                stderr,
+                "       %s --batch <queue_depth> <image.png>...\n",
+                argv[0]
+            );
             fprintf (stderr, "  iterations defaults to 100\n");
             return 1;
         }
@@ -152,6 +929,7 @@ main (int argc, char **argv)
             (double)(warm.width * warm.height * 4) / 1024.0
         );
         printf ("iterations: %d\n", iterations);
+        printf ("kernel isa: %s\n", cpu_isa_name (pixel_kernels ()->isa));
         image_free (&warm);
     }
     print_separator ();
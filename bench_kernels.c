@@ -0,0 +1,1013 @@
+/* _POSIX_C_SOURCE exposes clock_gettime / struct timespec under -std=c99 */
+#define _POSIX_C_SOURCE 199309L
+
+/*
+ * bench_kernels.c - per-kernel microbenchmark harness
+ *
+ * Times the decoder and blitter hot loops on synthetic rows, so that
+ * kernel-level changes are not lost in the noise of a whole-file decode:
+ *   - png_unfilter_row for filter types 0-4 at bpp 1, 2, 3, 4, 6 and 8
+ *   - png_unfilter_row_rgb_to_rgba, the direct RGB -> RGBA unfilter
+ *   - png_convert_rgb_rows_to_rgba, plain and with a tRNS colour key
+ *   - the dispatched alpha-coverage scan run on every RGBA row
+ *   - the dispatched RGBA -> xrgb8888 / rgb888 / rgb565 blit kernels
+ *   - the dispatched 32-bit pixel replication at 4x magnification
+ *   - pack_pixel + store_pixel and blend_pixel for 32/24/16 bpp visuals
+ *
+ * Each kernel runs at working-set sizes from L1-resident to
+ * DRAM-resident, once per ISA tier the CPU supports (see
+ * pixel_kernels.h), and the best of several passes is reported in
+ * cycles per output byte (TSC ticks on x86, nanoseconds elsewhere).
+ *
+ * Usage:
+ *   bench_kernels [work_MiB]
+ *   bench_kernels --verify
+ *
+ * work_MiB is the number of bytes processed per measurement (default
+ * 64); lower it for a quick run.  --verify times nothing: it checks
+ * every dispatched kernel of every tier the CPU supports against the
+ * scalar table and exits non-zero on any difference (`make
+ * check-kernels`).  `make bench-kernels` also builds
+ * bench_kernels_paeth_arith with -DPAETH_USE_ARITHMETIC so the two
+ * Paeth predictor variants can be compared side by side.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+
+#include "editor_pixels.h"
+#include "pixel_kernels.h"
+#include "png_decoder_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Tick source                                                          */
+/* ------------------------------------------------------------------ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TICK_UNIT "cycles/B (TSC)"
+
+static uint64_t
+ticks_now (void)
+{
+    return (uint64_t)__rdtsc ();
+}
+#else
+#define TICK_UNIT "ns/B"
+
+static uint64_t
+ticks_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Working-set sizes and shared buffers                                 */
+/* ------------------------------------------------------------------ */
+
+#define BENCH_WIDTH 1024U
+#define N_SIZES 4
+
+static const size_t g_sizes[N_SIZES] = {
+    16U * 1024U,
+    256U * 1024U,
+    4U * 1024U * 1024U,
+    64U * 1024U * 1024U,
+};
+static const char *const g_size_names[N_SIZES] = {
+    "L1 16K",
+    "L2 256K",
+    "L3 4M",
+    "DRAM 64M",
+};
+
+static size_t g_work_bytes = 64U * 1024U * 1024U;
+static uint8_t *g_src;
+static uint8_t *g_dst;
+static uint32_t g_sink;
+
+static void
+fill_random (uint8_t *buf, size_t n, uint32_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        {
+            seed = seed * 1664525U + 1013904223U;
+            buf[i] = (uint8_t)(seed >> 24);
+        }
+}
+
+static size_t
+rows_for_size (size_t size, size_t row_bytes)
+{
+    size_t rows = size / row_bytes;
+    return rows < 2U ? 2U : rows;
+}
+
+static size_t
+passes_for_bytes (size_t bytes)
+{
+    size_t passes = g_work_bytes / bytes;
+    return passes < 3U ? 3U : passes;
+}
+
+static void
+print_separator (void)
+{
+    puts ("------------------------------------------------------------------"
+          "------------");
+}
+
+static void
+print_row_label (const char *kernel, const char *isa)
+{
+    printf ("%-28s %-7s", kernel, isa);
+}
+
+static void
+print_result (uint64_t best_ticks, size_t bytes)
+{
+    printf (" %10.3f", (double)best_ticks / (double)bytes);
+    fflush (stdout);
+}
+
+/* ------------------------------------------------------------------ */
+/* Decoder kernels                                                      */
+/* ------------------------------------------------------------------ */
+
+static void
+bench_unfilter (size_t bpp, int filter, size_t size)
+{
+    size_t row_bytes = (size_t)BENCH_WIDTH * bpp;
+    size_t rows = rows_for_size (size, row_bytes);
+    size_t bytes = rows * row_bytes;
+    size_t passes = passes_for_bytes (bytes);
+    uint64_t best = UINT64_MAX;
+    size_t p;
+    size_t y;
+
+    for (y = 0; y < rows; y++)
+        {
+            g_src[y * (row_bytes + 1U)] = (uint8_t)filter;
+        }
+
+    for (p = 0; p < passes; p++)
+        {
+            uint64_t t0 = ticks_now ();
+            for (y = 0; y < rows; y++)
+                {
+                    png_unfilter_row (
+                        g_dst + y * row_bytes,
+                        g_src + y * (row_bytes + 1U),
+                        y == 0 ? NULL : g_dst + (y - 1U) * row_bytes,
+                        row_bytes,
+                        bpp
+                    );
+                }
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    g_sink += g_dst[bytes - 1U];
+    print_result (best, bytes);
+}
+
+static void
+bench_unfilter_rgba (int filter, size_t size)
+{
+    size_t row_bytes = (size_t)BENCH_WIDTH * 3U;
+    size_t out_row_bytes = (size_t)BENCH_WIDTH * 4U;
+    size_t rows = rows_for_size (size, out_row_bytes);
+    size_t bytes = rows * out_row_bytes;
+    size_t passes = passes_for_bytes (bytes);
+    uint64_t best = UINT64_MAX;
+    size_t p;
+    size_t y;
+
+    for (y = 0; y < rows; y++)
+        {
+            g_src[y * (row_bytes + 1U)] = (uint8_t)filter;
+        }
+
+    for (p = 0; p < passes; p++)
+        {
+            uint64_t t0 = ticks_now ();
+            for (y = 0; y < rows; y++)
+                {
+                    png_unfilter_row_rgb_to_rgba (
+                        g_dst + y * out_row_bytes,
+                        g_src + y * (row_bytes + 1U),
+                        y == 0 ? NULL : g_dst + (y - 1U) * out_row_bytes,
+                        BENCH_WIDTH,
+                        0,
+                        0U,
+                        0U,
+                        0U
+                    );
+                }
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    g_sink += g_dst[bytes - 1U];
+    print_result (best, bytes);
+}
+
+static void
+bench_expand (int has_trns, size_t size)
+{
+    size_t out_row_bytes = (size_t)BENCH_WIDTH * 4U;
+    size_t rows = rows_for_size (size, out_row_bytes);
+    size_t bytes = rows * out_row_bytes;
+    size_t passes = passes_for_bytes (bytes);
+    uint64_t best = UINT64_MAX;
+    size_t p;
+
+    for (p = 0; p < passes; p++)
+        {
+            uint64_t t0 = ticks_now ();
+            png_convert_rgb_rows_to_rgba (
+                g_dst, g_src, BENCH_WIDTH, 0, rows, has_trns, 255U, 0U, 255U
+            );
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    g_sink += g_dst[bytes - 1U];
+    print_result (best, bytes);
+}
+
+static void
+bench_alpha_scan (size_t size)
+{
+    const pixel_kernels_t *k = pixel_kernels ();
+    size_t row_bytes = (size_t)BENCH_WIDTH * 4U;
+    size_t rows = rows_for_size (size, row_bytes);
+    size_t bytes = rows * row_bytes;
+    size_t passes = passes_for_bytes (bytes);
+    uint64_t best = UINT64_MAX;
+    size_t p;
+    size_t y;
+
+    for (p = 0; p < passes; p++)
+        {
+            uint64_t t0 = ticks_now ();
+            for (y = 0; y < rows; y++)
+                {
+                    g_sink
+                        += k->alpha_scan (g_src + y * row_bytes, BENCH_WIDTH);
+                }
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    print_result (best, bytes);
+}
+
+/* ------------------------------------------------------------------ */
+/* Blitter kernels                                                      */
+/* ------------------------------------------------------------------ */
+
+typedef struct
+{
+    const char *name;
+    pixel_format_t format;
+} bench_format_t;
+
+static const bench_format_t g_formats[] = {
+    { "xrgb8888",
+      { 24, 4, XCB_IMAGE_ORDER_LSB_FIRST, 0xFF0000U, 0x00FF00U, 0x0000FFU, 16,
+        8, 0, 255, 255, 255 } },
+    { "rgb888",
+      { 24, 3, XCB_IMAGE_ORDER_LSB_FIRST, 0xFF0000U, 0x00FF00U, 0x0000FFU, 16,
+        8, 0, 255, 255, 255 } },
+    { "rgb565",
+      { 16, 2, XCB_IMAGE_ORDER_LSB_FIRST, 0xF800U, 0x07E0U, 0x001FU, 11, 5, 0,
+        31, 63, 31 } },
+};
+
+/* Bytes are counted on the RGBA source side for both blitter kernels. */
+static void
+bench_blit (const pixel_format_t *format, int blend, size_t size)
+{
+    size_t pixels = size / 4U;
+    size_t bytes = pixels * 4U;
+    size_t passes = passes_for_bytes (bytes);
+    size_t dst_bpp = (size_t)format->bytes_per_pixel;
+    uint64_t best = UINT64_MAX;
+    size_t p;
+    size_t i;
+
+    for (p = 0; p < passes; p++)
+        {
+            const uint8_t *s = g_src;
+            uint8_t *d = g_dst;
+            uint64_t t0 = ticks_now ();
+
+            if (blend)
+                {
+                    for (i = 0; i < pixels; i++, s += 4, d += dst_bpp)
+                        {
+                            blend_pixel (format, d, s[0], s[1], s[2], s[3]);
+                        }
+                }
+            else
+                {
+                    for (i = 0; i < pixels; i++, s += 4, d += dst_bpp)
+                        {
+                            uint32_t px
+                                = pack_pixel (format, s[0], s[1], s[2]);
+                            store_pixel (format, d, px);
+                        }
+                }
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    g_sink += g_dst[0];
+    print_result (best, bytes);
+}
+
+/* Dispatched RGBA -> native span kernels, for comparison with the
+   per-pixel pack_pixel path above. */
+static void
+bench_blit_kernel (blit_row_fn blit, size_t size)
+{
+    size_t pixels = size / 4U;
+    size_t bytes = pixels * 4U;
+    size_t passes = passes_for_bytes (bytes);
+    uint64_t best = UINT64_MAX;
+    size_t p;
+
+    for (p = 0; p < passes; p++)
+        {
+            uint64_t t0 = ticks_now ();
+            blit (g_dst, g_src, pixels);
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    g_sink += g_dst[0];
+    print_result (best, bytes);
+}
+
+/* Bytes are counted on the output side: `size` bytes of 32-bit pixels,
+   each source pixel written four times. */
+static void
+bench_replicate (replicate_fn replicate, size_t size)
+{
+    size_t count = size / 16U;
+    size_t bytes = count * 16U;
+    size_t passes = passes_for_bytes (bytes);
+    uint64_t best = UINT64_MAX;
+    size_t p;
+
+    for (p = 0; p < passes; p++)
+        {
+            uint64_t t0 = ticks_now ();
+            replicate (g_dst, g_src, count, 4U);
+            t0 = ticks_now () - t0;
+            if (t0 < best)
+                best = t0;
+        }
+
+    g_sink += g_dst[0];
+    print_result (best, bytes);
+}
+
+/* ------------------------------------------------------------------ */
+/* Verification                                                         */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Each slot of a tier's table runs on the same input as the scalar
+ * slot and the outputs are compared byte for byte, along with a guard
+ * band past the end to catch overruns.  Widths cover every SIMD tail up
+ * to a few vectors plus some long rows, and inputs start one byte off
+ * alignment.
+ */
+#define VERIFY_MAX_WIDTH 1031U
+#define VERIFY_MAX_FACTOR 5U
+#define VERIFY_GUARD 64U
+#define VERIFY_OUT_BYTES                                                     \
+    ((size_t)VERIFY_MAX_WIDTH * PIXEL_MAX_BPP * VERIFY_MAX_FACTOR          \
+     + VERIFY_GUARD)
+#define VERIFY_MAX_REPORTS 20
+
+static const size_t g_verify_long_widths[] = { 127U, 128U, 129U, 255U,
+                                                 256U, 1000U, 1031U };
+
+typedef struct
+{
+    const pixel_kernels_t *ref;
+    const pixel_kernels_t *k;
+    const char *isa;
+    uint8_t *ref_out;
+    uint8_t *out;
+    uint8_t *in; /* scratch input for planted keys and alpha patterns */
+    unsigned long checks;
+    unsigned long failures;
+} verify_t;
+
+static size_t
+verify_width (size_t i)
+{
+    return i < 68U ? i : g_verify_long_widths[i - 68U];
+}
+
+#define VERIFY_WIDTHS                                                        \
+    (68U + sizeof (g_verify_long_widths) / sizeof (g_verify_long_widths[0]))
+
+static void
+verify_reset (verify_t *v)
+{
+    memset (v->ref_out, 0xA5, VERIFY_OUT_BYTES);
+    memset (v->out, 0xA5, VERIFY_OUT_BYTES);
+}
+
+/* Compares `bytes` of output plus the guard band after them. */
+static void
+verify_check (verify_t *v, const char *kernel, size_t width, size_t bytes)
+{
+    v->checks++;
+    if (memcmp (v->ref_out, v->out, bytes + VERIFY_GUARD) == 0)
+        {
+            return;
+        }
+    if (v->failures++ < VERIFY_MAX_REPORTS)
+        {
+            printf (
+                "MISMATCH %-7s %-28s width %u\n",
+                v->isa,
+                kernel,
+                (unsigned)width
+            );
+        }
+}
+
+/* A slot one table fills and the other leaves NULL has no reference. */
+static int
+verify_pair (verify_t *v, const char *kernel, int ref_set, int k_set)
+{
+    if (ref_set == k_set)
+        {
+            return ref_set;
+        }
+    v->checks++;
+    if (v->failures++ < VERIFY_MAX_REPORTS)
+        {
+            printf ("MISMATCH %-7s %-28s slot set in one table only\n",
+                    v->isa, kernel);
+        }
+    return 0;
+}
+
+static void
+verify_unfilter (verify_t *v)
+{
+    static const char *const names[5]
+        = { "none", "sub", "up", "avg", "paeth" };
+    const uint8_t *src = g_src + 1;
+    const uint8_t *prev = g_src + 2U * VERIFY_OUT_BYTES + 3U;
+    size_t bpp;
+    int f;
+    size_t i;
+
+    for (bpp = 1; bpp <= PIXEL_MAX_BPP; bpp++)
+        {
+            for (f = 0; f < 5; f++)
+                {
+                    unfilter_row_fn ref = v->ref->unfilter[bpp][f];
+                    unfilter_row_fn fn = v->k->unfilter[bpp][f];
+                    char label[64];
+
+                    snprintf (
+                        label,
+                        sizeof (label),
+                        "unfilter bpp%u %s",
+                        (unsigned)bpp,
+                        names[f]
+                    );
+                    if (!verify_pair (v, label, ref != NULL, fn != NULL))
+                        {
+                            continue;
+                        }
+                    for (i = 0; i < VERIFY_WIDTHS; i++)
+                        {
+                            size_t bytes = verify_width (i) * bpp;
+
+                            verify_reset (v);
+                            ref (v->ref_out, src, NULL, bytes);
+                            fn (v->out, src, NULL, bytes);
+                            verify_check (v, label, verify_width (i), bytes);
+
+                            verify_reset (v);
+                            ref (v->ref_out, src, prev, bytes);
+                            fn (v->out, src, prev, bytes);
+                            verify_check (v, label, verify_width (i), bytes);
+                        }
+                }
+        }
+
+    for (f = 1; f < 5; f++)
+        {
+            unfilter_rgb_row_fn ref = v->ref->unfilter_rgb_to_rgba[f];
+            unfilter_rgb_row_fn fn = v->k->unfilter_rgb_to_rgba[f];
+            char label[64];
+
+            snprintf (
+                label, sizeof (label), "unfilter rgb->rgba %s", names[f]
+            );
+            if (!verify_pair (v, label, ref != NULL, fn != NULL))
+                {
+                    continue;
+                }
+            /* Rows are never empty; the scalar kernels store the first
+               pixel unconditionally. */
+            for (i = 1; i < VERIFY_WIDTHS; i++)
+                {
+                    size_t width = verify_width (i);
+
+                    verify_reset (v);
+                    ref (v->ref_out, src, NULL, width);
+                    fn (v->out, src, NULL, width);
+                    verify_check (v, label, width, width * 4U);
+
+                    verify_reset (v);
+                    ref (v->ref_out, src, prev, width);
+                    fn (v->out, src, prev, width);
+                    verify_check (v, label, width, width * 4U);
+                }
+        }
+}
+
+static void
+verify_expand (verify_t *v)
+{
+    size_t i;
+    size_t x;
+
+    /* Every third pixel is the key colour (1, 2, 3). */
+    memcpy (v->in, g_src + 1, (size_t)VERIFY_MAX_WIDTH * 4U);
+    for (x = 0; x < VERIFY_MAX_WIDTH; x += 3U)
+        {
+            v->in[x * 3U] = 1U;
+            v->in[x * 3U + 1U] = 2U;
+            v->in[x * 3U + 2U] = 3U;
+        }
+
+    for (i = 0; i < VERIFY_WIDTHS; i++)
+        {
+            size_t width = verify_width (i);
+
+            verify_reset (v);
+            v->ref->expand_rgb (v->ref_out, v->in + 1, width);
+            v->k->expand_rgb (v->out, v->in + 1, width);
+            verify_check (v, "rgb->rgba", width, width * 4U);
+
+            verify_reset (v);
+            v->ref->expand_rgb_key (v->ref_out, v->in, width, 1U, 2U, 3U);
+            v->k->expand_rgb_key (v->out, v->in, width, 1U, 2U, 3U);
+            verify_check (v, "rgb->rgba trns", width, width * 4U);
+
+            /* In place: both start from the same RGBA row with keys. */
+            verify_reset (v);
+            for (x = 0; x < width; x++)
+                {
+                    memcpy (v->ref_out + x * 4U, v->in + x * 3U, 3U);
+                    v->ref_out[x * 4U + 3U] = g_src[x];
+                }
+            memcpy (v->out, v->ref_out, width * 4U);
+            v->ref->key_rgba (v->ref_out, width, 1U, 2U, 3U);
+            v->k->key_rgba (v->out, width, 1U, 2U, 3U);
+            verify_check (v, "key rgba", width, width * 4U);
+        }
+}
+
+static void
+verify_alpha_scan (verify_t *v)
+{
+    size_t i;
+
+    for (i = 1; i < VERIFY_WIDTHS; i++)
+        {
+            size_t width = verify_width (i);
+            size_t bytes = width * 4U;
+            int pattern;
+
+            for (pattern = 0; pattern < 6; pattern++)
+                {
+                    unsigned int want;
+                    unsigned int got;
+                    size_t x;
+
+                    memcpy (v->in, g_src + 1, bytes);
+                    for (x = 0; x < width; x++)
+                        {
+                            v->in[x * 4U + 3U] = pattern < 3 ? 255U : 0U;
+                        }
+                    /* One odd pixel first, last or nowhere. */
+                    if (pattern % 3 == 1)
+                        {
+                            v->in[3] = pattern < 3 ? 254U : 1U;
+                        }
+                    if (pattern % 3 == 2)
+                        {
+                            v->in[bytes - 1U] = pattern < 3 ? 0U : 255U;
+                        }
+                    want = v->ref->alpha_scan (v->in, width);
+                    got = v->k->alpha_scan (v->in, width);
+                    v->checks++;
+                    if (want != got && v->failures++ < VERIFY_MAX_REPORTS)
+                        {
+                            printf (
+                                "MISMATCH %-7s %-28s width %u pattern %d\n",
+                                v->isa,
+                                "alpha scan",
+                                (unsigned)width,
+                                pattern
+                            );
+                        }
+                }
+        }
+}
+
+static void
+verify_blit (verify_t *v)
+{
+    static const char *const names[3]
+        = { "blit xrgb8888", "blit rgb888", "blit rgb565" };
+    const blit_row_fn refs[3] = { v->ref->blit_xrgb8888,
+                                  v->ref->blit_rgb888,
+                                  v->ref->blit_rgb565 };
+    const blit_row_fn fns[3]
+        = { v->k->blit_xrgb8888, v->k->blit_rgb888, v->k->blit_rgb565 };
+    static const size_t out_bpp[3] = { 4U, 3U, 2U };
+    size_t b;
+    size_t i;
+    size_t factor;
+
+    for (b = 0; b < 3U; b++)
+        {
+            if (!verify_pair (v, names[b], refs[b] != NULL, fns[b] != NULL))
+                {
+                    continue;
+                }
+            for (i = 0; i < VERIFY_WIDTHS; i++)
+                {
+                    size_t width = verify_width (i);
+
+                    verify_reset (v);
+                    refs[b] (v->ref_out, g_src + 1, width);
+                    fns[b] (v->out, g_src + 1, width);
+                    verify_check (v, names[b], width, width * out_bpp[b]);
+                }
+        }
+
+    for (factor = 1; factor <= VERIFY_MAX_FACTOR; factor++)
+        {
+            for (i = 0; i < VERIFY_WIDTHS; i++)
+                {
+                    size_t count = verify_width (i);
+
+                    verify_reset (v);
+                    v->ref->replicate32 (
+                        v->ref_out, g_src + 1, count, factor
+                    );
+                    v->k->replicate32 (
+                        v->out, g_src + 1, count, factor
+                    );
+                    verify_check (
+                        v, "replicate32", count, count * factor * 4U
+                    );
+
+                    verify_reset (v);
+                    v->ref->replicate16 (
+                        v->ref_out, g_src + 1, count, factor
+                    );
+                    v->k->replicate16 (
+                        v->out, g_src + 1, count, factor
+                    );
+                    verify_check (
+                        v, "replicate16", count, count * factor * 2U
+                    );
+                }
+        }
+}
+
+/* Returns the number of mismatches over every supported tier. */
+static unsigned long
+verify_kernels (void)
+{
+    pixel_kernels_t ref;
+    pixel_kernels_t k;
+    verify_t v;
+    unsigned long failures = 0;
+    int tiers = 0;
+    int isa;
+
+    memset (&v, 0, sizeof (v));
+    v.ref_out = (uint8_t *)malloc (VERIFY_OUT_BYTES);
+    v.out = (uint8_t *)malloc (VERIFY_OUT_BYTES);
+    v.in = (uint8_t *)malloc (VERIFY_OUT_BYTES);
+    if (!v.ref_out || !v.out || !v.in)
+        {
+            fprintf (stderr, "error: out of memory for verify buffers\n");
+            free (v.ref_out);
+            free (v.out);
+            free (v.in);
+            return 1;
+        }
+
+    pixel_kernels_select (CPU_ISA_SCALAR);
+    ref = *pixel_kernels ();
+    v.ref = &ref;
+    v.k = &k;
+    for (isa = CPU_ISA_SCALAR + 1; isa < CPU_ISA_COUNT; isa++)
+        {
+            if (!pixel_kernels_select ((cpu_isa_t)isa))
+                {
+                    continue;
+                }
+            k = *pixel_kernels ();
+            v.isa = cpu_isa_name ((cpu_isa_t)isa);
+            v.checks = 0;
+            v.failures = 0;
+            verify_unfilter (&v);
+            verify_expand (&v);
+            verify_alpha_scan (&v);
+            verify_blit (&v);
+            printf (
+                "verify %-7s %lu checks, %lu mismatches\n",
+                v.isa,
+                v.checks,
+                v.failures
+            );
+            failures += v.failures;
+            tiers++;
+        }
+    if (tiers == 0)
+        {
+            printf ("verify: only the scalar tier runs here, nothing to "
+                    "compare\n");
+        }
+
+    free (v.ref_out);
+    free (v.out);
+    free (v.in);
+    return failures;
+}
+
+/* ------------------------------------------------------------------ */
+/* Main                                                                 */
+/* ------------------------------------------------------------------ */
+
+static void
+print_header (void)
+{
+    int s;
+
+    print_row_label ("kernel", "isa");
+    for (s = 0; s < N_SIZES; s++)
+        {
+            printf (" %10s", g_size_names[s]);
+        }
+    printf ("\n");
+    print_separator ();
+}
+
+int
+main (int argc, char **argv)
+{
+    static const char *const filter_names[5]
+        = { "none", "sub", "up", "avg", "paeth" };
+    static const size_t bpps[] = { 1U, 2U, 3U, 4U, 6U, 8U };
+    size_t max_size = g_sizes[N_SIZES - 1];
+    size_t buf_size;
+    cpu_isa_t default_isa;
+    int verify = 0;
+    int isa;
+    int s;
+    size_t f;
+
+    if (argc == 2 && strcmp (argv[1], "--verify") == 0)
+        {
+            verify = 1;
+        }
+    else if (argc > 2)
+        {
+            fprintf (
+                stderr, "usage: %s [work_MiB] | --verify\n", argv[0]
+            );
+            return 1;
+        }
+    else if (argc == 2)
+        {
+            char *end = NULL;
+            long v = strtol (argv[1], &end, 10);
+            if (!end || *end != '\0' || v <= 0 || v > 65536L)
+                {
+                    fprintf (
+                        stderr, "error: work_MiB must be a positive integer\n"
+                    );
+                    return 1;
+                }
+            g_work_bytes = (size_t)v * 1024U * 1024U;
+        }
+
+    /* Room for the largest working set plus one filter byte per row
+       (the narrowest rows are BENCH_WIDTH bytes, at bpp 1). */
+    buf_size = max_size + max_size / (size_t)BENCH_WIDTH + 64U;
+    g_src = (uint8_t *)malloc (buf_size);
+    g_dst = (uint8_t *)malloc (buf_size);
+    if (!g_src || !g_dst)
+        {
+            fprintf (stderr, "error: out of memory for bench buffers\n");
+            free (g_src);
+            free (g_dst);
+            return 1;
+        }
+    fill_random (g_src, buf_size, 12345U);
+    memset (g_dst, 0, buf_size);
+    png_init_tables ();
+
+    if (verify)
+        {
+            unsigned long failures = verify_kernels ();
+
+            free (g_src);
+            free (g_dst);
+            return failures == 0 ? 0 : 1;
+        }
+
+    printf ("row width: %u px\n", BENCH_WIDTH);
+    printf (
+        "work per measurement: %.0f MiB (best pass reported)\n",
+        (double)g_work_bytes / (1024.0 * 1024.0)
+    );
+#ifdef PAETH_USE_ARITHMETIC
+    printf ("paeth predictor: arithmetic\n");
+#else
+    printf ("paeth predictor: lookup table\n");
+#endif
+    default_isa = pixel_kernels ()->isa;
+    printf ("kernel isa: %s (default)\n", cpu_isa_name (default_isa));
+    printf ("unit: %s\n", TICK_UNIT);
+    print_separator ();
+    print_header ();
+
+    for (isa = CPU_ISA_SCALAR; isa < CPU_ISA_COUNT; isa++)
+        {
+            const char *isa_name = cpu_isa_name ((cpu_isa_t)isa);
+
+            if (!pixel_kernels_select ((cpu_isa_t)isa))
+                {
+                    continue;
+                }
+
+            for (f = 0; f < 5U; f++)
+                {
+                    char label_rgba[64];
+                    size_t b;
+                    for (b = 0; b < sizeof (bpps) / sizeof (bpps[0]); b++)
+                        {
+                            size_t bpp = bpps[b];
+                            char label[64];
+                            snprintf (
+                                label,
+                                sizeof (label),
+                                "unfilter bpp%u %s",
+                                (unsigned)bpp,
+                                filter_names[f]
+                            );
+                            print_row_label (label, isa_name);
+                            for (s = 0; s < N_SIZES; s++)
+                                {
+                                    bench_unfilter (bpp, (int)f, g_sizes[s]);
+                                }
+                            printf ("\n");
+                        }
+
+                    snprintf (
+                        label_rgba,
+                        sizeof (label_rgba),
+                        "unfilter rgb->rgba %s",
+                        filter_names[f]
+                    );
+                    print_row_label (label_rgba, isa_name);
+                    for (s = 0; s < N_SIZES; s++)
+                        {
+                            bench_unfilter_rgba ((int)f, g_sizes[s]);
+                        }
+                    printf ("\n");
+                }
+
+            print_row_label ("rgb->rgba", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_expand (0, g_sizes[s]);
+                }
+            printf ("\n");
+
+            print_row_label ("rgb->rgba trns", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_expand (1, g_sizes[s]);
+                }
+            printf ("\n");
+
+            print_row_label ("alpha scan", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_alpha_scan (g_sizes[s]);
+                }
+            printf ("\n");
+
+            print_row_label ("blit xrgb8888", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_blit_kernel (
+                        pixel_kernels ()->blit_xrgb8888, g_sizes[s]
+                    );
+                }
+            printf ("\n");
+
+            print_row_label ("blit rgb888", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_blit_kernel (
+                        pixel_kernels ()->blit_rgb888, g_sizes[s]
+                    );
+                }
+            printf ("\n");
+
+            print_row_label ("blit rgb565", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_blit_kernel (
+                        pixel_kernels ()->blit_rgb565, g_sizes[s]
+                    );
+                }
+            printf ("\n");
+
+            print_row_label ("replicate32 x4", isa_name);
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_replicate (
+                        pixel_kernels ()->replicate32, g_sizes[s]
+                    );
+                }
+            printf ("\n");
+            print_separator ();
+        }
+    pixel_kernels_select (default_isa);
+
+    for (f = 0; f < sizeof (g_formats) / sizeof (g_formats[0]); f++)
+        {
+            char label[64];
+
+            snprintf (
+                label, sizeof (label), "pack_pixel %s", g_formats[f].name
+            );
+            print_row_label (label, "scalar");
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_blit (&g_formats[f].format, 0, g_sizes[s]);
+                }
+            printf ("\n");
+
+            snprintf (
+                label, sizeof (label), "blend_pixel %s", g_formats[f].name
+            );
+            print_row_label (label, "scalar");
+            for (s = 0; s < N_SIZES; s++)
+                {
+                    bench_blit (&g_formats[f].format, 1, g_sizes[s]);
+                }
+            printf ("\n");
+        }
+    print_separator ();
+    printf ("checksum: %u\n", (unsigned)g_sink);
+
+    free (g_src);
+    free (g_dst);
+    return 0;
+}
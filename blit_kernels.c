@@ -0,0 +1,517 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "pixel_kernels.h"
+
+/* ------------------------------------------------------------------ */
+/* RGBA -> x8r8g8b8 (LSB first)                                        */
+/* ------------------------------------------------------------------ */
+
+/*
+ * The overwhelmingly common TrueColor visual: one pixel per 32-bit word,
+ * blue in the low byte.  Opaque spans reduce to a byte shuffle.
+ */
+
+static void
+blit_xrgb8888_scalar (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    size_t x;
+
+    for (x = 0; x < width; x++, dst += 4, rgba += 4)
+        {
+            dst[0] = rgba[2];
+            dst[1] = rgba[1];
+            dst[2] = rgba[0];
+            dst[3] = 0U;
+        }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("ssse3")))
+#endif
+static void
+blit_xrgb8888_ssse3 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    __m128i shuf = _mm_setr_epi8 (
+        2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1
+    );
+    size_t x = 0;
+
+    for (; x + 4U <= width; x += 4U)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4U));
+            _mm_storeu_si128 (
+                (__m128i *)(dst + x * 4U), _mm_shuffle_epi8 (v, shuf)
+            );
+        }
+    blit_xrgb8888_scalar (dst + x * 4U, rgba + x * 4U, width - x);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx2")))
+#endif
+static void
+blit_xrgb8888_avx2 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    __m256i shuf = _mm256_setr_epi8 (
+        2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+        2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1
+    );
+    size_t x = 0;
+
+    for (; x + 8U <= width; x += 8U)
+        {
+            __m256i v
+                = _mm256_loadu_si256 ((const __m256i *)(rgba + x * 4U));
+            _mm256_storeu_si256 (
+                (__m256i *)(dst + x * 4U), _mm256_shuffle_epi8 (v, shuf)
+            );
+        }
+    blit_xrgb8888_scalar (dst + x * 4U, rgba + x * 4U, width - x);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx512f,avx512bw")))
+#endif
+static void
+blit_xrgb8888_avx512 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    __m512i shuf = _mm512_broadcast_i32x4 (_mm_setr_epi8 (
+        2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1
+    ));
+    size_t x = 0;
+
+    for (; x + 16U <= width; x += 16U)
+        {
+            __m512i v = _mm512_loadu_si512 ((const void *)(rgba + x * 4U));
+            _mm512_storeu_si512 (
+                (void *)(dst + x * 4U), _mm512_shuffle_epi8 (v, shuf)
+            );
+        }
+    blit_xrgb8888_avx2 (dst + x * 4U, rgba + x * 4U, width - x);
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+/* RGBA -> r8g8b8 (24bpp, LSB first)                                   */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Packed 24-bit pixels, blue first.  The vector versions shuffle four
+ * pixels into twelve bytes and store sixteen, so each store spills four
+ * bytes into the next pixel; the loops stop early enough that the spill
+ * stays inside the span and is overwritten by the following store.
+ */
+
+static void
+blit_rgb888_scalar (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    size_t x;
+
+    for (x = 0; x < width; x++, dst += 3, rgba += 4)
+        {
+            dst[0] = rgba[2];
+            dst[1] = rgba[1];
+            dst[2] = rgba[0];
+        }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("ssse3")))
+#endif
+static void
+blit_rgb888_ssse3 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    __m128i shuf = _mm_setr_epi8 (
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+    );
+    size_t x = 0;
+
+    for (; x + 6U <= width; x += 4U)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4U));
+            _mm_storeu_si128 (
+                (__m128i *)(dst + x * 3U), _mm_shuffle_epi8 (v, shuf)
+            );
+        }
+    blit_rgb888_scalar (dst + x * 3U, rgba + x * 4U, width - x);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx2")))
+#endif
+static void
+blit_rgb888_avx2 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    __m256i shuf = _mm256_setr_epi8 (
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+    );
+    size_t x = 0;
+
+    for (; x + 10U <= width; x += 8U)
+        {
+            __m256i v = _mm256_shuffle_epi8 (
+                _mm256_loadu_si256 ((const __m256i *)(rgba + x * 4U)), shuf
+            );
+            _mm_storeu_si128 (
+                (__m128i *)(dst + x * 3U), _mm256_castsi256_si128 (v)
+            );
+            _mm_storeu_si128 (
+                (__m128i *)(dst + x * 3U + 12U),
+                _mm256_extracti128_si256 (v, 1)
+            );
+        }
+    blit_rgb888_ssse3 (dst + x * 3U, rgba + x * 4U, width - x);
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+/* RGBA -> r5g6b5 (16bpp, LSB first)                                   */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Channels are scaled with the same rounding as the generic packer,
+ * (c * max + 127) / 255, so every visual gets identical output whichever
+ * path draws it.  The vector versions divide by 255 with a 16-bit
+ * multiply-high: x / 255 == (x * 0x8081) >> 23 for every x < 65536.
+ */
+
+static void
+blit_rgb565_scalar (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    size_t x;
+
+    for (x = 0; x < width; x++, dst += 2, rgba += 4)
+        {
+            unsigned int r = ((unsigned int)rgba[0] * 31U + 127U) / 255U;
+            unsigned int g = ((unsigned int)rgba[1] * 63U + 127U) / 255U;
+            unsigned int b = ((unsigned int)rgba[2] * 31U + 127U) / 255U;
+            unsigned int px = (r << 11) | (g << 5) | b;
+
+            dst[0] = (uint8_t)(px & 0xFFU);
+            dst[1] = (uint8_t)(px >> 8);
+        }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Two RGBA pixels widened to 16-bit lanes -> the three positioned
+   fields of each, alpha lane zero; adding a pixel's lanes packs it. */
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("ssse3")))
+#endif
+static inline __m128i
+rgb565_fields_ssse3 (__m128i px16)
+{
+    const __m128i scale = _mm_setr_epi16 (31, 63, 31, 0, 31, 63, 31, 0);
+    const __m128i bias = _mm_setr_epi16 (127, 127, 127, 0, 127, 127, 127, 0);
+    const __m128i place
+        = _mm_setr_epi16 (2048, 32, 1, 0, 2048, 32, 1, 0);
+    __m128i v = _mm_add_epi16 (_mm_mullo_epi16 (px16, scale), bias);
+
+    v = _mm_srli_epi16 (
+        _mm_mulhi_epu16 (v, _mm_set1_epi16 ((short)0x8081)), 7
+    );
+    return _mm_mullo_epi16 (v, place);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("ssse3")))
+#endif
+static void
+blit_rgb565_ssse3 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    size_t x = 0;
+
+    for (; x + 8U <= width; x += 8U)
+        {
+            __m128i a = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4U));
+            __m128i b
+                = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4U + 16U));
+            __m128i ha = _mm_hadd_epi16 (
+                rgb565_fields_ssse3 (_mm_unpacklo_epi8 (a, zero)),
+                rgb565_fields_ssse3 (_mm_unpackhi_epi8 (a, zero))
+            );
+            __m128i hb = _mm_hadd_epi16 (
+                rgb565_fields_ssse3 (_mm_unpacklo_epi8 (b, zero)),
+                rgb565_fields_ssse3 (_mm_unpackhi_epi8 (b, zero))
+            );
+
+            _mm_storeu_si128 (
+                (__m128i *)(dst + x * 2U), _mm_hadd_epi16 (ha, hb)
+            );
+        }
+    blit_rgb565_scalar (dst + x * 2U, rgba + x * 4U, width - x);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx2")))
+#endif
+static inline __m256i
+rgb565_fields_avx2 (__m256i px16)
+{
+    const __m256i scale = _mm256_setr_epi16 (
+        31, 63, 31, 0, 31, 63, 31, 0, 31, 63, 31, 0, 31, 63, 31, 0
+    );
+    const __m256i bias = _mm256_setr_epi16 (
+        127, 127, 127, 0, 127, 127, 127, 0,
+        127, 127, 127, 0, 127, 127, 127, 0
+    );
+    const __m256i place = _mm256_setr_epi16 (
+        2048, 32, 1, 0, 2048, 32, 1, 0, 2048, 32, 1, 0, 2048, 32, 1, 0
+    );
+    __m256i v = _mm256_add_epi16 (_mm256_mullo_epi16 (px16, scale), bias);
+
+    v = _mm256_srli_epi16 (
+        _mm256_mulhi_epu16 (v, _mm256_set1_epi16 ((short)0x8081)), 7
+    );
+    return _mm256_mullo_epi16 (v, place);
+}
+
+/* hadd works within 128-bit lanes, so the sixteen packed pixels come out
+   as quarters 0,2,1,3 and one cross-lane permute restores the order. */
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx2")))
+#endif
+static void
+blit_rgb565_avx2 (uint8_t *dst, const uint8_t *rgba, size_t width)
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    size_t x = 0;
+
+    for (; x + 16U <= width; x += 16U)
+        {
+            __m256i a
+                = _mm256_loadu_si256 ((const __m256i *)(rgba + x * 4U));
+            __m256i b = _mm256_loadu_si256 (
+                (const __m256i *)(rgba + x * 4U + 32U)
+            );
+            __m256i ha = _mm256_hadd_epi16 (
+                rgb565_fields_avx2 (_mm256_unpacklo_epi8 (a, zero)),
+                rgb565_fields_avx2 (_mm256_unpackhi_epi8 (a, zero))
+            );
+            __m256i hb = _mm256_hadd_epi16 (
+                rgb565_fields_avx2 (_mm256_unpacklo_epi8 (b, zero)),
+                rgb565_fields_avx2 (_mm256_unpackhi_epi8 (b, zero))
+            );
+
+            _mm256_storeu_si256 (
+                (__m256i *)(dst + x * 2U),
+                _mm256_permute4x64_epi64 (
+                    _mm256_hadd_epi16 (ha, hb), _MM_SHUFFLE (3, 1, 2, 0)
+                )
+            );
+        }
+    blit_rgb565_ssse3 (dst + x * 2U, rgba + x * 4U, width - x);
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Pixel replication                                                   */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Each run of `factor` copies is filled with whole vector stores of the
+ * broadcast pixel.  A store may spill past its run into the following
+ * ones, which are written afterwards and overwrite it, so only the runs
+ * close to the end of the span need the scalar loop.
+ */
+
+static void
+replicate32_scalar (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++, src += 4)
+        {
+            for (j = 0; j < factor; j++, dst += 4)
+                {
+                    memcpy (dst, src, 4);
+                }
+        }
+}
+
+static void
+replicate16_scalar (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++, src += 2)
+        {
+            for (j = 0; j < factor; j++, dst += 2)
+                {
+                    memcpy (dst, src, 2);
+                }
+        }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static void
+replicate32_sse2 (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+)
+{
+    uint8_t *end = dst + count * factor * 4U;
+    size_t run = factor * 4U;
+    size_t i = 0;
+
+    for (; i < count && (size_t)(end - dst) >= run + 16U; i++, src += 4)
+        {
+            uint32_t px;
+            __m128i v;
+            size_t off;
+
+            memcpy (&px, src, 4);
+            v = _mm_set1_epi32 ((int)px);
+            for (off = 0; off < run; off += 16U)
+                {
+                    _mm_storeu_si128 ((__m128i *)(dst + off), v);
+                }
+            dst += run;
+        }
+    replicate32_scalar (dst, src, count - i, factor);
+}
+
+static void
+replicate16_sse2 (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+)
+{
+    uint8_t *end = dst + count * factor * 2U;
+    size_t run = factor * 2U;
+    size_t i = 0;
+
+    for (; i < count && (size_t)(end - dst) >= run + 16U; i++, src += 2)
+        {
+            uint16_t px;
+            __m128i v;
+            size_t off;
+
+            memcpy (&px, src, 2);
+            v = _mm_set1_epi16 ((short)px);
+            for (off = 0; off < run; off += 16U)
+                {
+                    _mm_storeu_si128 ((__m128i *)(dst + off), v);
+                }
+            dst += run;
+        }
+    replicate16_scalar (dst, src, count - i, factor);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx2")))
+#endif
+static void
+replicate32_avx2 (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+)
+{
+    uint8_t *end = dst + count * factor * 4U;
+    size_t run = factor * 4U;
+    size_t i = 0;
+
+    for (; i < count && (size_t)(end - dst) >= run + 32U; i++, src += 4)
+        {
+            uint32_t px;
+            __m256i v;
+            size_t off;
+
+            memcpy (&px, src, 4);
+            v = _mm256_set1_epi32 ((int)px);
+            for (off = 0; off < run; off += 32U)
+                {
+                    _mm256_storeu_si256 ((__m256i *)(dst + off), v);
+                }
+            dst += run;
+        }
+    replicate32_sse2 (dst, src, count - i, factor);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__ ((target ("avx2")))
+#endif
+static void
+replicate16_avx2 (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+)
+{
+    uint8_t *end = dst + count * factor * 2U;
+    size_t run = factor * 2U;
+    size_t i = 0;
+
+    for (; i < count && (size_t)(end - dst) >= run + 32U; i++, src += 2)
+        {
+            uint16_t px;
+            __m256i v;
+            size_t off;
+
+            memcpy (&px, src, 2);
+            v = _mm256_set1_epi16 ((short)px);
+            for (off = 0; off < run; off += 32U)
+                {
+                    _mm256_storeu_si256 ((__m256i *)(dst + off), v);
+                }
+            dst += run;
+        }
+    replicate16_sse2 (dst, src, count - i, factor);
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+/* Registration                                                        */
+/* ------------------------------------------------------------------ */
+
+void
+blit_register_kernels (pixel_kernels_t *k, cpu_isa_t isa)
+{
+    k->blit_xrgb8888 = blit_xrgb8888_scalar;
+    k->blit_rgb888 = blit_rgb888_scalar;
+    k->blit_rgb565 = blit_rgb565_scalar;
+    k->replicate32 = replicate32_scalar;
+    k->replicate16 = replicate16_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (isa == CPU_ISA_NEON)
+        {
+            return;
+        }
+    if (isa >= CPU_ISA_SSE2)
+        {
+            k->replicate32 = replicate32_sse2;
+            k->replicate16 = replicate16_sse2;
+        }
+    if (isa >= CPU_ISA_SSSE3)
+        {
+            k->blit_xrgb8888 = blit_xrgb8888_ssse3;
+            k->blit_rgb888 = blit_rgb888_ssse3;
+            k->blit_rgb565 = blit_rgb565_ssse3;
+        }
+    if (isa >= CPU_ISA_AVX2)
+        {
+            k->blit_xrgb8888 = blit_xrgb8888_avx2;
+            k->blit_rgb888 = blit_rgb888_avx2;
+            k->blit_rgb565 = blit_rgb565_avx2;
+            k->replicate32 = replicate32_avx2;
+            k->replicate16 = replicate16_avx2;
+        }
+    if (isa >= CPU_ISA_AVX512)
+        {
+            k->blit_xrgb8888 = blit_xrgb8888_avx512;
+        }
+#endif
+    (void)isa;
+}
@@ -1,8 +1,10 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cli.h"
+#include "viewer.h"
 
 static int
 hex_nibble (char c)
@@ -83,6 +85,21 @@ parse_bg (const char *arg, bg_config_t *bg)
     return 0;
 }
 
+static int
+parse_fps (const char *arg, int *fps)
+{
+    char *end;
+    long value = strtol (arg, &end, 10);
+
+    if (end == arg || *end != '\0' || value < VIEWER_MIN_FPS
+        || value > VIEWER_MAX_FPS)
+        {
+            return 0;
+        }
+    *fps = (int)value;
+    return 1;
+}
+
 int
 app_options_parse (int argc, char **argv, app_options_t *out)
 {
@@ -93,9 +110,17 @@ app_options_parse (int argc, char **argv, app_options_t *out)
     out->bg.solid_r = 32U;
     out->bg.solid_g = 32U;
     out->bg.solid_b = 32U;
+    out->integer_zoom = 0;
+    out->frame_rate = VIEWER_DEFAULT_FPS;
 
     for (i = 1; i < argc; i++)
         {
+            if (strcmp (argv[i], "--integer-zoom") == 0)
+                {
+                    out->integer_zoom = 1;
+                    continue;
+                }
+
             if (strcmp (argv[i], "--bg") == 0)
                 {
                     if (i + 1 >= argc)
@@ -114,7 +139,30 @@ app_options_parse (int argc, char **argv, app_options_t *out)
                     continue;
                 }
 
-            if (argv[i][0] == '-')
+            if (strcmp (argv[i], "--fps") == 0)
+                {
+                    if (i + 1 >= argc)
+                        {
+                            fprintf (stderr, "missing value after --fps\n");
+                            return 0;
+                        }
+                    i++;
+                    if (!parse_fps (argv[i], &out->frame_rate))
+                        {
+                            fprintf (
+                                stderr,
+                                "invalid --fps value '%s' (%d-%d)\n",
+                                argv[i],
+                                VIEWER_MIN_FPS,
+                                VIEWER_MAX_FPS
+                            );
+                            return 0;
+                        }
+                    continue;
+                }
+
+            /* A lone "-" is the image on stdin. */
+            if (argv[i][0] == '-' && argv[i][1] != '\0')
                 {
                     fprintf (stderr, "unknown option: %s\n", argv[i]);
                     return 0;
@@ -140,10 +188,27 @@ app_options_parse (int argc, char **argv, app_options_t *out)
 void
 app_options_usage (const char *argv0)
 {
-    fprintf (stderr, "usage: %s [--bg mode] image.(png|ppm)\n", argv0);
+    fprintf (
+        stderr,
+        "usage: %s [--bg mode] [--integer-zoom] [--fps n] "
+        "image.(png|ppm)|-\n",
+        argv0
+    );
     fprintf (
         stderr,
         "  --bg checkered | solid | solid:#RRGGBB (default: checkered)\n"
     );
+    fprintf (
+        stderr, "  --integer-zoom  zoom in whole multiples from 1:1 up\n"
+    );
+    fprintf (
+        stderr,
+        "  --fps n         redraw at most n times a second (%d-%d, "
+        "default %d)\n",
+        VIEWER_MIN_FPS,
+        VIEWER_MAX_FPS,
+        VIEWER_DEFAULT_FPS
+    );
     fprintf (stderr, "supports: PNG (alpha), binary PPM (P6)\n");
+    fprintf (stderr, "'-' reads the image from stdin, e.g. from a pipe\n");
 }
@@ -7,6 +7,8 @@ typedef struct
 {
     const char *image_path;
     bg_config_t bg;
+    int integer_zoom;
+    int frame_rate;
 } app_options_t;
 
 int app_options_parse (int argc, char **argv, app_options_t *out);
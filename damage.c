@@ -0,0 +1,146 @@
+#include "damage.h"
+
+static long long
+rect_area (const render_rect_t *r)
+{
+    return (long long)r->w * (long long)r->h;
+}
+
+static void
+rect_union (render_rect_t *acc, const render_rect_t *r)
+{
+    int x1 = acc->x + acc->w > r->x + r->w ? acc->x + acc->w : r->x + r->w;
+    int y1 = acc->y + acc->h > r->y + r->h ? acc->y + acc->h : r->y + r->h;
+
+    acc->x = acc->x < r->x ? acc->x : r->x;
+    acc->y = acc->y < r->y ? acc->y : r->y;
+    acc->w = x1 - acc->x;
+    acc->h = y1 - acc->y;
+}
+
+static int
+rect_contains (const render_rect_t *outer, const render_rect_t *r)
+{
+    return r->x >= outer->x && r->y >= outer->y
+           && r->x + r->w <= outer->x + outer->w
+           && r->y + r->h <= outer->y + outer->h;
+}
+
+void
+damage_clear (damage_t *damage)
+{
+    damage->full = 0;
+    damage->count = 0;
+    damage->scroll_dx = 0;
+    damage->scroll_dy = 0;
+}
+
+void
+damage_add_all (damage_t *damage)
+{
+    damage->full = 1;
+    damage->count = 0;
+    damage->scroll_dx = 0;
+    damage->scroll_dy = 0;
+}
+
+void
+damage_add (damage_t *damage, const render_rect_t *rect, int win_w, int win_h)
+{
+    render_rect_t r = *rect;
+    long long area = 0;
+    int i;
+
+    if (damage->full)
+        {
+            return;
+        }
+    if (r.x < 0)
+        {
+            r.w += r.x;
+            r.x = 0;
+        }
+    if (r.y < 0)
+        {
+            r.h += r.y;
+            r.y = 0;
+        }
+    if (r.w > win_w - r.x)
+        {
+            r.w = win_w - r.x;
+        }
+    if (r.h > win_h - r.y)
+        {
+            r.h = win_h - r.y;
+        }
+    if (r.w <= 0 || r.h <= 0)
+        {
+            return;
+        }
+
+    for (i = 0; i < damage->count; i++)
+        {
+            if (rect_contains (&damage->rects[i], &r))
+                {
+                    return;
+                }
+        }
+    if (damage->count == DAMAGE_MAX_RECTS)
+        {
+            for (i = 1; i < damage->count; i++)
+                {
+                    rect_union (&damage->rects[0], &damage->rects[i]);
+                }
+            damage->count = 1;
+            rect_union (&damage->rects[0], &r);
+        }
+    else
+        {
+            damage->rects[damage->count++] = r;
+        }
+
+    for (i = 0; i < damage->count; i++)
+        {
+            area += rect_area (&damage->rects[i]);
+        }
+    if (area * 4 >= (long long)win_w * (long long)win_h * 3)
+        {
+            damage_add_all (damage);
+        }
+}
+
+int
+damage_empty (const damage_t *damage)
+{
+    return !damage->full && damage->count == 0 && damage->scroll_dx == 0
+           && damage->scroll_dy == 0;
+}
+
+void
+damage_scroll (damage_t *damage, int dx, int dy, int win_w, int win_h)
+{
+    render_rect_t moved[DAMAGE_MAX_RECTS];
+    int count = damage->count;
+    int i;
+
+    if (damage->full)
+        {
+            return;
+        }
+    for (i = 0; i < count; i++)
+        {
+            moved[i] = damage->rects[i];
+            moved[i].x += dx;
+            moved[i].y += dy;
+        }
+    damage->count = 0;
+    for (i = 0; i < count; i++)
+        {
+            damage_add (damage, &moved[i], win_w, win_h);
+        }
+    if (!damage->full)
+        {
+            damage->scroll_dx += dx;
+            damage->scroll_dy += dy;
+        }
+}
@@ -0,0 +1,40 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include "renderer.h"
+
+/*
+ * Window areas that need redrawing, gathered between two frames.
+ *
+ * Rectangles are kept as added, clipped to the window.  Past
+ * DAMAGE_MAX_RECTS they collapse into their bounding box, and once the
+ * damaged area is most of the window the whole window is marked
+ * instead, since a full redraw is then no slower.
+ *
+ * A pan is recorded as a scroll: the previous frame is shifted by
+ * (scroll_dx, scroll_dy) before the rectangles are redrawn, and the
+ * owner adds whatever the shift uncovers.
+ */
+
+#define DAMAGE_MAX_RECTS 32
+
+typedef struct
+{
+    int full;
+    int count;
+    int scroll_dx;
+    int scroll_dy;
+    render_rect_t rects[DAMAGE_MAX_RECTS];
+} damage_t;
+
+void damage_clear (damage_t *damage);
+void damage_add_all (damage_t *damage);
+void damage_add (
+    damage_t *damage, const render_rect_t *rect, int win_w, int win_h
+);
+int damage_empty (const damage_t *damage);
+
+/* Adds a shift of the previous frame; rectangles so far move with it. */
+void damage_scroll (damage_t *damage, int dx, int dy, int win_w, int win_h);
+
+#endif
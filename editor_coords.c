@@ -36,8 +36,6 @@ compute_view_rect (
     view_rect_t *out
 )
 {
-    double fit_scale;
-    double zoom;
     double scale;
     long long scaled_w;
     long long scaled_h;
@@ -54,14 +52,7 @@ compute_view_rect (
             return;
         }
 
-    fit_scale = (double)win_w / (double)img_w;
-    if ((double)win_h / (double)img_h < fit_scale)
-        {
-            fit_scale = (double)win_h / (double)img_h;
-        }
-
-    zoom = (view && view->zoom > 0.0f) ? (double)view->zoom : 1.0;
-    scale = fit_scale * zoom;
+    scale = renderer_view_scale (img_w, img_h, win_w, win_h, view);
 
     scaled_w = (long long)((double)img_w * scale + 0.5);
     scaled_h = (long long)((double)img_h * scale + 0.5);
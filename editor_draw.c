@@ -4,8 +4,7 @@
 
 static void
 plot_blended (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     int x,
     int y,
     uint8_t r,
@@ -14,25 +13,26 @@ plot_blended (
     uint8_t alpha
 )
 {
+    const viewer_t *viewer = target->viewer;
     size_t stride;
     uint8_t *dst_px;
 
-    if (x < 0 || y < 0 || x >= viewer->win_w || y >= viewer->win_h)
+    if (x < target->clip_x0 || y < target->clip_y0 || x >= target->clip_x1
+        || y >= target->clip_y1)
         {
             return;
         }
 
     stride
         = (size_t)viewer->win_w * (size_t)viewer->pixel_format.bytes_per_pixel;
-    dst_px = buf + (size_t)y * stride
+    dst_px = target->buf + (size_t)y * stride
              + (size_t)x * (size_t)viewer->pixel_format.bytes_per_pixel;
     blend_pixel (&viewer->pixel_format, dst_px, r, g, b, alpha);
 }
 
 void
 fill_rect_blended (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     const rect_i_t *r,
     uint8_t cr,
     uint8_t cg,
@@ -40,20 +40,20 @@ fill_rect_blended (
     uint8_t alpha
 )
 {
-    int x0 = r->x < 0 ? 0 : r->x;
-    int y0 = r->y < 0 ? 0 : r->y;
+    int x0 = r->x < target->clip_x0 ? target->clip_x0 : r->x;
+    int y0 = r->y < target->clip_y0 ? target->clip_y0 : r->y;
     int x1 = r->x + r->w;
     int y1 = r->y + r->h;
     int x;
     int y;
 
-    if (x1 > viewer->win_w)
+    if (x1 > target->clip_x1)
         {
-            x1 = viewer->win_w;
+            x1 = target->clip_x1;
         }
-    if (y1 > viewer->win_h)
+    if (y1 > target->clip_y1)
         {
-            y1 = viewer->win_h;
+            y1 = target->clip_y1;
         }
 
     if (x0 >= x1 || y0 >= y1)
@@ -65,15 +65,14 @@ fill_rect_blended (
         {
             for (x = x0; x < x1; x++)
                 {
-                    plot_blended (viewer, buf, x, y, cr, cg, cb, alpha);
+                    plot_blended (target, x, y, cr, cg, cb, alpha);
                 }
         }
 }
 
 void
 draw_line_blended (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     int x0,
     int y0,
     int x1,
@@ -89,21 +88,33 @@ draw_line_blended (
     int sx = x0 < x1 ? 1 : -1;
     int sy = y0 < y1 ? 1 : -1;
     int err = dx - dy;
+    int e2;
+
+    /* Wholly to one side of the clip rectangle: nothing to plot. */
+    if ((y0 < target->clip_y0 && y1 < target->clip_y0)
+        || (y0 >= target->clip_y1 && y1 >= target->clip_y1)
+        || (x0 < target->clip_x0 && x1 < target->clip_x0)
+        || (x0 >= target->clip_x1 && x1 >= target->clip_x1))
+        {
+            return;
+        }
 
     while (1)
         {
-            plot_blended (viewer, buf, x0, y0, r, g, b, alpha);
+            plot_blended (target, x0, y0, r, g, b, alpha);
             if (x0 == x1 && y0 == y1)
                 {
                     break;
                 }
 
-            if (2 * err > -dy)
+            /* Both tests use the error from before this step. */
+            e2 = 2 * err;
+            if (e2 > -dy)
                 {
                     err -= dy;
                     x0 += sx;
                 }
-            if (2 * err < dx)
+            if (e2 < dx)
                 {
                     err += dx;
                     y0 += sy;
@@ -113,8 +124,7 @@ draw_line_blended (
 
 void
 draw_rect_outline (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     const rect_i_t *r,
     uint8_t cr,
     uint8_t cg,
@@ -132,8 +142,8 @@ draw_rect_outline (
             return;
         }
 
-    draw_line_blended (viewer, buf, x0, y0, x1, y0, cr, cg, cb, alpha);
-    draw_line_blended (viewer, buf, x1, y0, x1, y1, cr, cg, cb, alpha);
-    draw_line_blended (viewer, buf, x1, y1, x0, y1, cr, cg, cb, alpha);
-    draw_line_blended (viewer, buf, x0, y1, x0, y0, cr, cg, cb, alpha);
+    draw_line_blended (target, x0, y0, x1, y0, cr, cg, cb, alpha);
+    draw_line_blended (target, x1, y0, x1, y1, cr, cg, cb, alpha);
+    draw_line_blended (target, x1, y1, x0, y1, cr, cg, cb, alpha);
+    draw_line_blended (target, x0, y1, x0, y0, cr, cg, cb, alpha);
 }
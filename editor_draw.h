@@ -11,9 +11,23 @@
 /* All functions write directly into the raw pixel draw buffer.        */
 /* ------------------------------------------------------------------ */
 
+/*
+ * Where primitives draw: the viewer's draw buffer, limited to columns
+ * [clip_x0, clip_x1) and rows [clip_y0, clip_y1), so that bands of one
+ * frame can be drawn in parallel and damaged areas redrawn alone.
+ */
+typedef struct
+{
+    const viewer_t *viewer;
+    uint8_t *buf;
+    int clip_x0;
+    int clip_y0;
+    int clip_x1;
+    int clip_y1;
+} draw_target_t;
+
 void fill_rect_blended (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     const rect_i_t *r,
     uint8_t cr,
     uint8_t cg,
@@ -22,8 +36,7 @@ void fill_rect_blended (
 );
 
 void draw_line_blended (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     int x0,
     int y0,
     int x1,
@@ -35,8 +48,7 @@ void draw_line_blended (
 );
 
 void draw_rect_outline (
-    const viewer_t *viewer,
-    uint8_t *buf,
+    const draw_target_t *target,
     const rect_i_t *r,
     uint8_t cr,
     uint8_t cg,
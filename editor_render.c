@@ -45,8 +45,9 @@ viewer_draw_text (
 }
 
 void
-editor_draw_sections (const viewer_t *viewer, const image_t *img, uint8_t *buf)
+editor_draw_sections (const draw_target_t *target, const image_t *img)
 {
+    const viewer_t *viewer = target->viewer;
     int i;
     view_rect_t vr;
 
@@ -87,7 +88,7 @@ editor_draw_sections (const viewer_t *viewer, const image_t *img, uint8_t *buf)
                     g = 230;
                     b = 230;
                     a = 185;
-                    draw_rect_outline (viewer, buf, &sr, r, g, b, a);
+                    draw_rect_outline (target, &sr, r, g, b, a);
 
                     sr.x += 1;
                     sr.y += 1;
@@ -95,19 +96,20 @@ editor_draw_sections (const viewer_t *viewer, const image_t *img, uint8_t *buf)
                     sr.h -= 2;
                     if (sr.w > 0 && sr.h > 0)
                         {
-                            draw_rect_outline (viewer, buf, &sr, r, g, b, 130);
+                            draw_rect_outline (target, &sr, r, g, b, 130);
                         }
                 }
             else
                 {
-                    draw_rect_outline (viewer, buf, &sr, r, g, b, a);
+                    draw_rect_outline (target, &sr, r, g, b, a);
                 }
         }
 }
 
 void
-editor_draw_cuts (const viewer_t *viewer, const image_t *img, uint8_t *buf)
+editor_draw_cuts (const draw_target_t *target, const image_t *img)
 {
+    const viewer_t *viewer = target->viewer;
     int i;
     view_rect_t vr;
 
@@ -136,16 +138,16 @@ editor_draw_cuts (const viewer_t *viewer, const image_t *img, uint8_t *buf)
             uint8_t b = i == g_editor.selected_cut ? 70 : 60;
             uint8_t a = i == g_editor.selected_cut ? 255 : 215;
 
-            draw_line_blended (viewer, buf, x1, y1, x2, y2, r, g, b, a);
+            draw_line_blended (target, x1, y1, x2, y2, r, g, b, a);
 
             if (i == g_editor.selected_cut)
                 {
                     rect_i_t h1 = { x1 - 3, y1 - 3, 7, 7 };
                     rect_i_t h2 = { x2, y2, 7, 7 };
-                    fill_rect_blended (viewer, buf, &h1, 255, 255, 200, 240);
-                    fill_rect_blended (viewer, buf, &h2, 255, 255, 200, 240);
-                    draw_rect_outline (viewer, buf, &h1, 50, 20, 20, 255);
-                    draw_rect_outline (viewer, buf, &h2, 50, 20, 20, 255);
+                    fill_rect_blended (target, &h1, 255, 255, 200, 240);
+                    fill_rect_blended (target, &h2, 255, 255, 200, 240);
+                    draw_rect_outline (target, &h1, 50, 20, 20, 255);
+                    draw_rect_outline (target, &h2, 50, 20, 20, 255);
                 }
         }
 
@@ -155,14 +157,12 @@ editor_draw_cuts (const viewer_t *viewer, const image_t *img, uint8_t *buf)
             int y1 = image_to_screen_y (&vr, img, g_editor.preview_y1);
             int x2 = image_to_screen_x (&vr, img, g_editor.preview_x2);
             int y2 = image_to_screen_y (&vr, img, g_editor.preview_y2);
-            draw_line_blended (
-                viewer, buf, x1, y1, x2, y2, 110, 255, 130, 255
-            );
+            draw_line_blended (target, x1, y1, x2, y2, 110, 255, 130, 255);
         }
 }
 
 void
-editor_draw_hud (const viewer_t *viewer, uint8_t *buf)
+editor_draw_hud (const draw_target_t *target)
 {
     hud_layout_t layout;
     rect_i_t button;
@@ -172,49 +172,302 @@ editor_draw_hud (const viewer_t *viewer, uint8_t *buf)
             return;
         }
 
-    hud_get_layout (viewer, &layout);
-    fill_rect_blended (viewer, buf, &layout.bar, 15, 22, 30, 150);
-    draw_rect_outline (viewer, buf, &layout.bar, 110, 130, 155, 180);
+    hud_get_layout (target->viewer, &layout);
+    fill_rect_blended (target, &layout.bar, 15, 22, 30, 150);
+    draw_rect_outline (target, &layout.bar, 110, 130, 155, 180);
 
     button = layout.buttons[HUD_BTN_DRAW];
     fill_rect_blended (
-        viewer,
-        buf,
+        target,
         &button,
         g_editor.tool == TOOL_DRAW ? 52 : 34,
         g_editor.tool == TOOL_DRAW ? 144 : 62,
         g_editor.tool == TOOL_DRAW ? 95 : 72,
         205
     );
-    draw_rect_outline (viewer, buf, &button, 170, 220, 180, 240);
+    draw_rect_outline (target, &button, 170, 220, 180, 240);
 
     button = layout.buttons[HUD_BTN_SELECT];
     fill_rect_blended (
-        viewer,
-        buf,
+        target,
         &button,
         g_editor.tool == TOOL_SELECT ? 48 : 34,
         g_editor.tool == TOOL_SELECT ? 98 : 62,
         g_editor.tool == TOOL_SELECT ? 165 : 88,
         205
     );
-    draw_rect_outline (viewer, buf, &button, 175, 190, 240, 240);
+    draw_rect_outline (target, &button, 175, 190, 240, 240);
 
     button = layout.buttons[HUD_BTN_MOVE];
     fill_rect_blended (
-        viewer,
-        buf,
+        target,
         &button,
         g_editor.tool == TOOL_MOVE ? 42 : 34,
         g_editor.tool == TOOL_MOVE ? 126 : 62,
         g_editor.tool == TOOL_MOVE ? 132 : 88,
         205
     );
-    draw_rect_outline (viewer, buf, &button, 160, 230, 232, 240);
+    draw_rect_outline (target, &button, 160, 230, 232, 240);
 
     button = layout.buttons[HUD_BTN_GRID];
-    fill_rect_blended (viewer, buf, &button, 120, 90, 34, 210);
-    draw_rect_outline (viewer, buf, &button, 245, 210, 120, 245);
+    fill_rect_blended (target, &button, 120, 90, 34, 210);
+    draw_rect_outline (target, &button, 245, 210, 120, 245);
+}
+
+/* ------------------------------------------------------------------ */
+/* Damage                                                              */
+/* ------------------------------------------------------------------ */
+
+static void
+damage_box (
+    const viewer_t *viewer, damage_t *damage, int x0, int y0, int x1, int y1
+)
+{
+    render_rect_t r;
+
+    r.x = x0;
+    r.y = y0;
+    r.w = x1 - x0;
+    r.h = y1 - y0;
+    damage_add (damage, &r, viewer->win_w, viewer->win_h);
+}
+
+/* The line plus, for the selected cut, its endpoint handles. */
+static void
+damage_cut (
+    const viewer_t *viewer,
+    const view_rect_t *vr,
+    const image_t *img,
+    const cut_t *cut,
+    damage_t *damage
+)
+{
+    int x1 = image_to_screen_x (vr, img, cut->x1);
+    int y1 = image_to_screen_y (vr, img, cut->y1);
+    int x2 = image_to_screen_x (vr, img, cut->x2);
+    int y2 = image_to_screen_y (vr, img, cut->y2);
+
+    damage_box (
+        viewer,
+        damage,
+        (x1 < x2 ? x1 : x2) - 3,
+        (y1 < y2 ? y1 : y2) - 3,
+        (x1 > x2 ? x1 : x2) + 8,
+        (y1 > y2 ? y1 : y2) + 8
+    );
+}
+
+/* The four edges only: the inside of a section is not drawn. */
+static void
+damage_section (
+    const viewer_t *viewer,
+    const view_rect_t *vr,
+    const image_t *img,
+    const section_t *s,
+    damage_t *damage
+)
+{
+    int x0 = image_edge_to_screen_x (vr, img, s->x);
+    int y0 = image_edge_to_screen_y (vr, img, s->y);
+    int x1 = image_edge_to_screen_x (vr, img, s->x + s->w);
+    int y1 = image_edge_to_screen_y (vr, img, s->y + s->h);
+
+    if (x1 <= x0 || y1 <= y0)
+        {
+            return;
+        }
+    damage_box (viewer, damage, x0, y0, x1, y0 + 2);
+    damage_box (viewer, damage, x0, y1 - 2, x1, y1);
+    damage_box (viewer, damage, x0, y0, x0 + 2, y1);
+    damage_box (viewer, damage, x1 - 2, y0, x1, y1);
+}
+
+static void
+damage_preview (
+    const viewer_t *viewer,
+    const view_rect_t *vr,
+    const image_t *img,
+    const editor_state_t *st,
+    damage_t *damage
+)
+{
+    int x1 = image_to_screen_x (vr, img, st->preview_x1);
+    int y1 = image_to_screen_y (vr, img, st->preview_y1);
+    int x2 = image_to_screen_x (vr, img, st->preview_x2);
+    int y2 = image_to_screen_y (vr, img, st->preview_y2);
+
+    if (!st->preview_active)
+        {
+            return;
+        }
+    damage_box (
+        viewer,
+        damage,
+        x1 < x2 ? x1 : x2,
+        y1 < y2 ? y1 : y2,
+        (x1 > x2 ? x1 : x2) + 1,
+        (y1 > y2 ? y1 : y2) + 1
+    );
+}
+
+/*
+ * The overlay pinned to the window rather than the image: the HUD strip
+ * with the summary line above it, whose text may be wider than the bar,
+ * or the "HUD hidden" label.
+ */
+static void
+pinned_box (const viewer_t *viewer, int hud_visible, render_rect_t *r)
+{
+    hud_layout_t layout;
+
+    r->x = 0;
+    r->w = viewer->win_w;
+    if (!hud_visible)
+        {
+            r->y = 0;
+            r->h = 32;
+            return;
+        }
+    hud_get_layout (viewer, &layout);
+    r->y = layout.bar.y - 24;
+    r->h = layout.bar.h + 24;
+}
+
+static int
+section_equal (const section_t *a, const section_t *b)
+{
+    return a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h;
+}
+
+void
+editor_overlay_damage (
+    const viewer_t *viewer,
+    const image_t *img,
+    const editor_state_t *before,
+    damage_t *damage
+)
+{
+    const editor_state_t *after = &g_editor;
+    view_rect_t vr;
+    int count;
+    int i;
+
+    if (before->hud_visible != after->hud_visible)
+        {
+            damage_add_all (damage);
+            return;
+        }
+
+    compute_view_rect (
+        img->width,
+        img->height,
+        viewer->win_w,
+        viewer->win_h,
+        &viewer->view,
+        &vr
+    );
+    if (vr.draw_w > 0 && vr.draw_h > 0)
+        {
+            count = before->cut_count > after->cut_count ? before->cut_count
+                                                         : after->cut_count;
+            for (i = 0; i < count; i++)
+                {
+                    int was = i < before->cut_count;
+                    int is = i < after->cut_count;
+
+                    if (was && is
+                        && editor_cut_equals (
+                            &before->cuts[i], &after->cuts[i]
+                        )
+                        && (i == before->selected_cut)
+                               == (i == after->selected_cut))
+                        {
+                            continue;
+                        }
+                    if (was)
+                        {
+                            damage_cut (
+                                viewer, &vr, img, &before->cuts[i], damage
+                            );
+                        }
+                    if (is)
+                        {
+                            damage_cut (
+                                viewer, &vr, img, &after->cuts[i], damage
+                            );
+                        }
+                }
+
+            count = before->section_count > after->section_count
+                        ? before->section_count
+                        : after->section_count;
+            for (i = 0; i < count; i++)
+                {
+                    int was = i < before->section_count;
+                    int is = i < after->section_count;
+
+                    if (was && is
+                        && section_equal (
+                            &before->sections[i], &after->sections[i]
+                        )
+                        && (i == before->selected_section)
+                               == (i == after->selected_section))
+                        {
+                            continue;
+                        }
+                    if (was)
+                        {
+                            damage_section (
+                                viewer, &vr, img, &before->sections[i], damage
+                            );
+                        }
+                    if (is)
+                        {
+                            damage_section (
+                                viewer, &vr, img, &after->sections[i], damage
+                            );
+                        }
+                }
+
+            if (before->preview_active != after->preview_active
+                || before->preview_x1 != after->preview_x1
+                || before->preview_y1 != after->preview_y1
+                || before->preview_x2 != after->preview_x2
+                || before->preview_y2 != after->preview_y2)
+                {
+                    damage_preview (viewer, &vr, img, before, damage);
+                    damage_preview (viewer, &vr, img, after, damage);
+                }
+        }
+
+    /* Buttons follow the tool; the summary line above the bar shows the
+       counts and grid size. */
+    if (after->hud_visible
+        && (before->tool != after->tool
+            || before->cut_count != after->cut_count
+            || before->section_count != after->section_count
+            || before->grid_cols != after->grid_cols
+            || before->grid_rows != after->grid_rows))
+        {
+            render_rect_t r;
+
+            pinned_box (viewer, 1, &r);
+            damage_add (damage, &r, viewer->win_w, viewer->win_h);
+        }
+}
+
+void
+editor_scroll_damage (
+    const viewer_t *viewer, int dx, int dy, damage_t *damage
+)
+{
+    render_rect_t r;
+
+    pinned_box (viewer, g_editor.hud_visible, &r);
+    damage_add (damage, &r, viewer->win_w, viewer->win_h);
+    r.x += dx;
+    r.y += dy;
+    damage_add (damage, &r, viewer->win_w, viewer->win_h);
 }
 
 void
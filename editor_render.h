@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+#include "damage.h"
+#include "editor_draw.h"
+#include "editor_types.h"
 #include "image.h"
 #include "viewer.h"
 
@@ -10,16 +13,36 @@
 /* Overlay rendering (written into the raw pixel draw buffer)          */
 /* ------------------------------------------------------------------ */
 
-void editor_draw_sections (
+void editor_draw_sections (const draw_target_t *target, const image_t *img);
+
+void editor_draw_cuts (const draw_target_t *target, const image_t *img);
+
+void editor_draw_hud (const draw_target_t *target);
+
+/* ------------------------------------------------------------------ */
+/* Damage                                                              */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Adds to `damage` the screen areas whose overlay differs between
+ * `before` and the current editor state under the same view: old and
+ * new bounds of changed cuts, edges of changed sections, the preview
+ * line and the HUD.
+ */
+void editor_overlay_damage (
     const viewer_t *viewer,
     const image_t *img,
-    uint8_t *buf
+    const editor_state_t *before,
+    damage_t *damage
 );
 
-void
-editor_draw_cuts (const viewer_t *viewer, const image_t *img, uint8_t *buf);
-
-void editor_draw_hud (const viewer_t *viewer, uint8_t *buf);
+/*
+ * A scroll by (dx, dy) carries the window-pinned HUD along with the
+ * image; adds both where it was moved to and where it belongs.
+ */
+void editor_scroll_damage (
+    const viewer_t *viewer, int dx, int dy, damage_t *damage
+);
 
 /* ------------------------------------------------------------------ */
 /* Text rendering (uses XCB text drawing; mutates viewer gc)           */
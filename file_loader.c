@@ -0,0 +1,682 @@
+/* _DEFAULT_SOURCE exposes syscall / pread / O_CLOEXEC under -std=c99 */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#include <linux/io_uring.h>
+#define FILE_LOADER_HAVE_URING 1
+#endif
+#endif
+
+#include "file_loader.h"
+
+#define FILE_LOADER_DEFAULT_DEPTH 8U
+#define FILE_LOADER_MAX_DEPTH 256U
+#define FILE_LOADER_MAX_THREADS 16U
+/* Largest single read request; bigger files take several. */
+#define FILE_LOADER_MAX_READ (1U << 30)
+
+/* ------------------------------------------------------------------ */
+/* Jobs                                                                */
+/* ------------------------------------------------------------------ */
+
+typedef struct load_job
+{
+    struct load_job *next;
+    struct load_job *prev; /* io_uring in-flight list only */
+    const char *path;
+    void *user;
+    int fd;
+    uint8_t *data;
+    size_t size;
+    size_t done;
+    int error;
+} load_job_t;
+
+typedef struct
+{
+    load_job_t *head;
+    load_job_t *tail;
+} job_queue_t;
+
+static void
+job_push (job_queue_t *q, load_job_t *job)
+{
+    job->next = NULL;
+    if (q->tail)
+        q->tail->next = job;
+    else
+        q->head = job;
+    q->tail = job;
+}
+
+static load_job_t *
+job_pop (job_queue_t *q)
+{
+    load_job_t *job = q->head;
+
+    if (job)
+        {
+            q->head = job->next;
+            if (!q->head)
+                q->tail = NULL;
+        }
+    return job;
+}
+
+/*
+ * Opens the file and allocates its buffer.  Returns 0 with job->error
+ * set on failure, or when there is nothing to read (job->size == 0).
+ */
+static int
+job_open (load_job_t *job)
+{
+    struct stat st;
+
+    job->fd = open (job->path, O_RDONLY | O_CLOEXEC);
+    if (job->fd < 0)
+        {
+            job->error = errno;
+            return 0;
+        }
+    if (fstat (job->fd, &st) != 0)
+        {
+            job->error = errno;
+            return 0;
+        }
+    if (!S_ISREG (st.st_mode))
+        {
+            job->error = EINVAL;
+            return 0;
+        }
+    if ((unsigned long long)st.st_size >= (unsigned long long)SIZE_MAX)
+        {
+            job->error = EFBIG;
+            return 0;
+        }
+    job->size = (size_t)st.st_size;
+    if (job->size == 0)
+        return 0;
+    job->data = (uint8_t *)malloc (job->size);
+    if (!job->data)
+        {
+            job->error = ENOMEM;
+            return 0;
+        }
+    return 1;
+}
+
+/* Closes the file; a failed job gives its buffer back. */
+static void
+job_finish (load_job_t *job)
+{
+    if (job->fd >= 0)
+        close (job->fd);
+    job->fd = -1;
+    if (job->error)
+        {
+            free (job->data);
+            job->data = NULL;
+            job->size = 0;
+        }
+}
+
+/* ------------------------------------------------------------------ */
+/* Loader state                                                        */
+/* ------------------------------------------------------------------ */
+
+enum
+{
+    BACKEND_URING = 0,
+    BACKEND_THREADS = 1
+};
+
+#if defined(FILE_LOADER_HAVE_URING)
+typedef struct
+{
+    int fd;
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map;
+    size_t cq_map_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int to_submit;
+} uring_t;
+#endif
+
+struct file_loader
+{
+    int backend;
+    unsigned int depth;
+    unsigned int in_flight; /* io_uring: jobs with a read outstanding */
+    load_job_t *active;     /* io_uring: those jobs */
+    size_t outstanding;     /* submitted, not yet returned by wait */
+    job_queue_t pending;
+    job_queue_t finished;
+
+#if defined(FILE_LOADER_HAVE_URING)
+    uring_t ring;
+#endif
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    pthread_t *threads;
+    unsigned int thread_count;
+    int stop;
+};
+
+/* ------------------------------------------------------------------ */
+/* io_uring backend                                                    */
+/* ------------------------------------------------------------------ */
+
+#if defined(FILE_LOADER_HAVE_URING)
+
+static int
+uring_setup (uring_t *r, unsigned int entries)
+{
+    struct io_uring_params p;
+    uint8_t *sq;
+    uint8_t *cq;
+
+    memset (&p, 0, sizeof (p));
+    memset (r, 0, sizeof (*r));
+    r->fd = (int)syscall (__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return 0;
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof (*r->cqes);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            if (r->cq_map_len > r->sq_map_len)
+                r->sq_map_len = r->cq_map_len;
+            r->cq_map_len = r->sq_map_len;
+        }
+    r->sq_map = mmap (
+        NULL,
+        r->sq_map_len,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        r->fd,
+        IORING_OFF_SQ_RING
+    );
+    if (r->sq_map == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            r->cq_map = r->sq_map;
+        }
+    else
+        {
+            r->cq_map = mmap (
+                NULL,
+                r->cq_map_len,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED,
+                r->fd,
+                IORING_OFF_CQ_RING
+            );
+            if (r->cq_map == MAP_FAILED)
+                goto fail;
+        }
+    r->sqes_len = p.sq_entries * sizeof (*r->sqes);
+    r->sqes = (struct io_uring_sqe *)mmap (
+        NULL,
+        r->sqes_len,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        r->fd,
+        IORING_OFF_SQES
+    );
+    if ((void *)r->sqes == MAP_FAILED)
+        goto fail;
+
+    sq = (uint8_t *)r->sq_map;
+    cq = (uint8_t *)r->cq_map;
+    r->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 1;
+
+fail:
+    if (r->sqes && (void *)r->sqes != MAP_FAILED)
+        munmap (r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+        munmap (r->cq_map, r->cq_map_len);
+    if (r->sq_map && r->sq_map != MAP_FAILED)
+        munmap (r->sq_map, r->sq_map_len);
+    close (r->fd);
+    return 0;
+}
+
+static void
+uring_teardown (uring_t *r)
+{
+    munmap (r->sqes, r->sqes_len);
+    if (r->cq_map != r->sq_map)
+        munmap (r->cq_map, r->cq_map_len);
+    munmap (r->sq_map, r->sq_map_len);
+    close (r->fd);
+}
+
+/* Queues a read of the job's next piece; the ring has a slot per job. */
+static void
+uring_queue_read (uring_t *r, load_job_t *job)
+{
+    unsigned int tail = *r->sq_tail;
+    unsigned int idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    size_t len = job->size - job->done;
+
+    if (len > FILE_LOADER_MAX_READ)
+        len = FILE_LOADER_MAX_READ;
+    memset (sqe, 0, sizeof (*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = job->fd;
+    sqe->off = (uint64_t)job->done;
+    sqe->addr = (uint64_t)(uintptr_t)(job->data + job->done);
+    sqe->len = (uint32_t)len;
+    sqe->user_data = (uint64_t)(uintptr_t)job;
+    r->sq_array[idx] = idx;
+    __atomic_store_n (r->sq_tail, tail + 1U, __ATOMIC_RELEASE);
+    r->to_submit++;
+}
+
+/* Submits queued reads and waits for at least one completion. */
+static int
+uring_enter (uring_t *r)
+{
+    for (;;)
+        {
+            long n = syscall (
+                __NR_io_uring_enter,
+                r->fd,
+                r->to_submit,
+                1U,
+                IORING_ENTER_GETEVENTS,
+                NULL,
+                0
+            );
+
+            if (n >= 0)
+                {
+                    r->to_submit -= (unsigned int)n;
+                    return 1;
+                }
+            if (errno != EINTR && errno != EAGAIN)
+                return 0;
+        }
+}
+
+static void
+uring_start_jobs (file_loader_t *l)
+{
+    while (l->in_flight < l->depth && l->pending.head)
+        {
+            load_job_t *job = job_pop (&l->pending);
+
+            if (!job_open (job))
+                {
+                    job_finish (job);
+                    job_push (&l->finished, job);
+                    continue;
+                }
+            uring_queue_read (&l->ring, job);
+            job->prev = NULL;
+            job->next = l->active;
+            if (l->active)
+                l->active->prev = job;
+            l->active = job;
+            l->in_flight++;
+        }
+}
+
+static void
+uring_retire (file_loader_t *l, load_job_t *job)
+{
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        l->active = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    l->in_flight--;
+    job_finish (job);
+    job_push (&l->finished, job);
+}
+
+static void
+uring_reap (file_loader_t *l)
+{
+    uring_t *r = &l->ring;
+    unsigned int head = *r->cq_head;
+    unsigned int tail = __atomic_load_n (r->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            load_job_t *job = (load_job_t *)(uintptr_t)cqe->user_data;
+            int res = cqe->res;
+
+            if (res == -EINTR || res == -EAGAIN)
+                {
+                    uring_queue_read (r, job);
+                    continue;
+                }
+            if (res < 0)
+                job->error = -res;
+            else if (res == 0)
+                job->size = job->done; /* file shrank under us */
+            else
+                job->done += (size_t)res;
+
+            if (!job->error && job->done < job->size)
+                {
+                    uring_queue_read (r, job);
+                    continue;
+                }
+            uring_retire (l, job);
+        }
+    __atomic_store_n (r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int
+uring_wait (file_loader_t *l)
+{
+    while (!l->finished.head && (l->pending.head || l->in_flight > 0))
+        {
+            uring_start_jobs (l);
+            if (l->finished.head)
+                break;
+            if (!uring_enter (&l->ring))
+                return 0;
+            uring_reap (l);
+        }
+    return 1;
+}
+
+#endif /* FILE_LOADER_HAVE_URING */
+
+static int pool_start (file_loader_t *l);
+
+/* ------------------------------------------------------------------ */
+/* pread thread-pool backend                                           */
+/* ------------------------------------------------------------------ */
+
+static void
+job_read_blocking (load_job_t *job)
+{
+    if (job_open (job))
+        {
+            while (job->done < job->size)
+                {
+                    ssize_t got = pread (
+                        job->fd,
+                        job->data + job->done,
+                        job->size - job->done,
+                        (off_t)job->done
+                    );
+
+                    if (got < 0 && errno == EINTR)
+                        continue;
+                    if (got < 0)
+                        {
+                            job->error = errno;
+                            break;
+                        }
+                    if (got == 0)
+                        {
+                            job->size = job->done;
+                            break;
+                        }
+                    job->done += (size_t)got;
+                }
+        }
+    job_finish (job);
+}
+
+static void *
+pool_worker (void *arg)
+{
+    file_loader_t *l = (file_loader_t *)arg;
+
+    pthread_mutex_lock (&l->lock);
+    for (;;)
+        {
+            load_job_t *job;
+
+            while (!l->stop && !l->pending.head)
+                pthread_cond_wait (&l->work_cv, &l->lock);
+            if (l->stop)
+                break;
+            job = job_pop (&l->pending);
+            pthread_mutex_unlock (&l->lock);
+
+            job_read_blocking (job);
+
+            pthread_mutex_lock (&l->lock);
+            job_push (&l->finished, job);
+            pthread_cond_signal (&l->done_cv);
+        }
+    pthread_mutex_unlock (&l->lock);
+    return NULL;
+}
+
+static int
+pool_start (file_loader_t *l)
+{
+    unsigned int want = l->depth;
+    unsigned int i;
+
+    if (want > FILE_LOADER_MAX_THREADS)
+        want = FILE_LOADER_MAX_THREADS;
+    l->threads = (pthread_t *)malloc (want * sizeof (*l->threads));
+    if (!l->threads)
+        return 0;
+    for (i = 0; i < want; i++)
+        {
+            if (pthread_create (&l->threads[i], NULL, pool_worker, l) != 0)
+                break;
+            l->thread_count++;
+        }
+    return l->thread_count > 0;
+}
+
+static void
+pool_stop (file_loader_t *l)
+{
+    unsigned int i;
+
+    pthread_mutex_lock (&l->lock);
+    l->stop = 1;
+    pthread_cond_broadcast (&l->work_cv);
+    pthread_mutex_unlock (&l->lock);
+    for (i = 0; i < l->thread_count; i++)
+        pthread_join (l->threads[i], NULL);
+    free (l->threads);
+}
+
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
+
+file_loader_t *
+file_loader_new (unsigned int depth)
+{
+    file_loader_t *l = (file_loader_t *)calloc (1, sizeof (*l));
+    const char *env = getenv ("SLICER_IO");
+    int want_uring = !env || strcmp (env, "threads") != 0;
+
+    if (!l)
+        return NULL;
+    if (depth == 0)
+        depth = FILE_LOADER_DEFAULT_DEPTH;
+    if (depth > FILE_LOADER_MAX_DEPTH)
+        depth = FILE_LOADER_MAX_DEPTH;
+    l->depth = depth;
+    pthread_mutex_init (&l->lock, NULL);
+    pthread_cond_init (&l->work_cv, NULL);
+    pthread_cond_init (&l->done_cv, NULL);
+
+#if defined(FILE_LOADER_HAVE_URING)
+    if (want_uring && uring_setup (&l->ring, depth))
+        {
+            l->backend = BACKEND_URING;
+            return l;
+        }
+#endif
+    if (want_uring && env && strcmp (env, "uring") == 0)
+        fprintf (stderr, "SLICER_IO=uring unavailable, using threads\n");
+
+    l->backend = BACKEND_THREADS;
+    if (!pool_start (l))
+        {
+            file_loader_free (l);
+            return NULL;
+        }
+    return l;
+}
+
+void
+file_loader_free (file_loader_t *loader)
+{
+    file_load_t res;
+
+    load_job_t *job;
+
+    if (!loader)
+        return;
+    /* Files not started yet are dropped; the reads in flight are
+       drained so none still targets a buffer we are about to free. */
+    pthread_mutex_lock (&loader->lock);
+    while ((job = job_pop (&loader->pending)) != NULL)
+        {
+            loader->outstanding--;
+            free (job);
+        }
+    pthread_mutex_unlock (&loader->lock);
+    while (file_loader_wait (loader, &res))
+        free (res.data);
+
+#if defined(FILE_LOADER_HAVE_URING)
+    if (loader->backend == BACKEND_URING)
+        uring_teardown (&loader->ring);
+#endif
+    if (loader->backend == BACKEND_THREADS && loader->threads)
+        pool_stop (loader);
+    pthread_cond_destroy (&loader->done_cv);
+    pthread_cond_destroy (&loader->work_cv);
+    pthread_mutex_destroy (&loader->lock);
+    free (loader);
+}
+
+const char *
+file_loader_backend (const file_loader_t *loader)
+{
+    return loader->backend == BACKEND_URING ? "io_uring" : "threads";
+}
+
+int
+file_loader_submit (file_loader_t *loader, const char *path, void *user)
+{
+    load_job_t *job = (load_job_t *)calloc (1, sizeof (*job));
+
+    if (!job)
+        return 0;
+    job->path = path;
+    job->user = user;
+    job->fd = -1;
+
+    pthread_mutex_lock (&loader->lock);
+    job_push (&loader->pending, job);
+    loader->outstanding++;
+    pthread_cond_signal (&loader->work_cv);
+    pthread_mutex_unlock (&loader->lock);
+    return 1;
+}
+
+int
+file_loader_wait (file_loader_t *loader, file_load_t *out)
+{
+    load_job_t *job;
+
+    memset (out, 0, sizeof (*out));
+    pthread_mutex_lock (&loader->lock);
+    if (loader->outstanding == 0)
+        {
+            pthread_mutex_unlock (&loader->lock);
+            return 0;
+        }
+
+#if defined(FILE_LOADER_HAVE_URING)
+    if (loader->backend == BACKEND_URING && !uring_wait (loader))
+        {
+            /* The ring broke.  Reads still queued in it may land later,
+               so their buffers are abandoned rather than freed; the
+               files not yet started move to the thread pool. */
+            int err = errno;
+
+            fprintf (
+                stderr, "io_uring failed (%s), using threads\n", strerror (err)
+            );
+            while ((job = loader->active) != NULL)
+                {
+                    job->data = NULL;
+                    job->error = err;
+                    uring_retire (loader, job);
+                }
+            uring_teardown (&loader->ring);
+            loader->backend = BACKEND_THREADS;
+            if (!pool_start (loader))
+                {
+                    while ((job = job_pop (&loader->pending)) != NULL)
+                        {
+                            job_read_blocking (job);
+                            job_push (&loader->finished, job);
+                        }
+                }
+        }
+#endif
+    while (!loader->finished.head)
+        pthread_cond_wait (&loader->done_cv, &loader->lock);
+
+    job = job_pop (&loader->finished);
+    loader->outstanding--;
+    pthread_mutex_unlock (&loader->lock);
+
+    out->path = job->path;
+    out->user = job->user;
+    out->data = job->data;
+    out->size = job->size;
+    out->error = job->error;
+    free (job);
+    return 1;
+}
@@ -0,0 +1,42 @@
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous whole-file loading for batch decode.
+ *
+ * Paths are queued with file_loader_submit; the loader keeps up to
+ * `depth` reads in flight and file_loader_wait hands back whichever
+ * file finished next, so decoding one buffer overlaps the reads of the
+ * following ones.  Reads go through io_uring (raw syscalls, no liburing)
+ * when the kernel allows it and through a pool of pread threads
+ * otherwise.  SLICER_IO=uring|threads forces a backend.
+ */
+
+typedef struct file_loader file_loader_t;
+
+typedef struct
+{
+    const char *path; /* as passed to file_loader_submit */
+    void *user;
+    uint8_t *data; /* malloc'd file contents, owned by the caller */
+    size_t size;
+    int error; /* errno value, 0 on success; data is NULL on error */
+} file_load_t;
+
+file_loader_t *file_loader_new (unsigned int depth);
+void file_loader_free (file_loader_t *loader);
+const char *file_loader_backend (const file_loader_t *loader);
+
+/* `path` must stay valid until its result has been returned. */
+int file_loader_submit (file_loader_t *loader, const char *path, void *user);
+
+/*
+ * Blocks until a submitted file has been read.  Returns 0 once nothing
+ * is queued or in flight.
+ */
+int file_loader_wait (file_loader_t *loader, file_load_t *out);
+
+#endif
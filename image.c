@@ -1,8 +1,13 @@
+/* _POSIX_C_SOURCE exposes fmemopen / open under -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "image.h"
 #include "png_decoder.h"
@@ -78,10 +83,10 @@ read_token (FILE *f, char *buf, size_t n)
     return i > 0;
 }
 
+/* Parses a P6 stream; the caller owns and closes `f`. */
 static int
-load_ppm_p6 (const char *path, image_t *img)
+load_ppm_p6 (FILE *f, const char *path, image_t *img)
 {
-    FILE *f = fopen (path, "rb");
     char tok[64];
     int width, height, maxval;
     size_t pix_count;
@@ -90,13 +95,6 @@ load_ppm_p6 (const char *path, image_t *img)
     uint8_t *rgba_data;
     size_t i;
 
-    if (!f)
-        {
-            fprintf (
-                stderr, "failed to open '%s': %s\n", path, strerror (errno)
-            );
-            return 0;
-        }
     if (!read_token (f, tok, sizeof (tok)) || strcmp (tok, "P6") != 0)
         {
             fprintf (
@@ -104,49 +102,41 @@ load_ppm_p6 (const char *path, image_t *img)
                 "unsupported format in '%s' (need PNG or PPM P6)\n",
                 path
             );
-            fclose (f);
             return 0;
         }
     if (!read_token (f, tok, sizeof (tok)) || !parse_pos_int (tok, &width))
         {
             fprintf (stderr, "invalid ppm width in '%s'\n", path);
-            fclose (f);
             return 0;
         }
     if (!read_token (f, tok, sizeof (tok)) || !parse_pos_int (tok, &height))
         {
             fprintf (stderr, "invalid ppm height in '%s'\n", path);
-            fclose (f);
             return 0;
         }
     if (!read_token (f, tok, sizeof (tok)))
         {
-            fclose (f);
             return 0;
         }
     maxval = atoi (tok);
     if (maxval <= 0 || maxval > 255)
         {
             fprintf (stderr, "invalid ppm maxval in '%s'\n", path);
-            fclose (f);
             return 0;
         }
 
     pix_count = (size_t)width * (size_t)height;
     if (pix_count == 0 || pix_count > (SIZE_MAX / 4U))
         {
-            fclose (f);
             return 0;
         }
     need = pix_count * 3U;
     rgb_data = (uint8_t *)malloc (need);
     if (!rgb_data)
         {
-            fclose (f);
             return 0;
         }
     got = fread (rgb_data, 1, need, f);
-    fclose (f);
     if (got != need)
         {
             fprintf (stderr, "short read in '%s'\n", path);
@@ -173,37 +163,85 @@ load_ppm_p6 (const char *path, image_t *img)
     img->height = height;
     img->rgba = rgba_data;
     img->has_alpha = 0;
+    img->row_alpha = NULL;
     return 1;
 }
 
 int
-image_load (const char *path, image_t *img)
+image_load_fd (int fd, const char *name, image_t *img)
 {
+    uint8_t *buf = NULL;
+    size_t size = 0;
     FILE *f;
-    uint8_t sig[8];
-    size_t n;
+    int ok;
 
     img->width = 0;
     img->height = 0;
     img->rgba = NULL;
     img->has_alpha = 0;
+    img->row_alpha = NULL;
+
+    /* One pass over the input: the format is sniffed from the buffer,
+       so pipes never need rewinding. */
+    if (!png_read_fd_bytes (fd, &buf, &size))
+        {
+            fprintf (
+                stderr, "failed to read '%s': %s\n", name, strerror (errno)
+            );
+            return 0;
+        }
+
+    if (png_is_signature (buf, size))
+        {
+            ok = png_decode_memory (buf, size, name, img, NULL);
+            free (buf);
+            return ok;
+        }
 
-    f = fopen (path, "rb");
+    f = buf ? fmemopen (buf, size, "rb") : NULL;
     if (!f)
         {
             fprintf (
-                stderr, "failed to open '%s': %s\n", path, strerror (errno)
+                stderr,
+                "unsupported format in '%s' (need PNG or PPM P6)\n",
+                name
             );
+            free (buf);
             return 0;
         }
-    n = fread (sig, 1, sizeof (sig), f);
+    ok = load_ppm_p6 (f, name, img);
     fclose (f);
+    free (buf);
+    return ok;
+}
 
-    if (png_is_signature (sig, n))
+int
+image_load (const char *path, image_t *img)
+{
+    int fd;
+    int ok;
+
+    if (strcmp (path, "-") == 0)
+        {
+            return image_load_fd (STDIN_FILENO, "<stdin>", img);
+        }
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
         {
-            return png_decode_file (path, img);
+            img->width = 0;
+            img->height = 0;
+            img->rgba = NULL;
+            img->has_alpha = 0;
+            img->row_alpha = NULL;
+            fprintf (
+                stderr, "failed to open '%s': %s\n", path, strerror (errno)
+            );
+            return 0;
         }
-    return load_ppm_p6 (path, img);
+    ok = image_load_fd (fd, path, img);
+    close (fd);
+    return ok;
 }
 
 void
@@ -214,7 +252,9 @@ image_free (image_t *img)
             return;
         }
     free (img->rgba);
+    free (img->row_alpha);
     img->rgba = NULL;
+    img->row_alpha = NULL;
     img->width = 0;
     img->height = 0;
     img->has_alpha = 0;
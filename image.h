@@ -3,15 +3,29 @@
 
 #include <stdint.h>
 
+/* Alpha coverage of one image row, see image_t.row_alpha. */
+enum
+{
+    IMAGE_ROW_OPAQUE = 0,
+    IMAGE_ROW_TRANSPARENT = 1,
+    IMAGE_ROW_MIXED = 2
+};
+
 typedef struct
 {
     int width;
     int height;
     uint8_t *rgba;
     int has_alpha;
+    /* `height` IMAGE_ROW_* entries when has_alpha is set, so renderers
+       can skip blending row by row; NULL if not computed. */
+    uint8_t *row_alpha;
 } image_t;
 
+/* Loads a PNG or PPM P6 file; "-" reads standard input. */
 int image_load (const char *path, image_t *img);
+/* Loads from everything left on `fd`; `name` labels errors. */
+int image_load_fd (int fd, const char *name, image_t *img);
 void image_free (image_t *img);
 
 #endif
@@ -0,0 +1,286 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_mips.h"
+#include "pixel_kernels.h"
+
+struct image_mips
+{
+    image_t levels[IMAGE_MIPS_MAX_LEVELS]; /* [0] is the base image */
+    int count;
+    int ready; /* levels [0, ready) can be sampled */
+    int cancel;
+    pthread_t thread;
+    int thread_live;
+    void (*on_done) (void *ctx);
+    void *ctx;
+};
+
+/* ------------------------------------------------------------------ */
+/* Box filter                                                          */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Colour is averaged weighted by alpha and alpha is averaged plainly,
+ * which is the plain average of the four pixels composited over any
+ * background.  Opaque blocks, the common case, skip the divides.
+ */
+static void
+average_2x2 (
+    uint8_t *out,
+    const uint8_t *p0,
+    const uint8_t *p1,
+    const uint8_t *p2,
+    const uint8_t *p3
+)
+{
+    unsigned int a = (unsigned int)p0[3] + p1[3] + p2[3] + p3[3];
+    int c;
+
+    if (a == 4U * 255U)
+        {
+            for (c = 0; c < 3; c++)
+                {
+                    out[c] = (uint8_t)(((unsigned int)p0[c] + p1[c] + p2[c]
+                                        + p3[c] + 2U)
+                                       >> 2);
+                }
+            out[3] = 255U;
+            return;
+        }
+    if (a == 0U)
+        {
+            memset (out, 0, 4);
+            return;
+        }
+    for (c = 0; c < 3; c++)
+        {
+            unsigned int sum = (unsigned int)p0[c] * p0[3]
+                               + (unsigned int)p1[c] * p1[3]
+                               + (unsigned int)p2[c] * p2[3]
+                               + (unsigned int)p3[c] * p3[3];
+
+            out[c] = (uint8_t)((sum + a / 2U) / a);
+        }
+    out[3] = (uint8_t)((a + 2U) >> 2);
+}
+
+static int
+classify_row (const uint8_t *rgba, int width)
+{
+    unsigned int flags = pixel_kernels ()->alpha_scan (rgba, (size_t)width);
+
+    if (!(flags & PIXEL_ALPHA_NOT_OPAQUE))
+        {
+            return IMAGE_ROW_OPAQUE;
+        }
+    if (!(flags & PIXEL_ALPHA_NOT_CLEAR))
+        {
+            return IMAGE_ROW_TRANSPARENT;
+        }
+    return IMAGE_ROW_MIXED;
+}
+
+/* Odd edges repeat their last row or column.  Returns 0 if cancelled. */
+static int
+downsample (const image_t *src, image_t *dst, const int *cancel)
+{
+    size_t src_stride = (size_t)src->width * 4U;
+    int x;
+    int y;
+
+    for (y = 0; y < dst->height; y++)
+        {
+            int sy1 = 2 * y + 1 < src->height ? 2 * y + 1 : src->height - 1;
+            const uint8_t *r0 = src->rgba + (size_t)(2 * y) * src_stride;
+            const uint8_t *r1 = src->rgba + (size_t)sy1 * src_stride;
+            uint8_t *out = dst->rgba + (size_t)y * (size_t)dst->width * 4U;
+
+            if (__atomic_load_n (cancel, __ATOMIC_RELAXED))
+                {
+                    return 0;
+                }
+            for (x = 0; x < dst->width; x++)
+                {
+                    size_t x0 = (size_t)(2 * x) * 4U;
+                    size_t x1 = (2 * x + 1 < src->width ? x0 + 4U : x0);
+
+                    average_2x2 (
+                        out + (size_t)x * 4U,
+                        r0 + x0,
+                        r0 + x1,
+                        r1 + x0,
+                        r1 + x1
+                    );
+                }
+            if (dst->row_alpha)
+                {
+                    dst->row_alpha[y]
+                        = (uint8_t)classify_row (out, dst->width);
+                }
+        }
+    return 1;
+}
+
+static void *
+mips_builder (void *arg)
+{
+    image_mips_t *m = (image_mips_t *)arg;
+    int level;
+
+    for (level = 1; level < m->count; level++)
+        {
+            if (!downsample (
+                    &m->levels[level - 1], &m->levels[level], &m->cancel
+                ))
+                {
+                    return NULL;
+                }
+            __atomic_store_n (&m->ready, level + 1, __ATOMIC_RELEASE);
+        }
+    if (m->on_done)
+        {
+            m->on_done (m->ctx);
+        }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
+
+int
+image_mips_pick (int width, int height, int draw_w, int draw_h)
+{
+    int level = 0;
+
+    while (level + 1 < IMAGE_MIPS_MAX_LEVELS && (width > 1 || height > 1))
+        {
+            int next_w = (width + 1) / 2;
+            int next_h = (height + 1) / 2;
+
+            if (next_w < draw_w || next_h < draw_h)
+                {
+                    break;
+                }
+            width = next_w;
+            height = next_h;
+            level++;
+        }
+    return level;
+}
+
+image_mips_t *
+image_mips_new (const image_t *base, void (*on_done) (void *ctx), void *ctx)
+{
+    image_mips_t *m;
+    int level;
+
+    if (!base || !base->rgba || base->width <= 0 || base->height <= 0)
+        {
+            return NULL;
+        }
+    m = (image_mips_t *)calloc (1, sizeof (*m));
+    if (!m)
+        {
+            return NULL;
+        }
+    m->levels[0] = *base;
+    m->count = 1;
+    m->ready = 1;
+    m->on_done = on_done;
+    m->ctx = ctx;
+
+    /* Allocate up front so the builder cannot fail half way; if memory
+       runs out the chain just stops at the last level that fitted. */
+    for (level = 1; level < IMAGE_MIPS_MAX_LEVELS; level++)
+        {
+            const image_t *prev = &m->levels[level - 1];
+            image_t *img = &m->levels[level];
+
+            if (prev->width == 1 && prev->height == 1)
+                {
+                    break;
+                }
+            img->width = (prev->width + 1) / 2;
+            img->height = (prev->height + 1) / 2;
+            img->has_alpha = base->has_alpha;
+            img->rgba = (uint8_t *)malloc (
+                (size_t)img->width * (size_t)img->height * 4U
+            );
+            if (img->rgba && base->has_alpha)
+                {
+                    img->row_alpha = (uint8_t *)malloc ((size_t)img->height);
+                }
+            if (!img->rgba || (base->has_alpha && !img->row_alpha))
+                {
+                    image_free (img);
+                    break;
+                }
+            m->count = level + 1;
+        }
+
+    if (m->count > 1)
+        {
+            if (pthread_create (&m->thread, NULL, mips_builder, m) == 0)
+                {
+                    m->thread_live = 1;
+                }
+            else
+                {
+                    /* No builder: level 0 only, as without a chain. */
+                    for (level = 1; level < m->count; level++)
+                        {
+                            image_free (&m->levels[level]);
+                        }
+                    m->count = 1;
+                }
+        }
+    return m;
+}
+
+void
+image_mips_free (image_mips_t *mips)
+{
+    int level;
+
+    if (!mips)
+        {
+            return;
+        }
+    if (mips->thread_live)
+        {
+            __atomic_store_n (&mips->cancel, 1, __ATOMIC_RELAXED);
+            pthread_join (mips->thread, NULL);
+        }
+    for (level = 1; level < mips->count; level++)
+        {
+            image_free (&mips->levels[level]);
+        }
+    free (mips);
+}
+
+int
+image_mips_matches (const image_mips_t *mips, const image_t *img)
+{
+    return mips && mips->levels[0].rgba == img->rgba
+           && mips->levels[0].width == img->width
+           && mips->levels[0].height == img->height;
+}
+
+const image_t *
+image_mips_get (const image_mips_t *mips, int level)
+{
+    int ready = __atomic_load_n (&mips->ready, __ATOMIC_ACQUIRE);
+
+    if (level >= ready)
+        {
+            level = ready - 1;
+        }
+    if (level < 0)
+        {
+            level = 0;
+        }
+    return &mips->levels[level];
+}
@@ -0,0 +1,46 @@
+#ifndef IMAGE_MIPS_H
+#define IMAGE_MIPS_H
+
+#include "image.h"
+
+/*
+ * Box-filtered mip chain of an image, for drawing it zoomed out.
+ *
+ * Level 0 is the image itself; each further level halves both sides
+ * (rounding up) by averaging 2x2 blocks, weighted by alpha so that
+ * transparent pixels do not bleed their colour into their neighbours.
+ * Levels are built on a background thread; until one is ready the
+ * chain hands out the deepest level that is.
+ */
+
+#define IMAGE_MIPS_MAX_LEVELS 16
+
+typedef struct image_mips image_mips_t;
+
+/*
+ * Starts building the chain of `base`, which must stay valid and
+ * unchanged until image_mips_free.  `on_done`, if set, is called from
+ * the builder thread once every level is ready.
+ */
+image_mips_t *image_mips_new (
+    const image_t *base, void (*on_done) (void *ctx), void *ctx
+);
+/* Stops the builder if it is still running and frees every level. */
+void image_mips_free (image_mips_t *mips);
+
+/* Whether the chain was built from `img` (same pixels and size). */
+int image_mips_matches (const image_mips_t *mips, const image_t *img);
+
+/*
+ * The deepest level, no deeper than `level`, that is ready to sample.
+ * Never NULL: level 0 is always ready.
+ */
+const image_t *image_mips_get (const image_mips_t *mips, int level);
+
+/*
+ * The deepest level of a `width` x `height` image that is still at
+ * least `draw_w` x `draw_h`, so that sampling it never magnifies.
+ */
+int image_mips_pick (int width, int height, int draw_w, int draw_h);
+
+#endif
@@ -17,6 +17,8 @@
 #define ZOOM_STEP 1.1f
 #define ZOOM_MIN 0.1f
 #define ZOOM_MAX 32.0f
+/* Slack when deciding whether a snapped scale is already whole. */
+#define ZOOM_SNAP_EPS 1e-3
 
 #define ARROW_PAN_STEP 32
 
@@ -34,8 +36,65 @@ clamp_zoom (float zoom)
     return zoom;
 }
 
+/*
+ * With integer zoom on, steps from 1:1 upwards move the on-screen scale
+ * to the next or previous whole multiple instead of by ZOOM_STEP, so
+ * pixel art always lands on the renderer's pixel-replication path.
+ * Below 1:1 zooming stays continuous.
+ */
+static float
+step_zoom (
+    const keybinds_state_t *state,
+    const view_params_t *view,
+    int zoom_in,
+    int win_w,
+    int win_h
+)
+{
+    float stepped = zoom_in ? view->zoom * ZOOM_STEP : view->zoom / ZOOM_STEP;
+    double fit;
+    double scale;
+    int target;
+
+    if (!view->integer_zoom)
+        {
+            return clamp_zoom (stepped);
+        }
+    fit = renderer_fit_scale (state->img_w, state->img_h, win_w, win_h);
+    if (fit <= 0.0)
+        {
+            return clamp_zoom (stepped);
+        }
+    scale = renderer_view_scale (
+        state->img_w, state->img_h, win_w, win_h, view
+    );
+
+    if (zoom_in)
+        {
+            if (scale * ZOOM_STEP < 1.0)
+                {
+                    return clamp_zoom (stepped);
+                }
+            target = (int)(scale + ZOOM_SNAP_EPS) + 1;
+        }
+    else
+        {
+            if (scale <= 1.0 + ZOOM_SNAP_EPS)
+                {
+                    return clamp_zoom (stepped);
+                }
+            target = (int)(scale - ZOOM_SNAP_EPS);
+            if (target < 1)
+                {
+                    target = 1;
+                }
+        }
+    return clamp_zoom ((float)((double)target / fit));
+}
+
 static void
 apply_zoom_at_cursor (
+    const keybinds_state_t *state,
     view_params_t *view,
     float new_zoom,
     int cursor_x,
@@ -44,6 +103,8 @@ apply_zoom_at_cursor (
     int win_h
 )
 {
+    view_params_t next;
+    double old_scale;
     float r;
 
     if (view->zoom <= 0.0f)
@@ -52,7 +113,23 @@ apply_zoom_at_cursor (
             return;
         }
 
-    r = new_zoom / view->zoom;
+    /* Anchor on the scales actually drawn, which integer zoom rounds. */
+    next = *view;
+    next.zoom = new_zoom;
+    old_scale = renderer_view_scale (
+        state->img_w, state->img_h, win_w, win_h, view
+    );
+    if (old_scale > 0.0)
+        {
+            r = (float)(renderer_view_scale (
+                            state->img_w, state->img_h, win_w, win_h, &next
+                        )
+                        / old_scale);
+        }
+    else
+        {
+            r = new_zoom / view->zoom;
+        }
 
     view->pan_x = (int)((cursor_x - win_w * 0.5f) * (1.0f - r)
                         + (float)view->pan_x * r + 0.5f);
@@ -75,10 +152,25 @@ keybinds_init (keybinds_state_t *state, view_params_t *view)
     state->drag_last_y = 0;
     state->cursor_x = 0;
     state->cursor_y = 0;
+    state->img_w = 0;
+    state->img_h = 0;
 
     view->zoom = 1.0f;
     view->pan_x = 0;
     view->pan_y = 0;
+    view->integer_zoom = 0;
+}
+
+void
+keybinds_set_image_size (keybinds_state_t *state, int img_w, int img_h)
+{
+    if (!state)
+        {
+            return;
+        }
+
+    state->img_w = img_w;
+    state->img_h = img_h;
 }
 
 void
@@ -124,8 +216,9 @@ keybinds_handle_event (
                     || key->detail == KEYCODE_KP_ADD)
                     {
                         apply_zoom_at_cursor (
+                            state,
                             view,
-                            clamp_zoom (view->zoom * ZOOM_STEP),
+                            step_zoom (state, view, 1, win_w, win_h),
                             state->cursor_x,
                             state->cursor_y,
                             win_w,
@@ -137,8 +230,9 @@ keybinds_handle_event (
                          || key->detail == KEYCODE_KP_SUBTRACT)
                     {
                         apply_zoom_at_cursor (
+                            state,
                             view,
-                            clamp_zoom (view->zoom / ZOOM_STEP),
+                            step_zoom (state, view, 0, win_w, win_h),
                             state->cursor_x,
                             state->cursor_y,
                             win_w,
@@ -184,8 +278,9 @@ keybinds_handle_event (
                 else if (btn->detail == MOUSE_WHEEL_UP)
                     {
                         apply_zoom_at_cursor (
+                            state,
                             view,
-                            clamp_zoom (view->zoom * ZOOM_STEP),
+                            step_zoom (state, view, 1, win_w, win_h),
                             btn->event_x,
                             btn->event_y,
                             win_w,
@@ -196,8 +291,9 @@ keybinds_handle_event (
                 else if (btn->detail == MOUSE_WHEEL_DOWN)
                     {
                         apply_zoom_at_cursor (
+                            state,
                             view,
-                            clamp_zoom (view->zoom / ZOOM_STEP),
+                            step_zoom (state, view, 0, win_w, win_h),
                             btn->event_x,
                             btn->event_y,
                             win_w,
@@ -13,10 +13,14 @@ typedef struct
     int drag_last_y;
     int cursor_x;
     int cursor_y;
+    /* Size of the image on screen, for integer zoom steps. */
+    int img_w;
+    int img_h;
 } keybinds_state_t;
 
 void keybinds_init (keybinds_state_t *state, view_params_t *view);
 void keybinds_set_mouse_pan_enabled (keybinds_state_t *state, int enabled);
+void keybinds_set_image_size (keybinds_state_t *state, int img_w, int img_h);
 
 void keybinds_handle_event (
     keybinds_state_t *state,
@@ -30,6 +30,8 @@ main (int argc, char **argv)
         {
             goto done;
         }
+    viewer.view.integer_zoom = options.integer_zoom;
+    viewer.frame_rate = options.frame_rate;
 
     status = viewer_run (&viewer, &img, &options.bg) ? 0 : 1;
 
@@ -11,6 +11,7 @@
 #   massif     <image> [iters]   valgrind heap profiler
 #   asan       <image> [iters]   AddressSanitizer + UBSan run
 #   all        <image> [iters]   run bench + perf-stat + flamegraph + gprof
+#   kernels    [work_MiB]        per-kernel cycles/byte (unfilter, expand, blit)
 #
 # Requirements (install what you need):
 #   bench / flamegraph / perf-stat  : linux-perf  (xbps-install: linux-tools)
@@ -387,6 +388,28 @@ cmd_asan() {
     fi
 }
 
+# ---------------------------------------------------------------------------
+# Subcommand: kernels
+# ---------------------------------------------------------------------------
+cmd_kernels() {
+    local work="${1:-64}"
+    local binary="${BUILD_DIR}/bench_kernels"
+
+    header "KERNELS  –  per-kernel microbenchmarks, ${work} MiB per measurement"
+    build_target bench-kernels "$binary"
+
+    mkdir -p "${RESULTS_DIR}"
+    local outfile="${RESULTS_DIR}/kernels_$(timestamp).txt"
+
+    {
+        run_with_header "bench_kernels (paeth: lut)" "$binary" "$work"
+        run_with_header "bench_kernels (paeth: arithmetic)" \
+            "${binary}_paeth_arith" "$work"
+    } | tee "$outfile"
+
+    ok "results saved to ${outfile}"
+}
+
 # ---------------------------------------------------------------------------
 # Subcommand: all
 # ---------------------------------------------------------------------------
@@ -431,6 +454,7 @@ ${BOLD}Subcommands:${RESET}
   massif      <image> [iters]   Valgrind massif (heap allocation profiling)
   asan        <image> [iters]   AddressSanitizer + UBSan correctness check
   all         <image> [iters]   bench + perf-stat + gprof + flamegraph
+  kernels     [work_MiB]        Per-kernel cycles/byte, every ISA path
 
 ${BOLD}Examples:${RESET}
   $0 bench      sample/test1.png 500
@@ -496,6 +520,9 @@ main() {
             [[ $# -ge 1 ]] || { usage; die "all requires <image>"; }
             cmd_all "$@"
             ;;
+        kernels)
+            cmd_kernels "$@"
+            ;;
         -h|--help|help)
             usage
             ;;
@@ -0,0 +1,154 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pixel_kernels.h"
+
+/* ------------------------------------------------------------------ */
+/* CPU feature detection                                               */
+/* ------------------------------------------------------------------ */
+
+static const char *const g_isa_names[CPU_ISA_COUNT]
+    = { "scalar", "sse2", "ssse3", "avx2", "avx512", "neon" };
+
+static int g_isa_has[CPU_ISA_COUNT];
+static pthread_once_t g_detect_once = PTHREAD_ONCE_INIT;
+
+static void
+detect_cpu_once (void)
+{
+    g_isa_has[CPU_ISA_SCALAR] = 1;
+#if (defined(__x86_64__) || defined(__i386__))                               \
+    && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init ();
+    g_isa_has[CPU_ISA_SSE2] = __builtin_cpu_supports ("sse2");
+    g_isa_has[CPU_ISA_SSSE3]
+        = g_isa_has[CPU_ISA_SSE2] && __builtin_cpu_supports ("ssse3");
+    g_isa_has[CPU_ISA_AVX2]
+        = g_isa_has[CPU_ISA_SSSE3] && __builtin_cpu_supports ("avx2");
+    g_isa_has[CPU_ISA_AVX512] = g_isa_has[CPU_ISA_AVX2]
+                                && __builtin_cpu_supports ("avx512f")
+                                && __builtin_cpu_supports ("avx512bw");
+#endif
+#if defined(__aarch64__)
+    /* Advanced SIMD is part of the AArch64 base architecture. */
+    g_isa_has[CPU_ISA_NEON] = 1;
+#endif
+}
+
+int
+cpu_isa_supported (cpu_isa_t isa)
+{
+    if ((int)isa < 0 || isa >= CPU_ISA_COUNT)
+        {
+            return 0;
+        }
+    pthread_once (&g_detect_once, detect_cpu_once);
+    return g_isa_has[isa];
+}
+
+const char *
+cpu_isa_name (cpu_isa_t isa)
+{
+    if ((int)isa < 0 || isa >= CPU_ISA_COUNT)
+        {
+            return "unknown";
+        }
+    return g_isa_names[isa];
+}
+
+static cpu_isa_t
+best_supported_isa (void)
+{
+    int isa;
+
+    for (isa = CPU_ISA_COUNT - 1; isa > CPU_ISA_SCALAR; isa--)
+        {
+            if (cpu_isa_supported ((cpu_isa_t)isa))
+                {
+                    return (cpu_isa_t)isa;
+                }
+        }
+    return CPU_ISA_SCALAR;
+}
+
+/* ------------------------------------------------------------------ */
+/* Dispatch table                                                      */
+/* ------------------------------------------------------------------ */
+
+static pixel_kernels_t g_kernels;
+static pthread_once_t g_kernels_once = PTHREAD_ONCE_INIT;
+
+static void
+fill_kernels (cpu_isa_t isa)
+{
+    memset (&g_kernels, 0, sizeof (g_kernels));
+    g_kernels.isa = isa;
+    png_register_kernels (&g_kernels, isa);
+    blit_register_kernels (&g_kernels, isa);
+}
+
+static void
+init_kernels_once (void)
+{
+    cpu_isa_t isa = best_supported_isa ();
+    const char *env = getenv ("SLICER_ISA");
+
+    if (env && env[0] != '\0')
+        {
+            int i;
+
+            for (i = 0; i < CPU_ISA_COUNT; i++)
+                {
+                    if (strcmp (env, g_isa_names[i]) == 0)
+                        {
+                            break;
+                        }
+                }
+            if (i == CPU_ISA_COUNT)
+                {
+                    fprintf (
+                        stderr,
+                        "warning: unknown SLICER_ISA '%s', using %s\n",
+                        env,
+                        g_isa_names[isa]
+                    );
+                }
+            else if (!cpu_isa_supported ((cpu_isa_t)i))
+                {
+                    fprintf (
+                        stderr,
+                        "warning: SLICER_ISA=%s not supported by this CPU, "
+                        "using %s\n",
+                        env,
+                        g_isa_names[isa]
+                    );
+                }
+            else
+                {
+                    isa = (cpu_isa_t)i;
+                }
+        }
+
+    fill_kernels (isa);
+}
+
+const pixel_kernels_t *
+pixel_kernels (void)
+{
+    pthread_once (&g_kernels_once, init_kernels_once);
+    return &g_kernels;
+}
+
+int
+pixel_kernels_select (cpu_isa_t isa)
+{
+    pthread_once (&g_kernels_once, init_kernels_once);
+    if (!cpu_isa_supported (isa))
+        {
+            return 0;
+        }
+    fill_kernels (isa);
+    return 1;
+}
@@ -0,0 +1,127 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Runtime CPU dispatch for the per-row pixel kernels.
+ *
+ * The table is filled once, on first use, with the best kernels the CPU
+ * supports.  SLICER_ISA=scalar|sse2|ssse3|avx2|avx512|neon caps the
+ * choice, e.g. to benchmark a lower tier on a newer machine; levels the
+ * CPU cannot run fall back to the best supported one with a warning.
+ */
+
+typedef enum
+{
+    CPU_ISA_SCALAR = 0,
+    CPU_ISA_SSE2,
+    CPU_ISA_SSSE3,
+    CPU_ISA_AVX2,
+    CPU_ISA_AVX512,
+    CPU_ISA_NEON,
+    CPU_ISA_COUNT
+} cpu_isa_t;
+
+/* Highest bytes-per-pixel with a specialised unfilter entry. */
+#define PIXEL_MAX_BPP 8
+
+/*
+ * Unfilter one row of `row_bytes` filtered bytes (filter byte already
+ * stripped).  `prev` is the unfiltered row above or NULL for the first.
+ */
+typedef void (*unfilter_row_fn) (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+);
+
+/*
+ * Unfilter one colour type 2 row straight into RGBA with opaque alpha;
+ * `prev` is the RGBA row above (stride 4) or NULL for the first.
+ */
+typedef void (*unfilter_rgb_row_fn) (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+);
+
+/* RGB -> RGBA for one row, opaque. */
+typedef void (*expand_rgb_fn) (
+    uint8_t *rgba, const uint8_t *rgb, size_t width
+);
+
+/* RGB -> RGBA for one row, alpha 0 where the pixel equals the key. */
+typedef void (*expand_rgb_key_fn) (
+    uint8_t *rgba,
+    const uint8_t *rgb,
+    size_t width,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+);
+
+/* Clears alpha in place wherever an RGBA pixel's colour equals the key. */
+typedef void (*key_rgba_fn) (
+    uint8_t *rgba, size_t width, uint8_t tr, uint8_t tg, uint8_t tb
+);
+
+/*
+ * Alpha coverage of one RGBA row: PIXEL_ALPHA_NOT_OPAQUE if any alpha
+ * byte is below 255, PIXEL_ALPHA_NOT_CLEAR if any is above 0.
+ */
+#define PIXEL_ALPHA_NOT_OPAQUE 1U
+#define PIXEL_ALPHA_NOT_CLEAR 2U
+typedef unsigned int (*alpha_scan_fn) (const uint8_t *rgba, size_t width);
+
+/*
+ * Opaque RGBA -> native pixels for one span, alpha ignored.  One kernel
+ * per common LSB-first TrueColor visual: x8r8g8b8, packed r8g8b8 and
+ * r5g6b5.
+ */
+typedef void (*blit_row_fn) (uint8_t *dst, const uint8_t *rgba, size_t width);
+
+/*
+ * Writes each of `count` native pixels `factor` times in a row: the
+ * horizontal half of upscaling by a whole factor.  One kernel per pixel
+ * size, 32 and 16 bits.
+ */
+typedef void (*replicate_fn) (
+    uint8_t *dst, const uint8_t *src, size_t count, size_t factor
+);
+
+typedef struct
+{
+    cpu_isa_t isa;
+
+    /* [bpp][filter type]; NULL entries use the generic kernel. */
+    unfilter_row_fn unfilter[PIXEL_MAX_BPP + 1][5];
+    unfilter_rgb_row_fn unfilter_rgb_to_rgba[5];
+
+    expand_rgb_fn expand_rgb;
+    expand_rgb_key_fn expand_rgb_key;
+    key_rgba_fn key_rgba;
+    alpha_scan_fn alpha_scan;
+
+    blit_row_fn blit_xrgb8888;
+    blit_row_fn blit_rgb888;
+    blit_row_fn blit_rgb565;
+    replicate_fn replicate32;
+    replicate_fn replicate16;
+} pixel_kernels_t;
+
+/* The process-wide table; selected on first call. */
+const pixel_kernels_t *pixel_kernels (void);
+
+/*
+ * Refill the table for `isa` (benchmarks only: must not race with
+ * decodes or renders in flight).  Returns 0 if the CPU cannot run it.
+ */
+int pixel_kernels_select (cpu_isa_t isa);
+
+int cpu_isa_supported (cpu_isa_t isa);
+const char *cpu_isa_name (cpu_isa_t isa);
+
+/* Registration hooks, one per module that owns kernels.  Each fills in
+   its slots for `isa`, layering tiers from scalar upwards. */
+void png_register_kernels (pixel_kernels_t *k, cpu_isa_t isa);
+void blit_register_kernels (pixel_kernels_t *k, cpu_isa_t isa);
+
+#endif
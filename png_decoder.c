@@ -1,8 +1,12 @@
+/* _DEFAULT_SOURCE exposes sysconf (_SC_NPROCESSORS_ONLN) under -std=c99 */
+#define _DEFAULT_SOURCE
+
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "png_decoder.h"
 #include "png_decoder_internal.h"
@@ -11,8 +15,8 @@
 /* IHDR / tRNS chunk parsers                                          */
 /* ------------------------------------------------------------------ */
 
-static int
-parse_ihdr (const uint8_t *data, uint32_t length, png_ihdr_t *out)
+int
+png_parse_ihdr (const uint8_t *data, uint32_t length, png_ihdr_t *out)
 {
     if (length != 13U)
         return 0;
@@ -27,8 +31,8 @@ parse_ihdr (const uint8_t *data, uint32_t length, png_ihdr_t *out)
     return 1;
 }
 
-static void
-parse_trns_rgb (const uint8_t *data, uint32_t length, png_trns_t *out)
+void
+png_parse_trns_rgb (const uint8_t *data, uint32_t length, png_trns_t *out)
 {
     uint16_t vr, vg, vb;
 
@@ -49,8 +53,8 @@ parse_trns_rgb (const uint8_t *data, uint32_t length, png_trns_t *out)
 /* IHDR validation                                                     */
 /* ------------------------------------------------------------------ */
 
-static int
-validate_ihdr (const png_ihdr_t *ihdr, const char *path)
+int
+png_validate_ihdr (const png_ihdr_t *ihdr, const char *path)
 {
     if (ihdr->width == 0 || ihdr->height == 0 || ihdr->width > 1000000U
         || ihdr->height > 1000000U)
@@ -99,10 +103,47 @@ png_is_signature (const uint8_t *buf, size_t len)
 
 int
 png_decode_file (const char *path, image_t *img)
+{
+    return png_decode_file_cancellable (path, img, NULL) == 1;
+}
+
+int
+png_decode_file_cancellable (
+    const char *path, image_t *img, const png_cancel_t *cancel
+)
 {
     uint8_t *file_buf = NULL;
     size_t file_size = 0;
+    int ok;
+
+    if (!png_load_file_bytes (path, &file_buf, &file_size))
+        {
+            fprintf (
+                stderr, "failed to open '%s': %s\n", path, strerror (errno)
+            );
+            img->width = 0;
+            img->height = 0;
+            img->rgba = NULL;
+            img->has_alpha = 0;
+            img->row_alpha = NULL;
+            return 0;
+        }
+    ok = png_decode_memory (file_buf, file_size, path, img, cancel);
+    free (file_buf);
+    return ok;
+}
+
+int
+png_decode_memory (
+    const uint8_t *file_buf,
+    size_t file_size,
+    const char *path,
+    image_t *img,
+    const png_cancel_t *cancel
+)
+{
     size_t pos;
+    int status = 0;
 
     uint8_t *idat = NULL;
     size_t idat_size = 0;
@@ -110,6 +151,7 @@ png_decode_file (const char *path, image_t *img)
 
     uint8_t *raw = NULL;
     uint8_t *rgba = NULL;
+    uint8_t *row_alpha = NULL;
 
     png_ihdr_t ihdr = { 0 };
     png_trns_t trns = { 0 };
@@ -121,21 +163,16 @@ png_decode_file (const char *path, image_t *img)
     size_t encoded_size;
     size_t decoded_size;
     size_t pix_count;
+    png_tuning_t tuning;
+    int has_alpha;
+    uint32_t y;
 
     img->width = 0;
     img->height = 0;
     img->rgba = NULL;
     img->has_alpha = 0;
+    img->row_alpha = NULL;
 
-    /* ---- load raw bytes ------------------------------------------ */
-
-    if (!png_load_file_bytes (path, &file_buf, &file_size))
-        {
-            fprintf (
-                stderr, "failed to open '%s': %s\n", path, strerror (errno)
-            );
-            goto fail;
-        }
     if (!png_is_signature (file_buf, file_size))
         {
             fprintf (stderr, "not a png: '%s'\n", path);
@@ -167,7 +204,8 @@ png_decode_file (const char *path, image_t *img)
             switch (chunk_type)
                 {
                 case PNG_CHUNK_IHDR:
-                    if (seen_ihdr || !parse_ihdr (chunk_data, length, &ihdr))
+                    if (seen_ihdr
+                        || !png_parse_ihdr (chunk_data, length, &ihdr))
                         goto fail;
                     seen_ihdr = 1;
                     break;
@@ -186,7 +224,7 @@ png_decode_file (const char *path, image_t *img)
 
                 case PNG_CHUNK_tRNS:
                     if (ihdr.color_type == 2)
-                        parse_trns_rgb (chunk_data, length, &trns);
+                        png_parse_trns_rgb (chunk_data, length, &trns);
                     break;
 
                 case PNG_CHUNK_IEND:
@@ -205,7 +243,7 @@ png_decode_file (const char *path, image_t *img)
             fprintf (stderr, "invalid png chunk structure: '%s'\n", path);
             goto fail;
         }
-    if (!validate_ihdr (&ihdr, path))
+    if (!png_validate_ihdr (&ihdr, path))
         goto fail;
 
     /* ---- size arithmetic ----------------------------------------- */
@@ -224,13 +262,82 @@ png_decode_file (const char *path, image_t *img)
 
     encoded_size = decoded_size + (size_t)ihdr.height; /* +1 filter byte/row */
 
+    pix_count = (size_t)ihdr.width * (size_t)ihdr.height;
+    if (pix_count == 0 || pix_count > (SIZE_MAX / 4U))
+        goto fail;
+
+    if (png_cancel_requested (cancel))
+        goto cancelled;
+
+    rgba = (uint8_t *)malloc (pix_count * 4U);
+    if (!rgba)
+        goto fail;
+
+    /* Images that may carry alpha get a per-row coverage map; it is
+       dropped again below if every row turns out opaque. */
+    has_alpha = (ihdr.color_type == 6) ? 1 : trns.present;
+    if (has_alpha)
+        {
+            row_alpha = (uint8_t *)malloc ((size_t)ihdr.height);
+            if (!row_alpha)
+                goto fail;
+        }
+
+    /* ---- pipelined inflate + unfilter ---------------------------- */
+
+    /* The two stages only overlap with a second CPU to run on. */
+    png_get_tuning (&tuning);
+    if (encoded_size >= tuning.pipeline_min_bytes
+        && sysconf (_SC_NPROCESSORS_ONLN) >= 2)
+        {
+            int r = png_decode_pipelined (
+                rgba,
+                idat,
+                idat_size,
+                ihdr.width,
+                ihdr.height,
+                src_channels,
+                trns.present,
+                trns.r,
+                trns.g,
+                trns.b,
+                row_alpha,
+                cancel
+            );
+
+            if (r == PNG_DECODE_CANCELLED)
+                goto cancelled;
+            if (r == 0)
+                {
+                    fprintf (stderr, "png decode failed: '%s'\n", path);
+                    goto fail;
+                }
+            if (r > 0)
+                goto done;
+        }
+
     /* ---- inflate ------------------------------------------------- */
 
     raw = (uint8_t *)malloc (encoded_size);
     if (!raw)
         goto fail;
 
-    if (!png_inflate_idat_fast (raw, encoded_size, idat, idat_size))
+    /* libdeflate inflates in one uninterruptible call; with a token the
+       streaming inflater is used instead so cancellation stays prompt. */
+    if (cancel && png_inflate_stream_available ())
+        {
+            status = png_inflate_idat_cancellable (
+                raw, encoded_size, idat, idat_size, cancel
+            );
+            if (status == PNG_DECODE_CANCELLED)
+                goto fail;
+            if (!status)
+                {
+                    fprintf (stderr, "png inflate failed: '%s'\n", path);
+                    goto fail;
+                }
+        }
+    else if (!png_inflate_idat_fast (raw, encoded_size, idat, idat_size))
         {
             fprintf (
                 stderr,
@@ -242,25 +349,22 @@ png_decode_file (const char *path, image_t *img)
 
     /* ---- pixel decode -------------------------------------------- */
 
-    pix_count = (size_t)ihdr.width * (size_t)ihdr.height;
-    if (pix_count == 0 || pix_count > (SIZE_MAX / 4U))
+    status = png_decode_raw_to_rgba (
+        rgba,
+        raw,
+        ihdr.width,
+        ihdr.height,
+        src_channels,
+        trns.present,
+        trns.r,
+        trns.g,
+        trns.b,
+        row_alpha,
+        cancel
+    );
+    if (status == PNG_DECODE_CANCELLED)
         goto fail;
-
-    rgba = (uint8_t *)malloc (pix_count * 4U);
-    if (!rgba)
-        goto fail;
-
-    if (!png_decode_raw_to_rgba (
-            rgba,
-            raw,
-            ihdr.width,
-            ihdr.height,
-            src_channels,
-            trns.present,
-            trns.r,
-            trns.g,
-            trns.b
-        ))
+    if (!status)
         {
             fprintf (stderr, "png filter decode failed: '%s'\n", path);
             goto fail;
@@ -268,20 +372,40 @@ png_decode_file (const char *path, image_t *img)
 
     /* ---- success ------------------------------------------------- */
 
+done:
+    if (row_alpha)
+        {
+            for (y = 0; y < ihdr.height; y++)
+                {
+                    if (row_alpha[y] != IMAGE_ROW_OPAQUE)
+                        break;
+                }
+            if (y == ihdr.height)
+                {
+                    /* Fully opaque: unlocks the renderer's fast paths. */
+                    free (row_alpha);
+                    row_alpha = NULL;
+                    has_alpha = 0;
+                }
+        }
+
     img->width = (int)ihdr.width;
     img->height = (int)ihdr.height;
     img->rgba = rgba;
-    img->has_alpha = (ihdr.color_type == 6) ? 1 : trns.present;
+    img->has_alpha = has_alpha;
+    img->row_alpha = row_alpha;
 
     free (raw);
     free (idat);
-    free (file_buf);
     return 1;
 
+cancelled:
+    status = PNG_DECODE_CANCELLED;
+
 fail:
+    free (row_alpha);
     free (rgba);
     free (raw);
     free (idat);
-    free (file_buf);
-    return 0;
+    return status == PNG_DECODE_CANCELLED ? status : 0;
 }
@@ -6,7 +6,105 @@
 
 #include "image.h"
 
+/*
+ * Threading knobs for the multithreaded decode paths.  Defaults are read
+ * once from SLICER_PNG_THREADS, SLICER_PNG_MT_MIN_ROWS,
+ * SLICER_PNG_MT_MIN_PIXELS and SLICER_PNG_PIPELINE_MIN_BYTES;
+ * png_set_tuning replaces them for every decode that starts afterwards.
+ * Images with fewer rows or pixels than the cut-over thresholds are
+ * decoded on the calling thread only.  Images whose inflated size
+ * reaches pipeline_min_bytes overlap inflate and unfilter on two threads
+ * instead, whatever `threads` is, as long as two CPUs are online.
+ */
+typedef struct
+{
+    int threads;
+    size_t mt_min_rows;
+    size_t mt_min_pixels;
+    size_t pipeline_min_bytes;
+} png_tuning_t;
+
+/*
+ * Cancellation for interactive decodes.  Any thread may png_cancel() a
+ * token that a decode is using, and the decode also gives up once the
+ * token's deadline has passed.  It polls once per strip of rows, frees
+ * its buffers and returns PNG_DECODE_CANCELLED.
+ */
+#define PNG_DECODE_CANCELLED (-2)
+
+typedef struct
+{
+    int cancelled;
+    uint64_t deadline_ns; /* CLOCK_MONOTONIC; 0 means none */
+} png_cancel_t;
+
+/* `timeout_ms` of 0 means no deadline. */
+void png_cancel_init (png_cancel_t *cancel, unsigned long timeout_ms);
+void png_cancel (png_cancel_t *cancel);
+/* True once cancelled or past the deadline; NULL is never cancelled. */
+int png_cancel_requested (const png_cancel_t *cancel);
+
 int png_is_signature (const uint8_t *buf, size_t len);
 int png_decode_file (const char *path, image_t *img);
+/* png_decode_file under a token: 1, 0 or PNG_DECODE_CANCELLED. */
+int png_decode_file_cancellable (
+    const char *path, image_t *img, const png_cancel_t *cancel
+);
+/*
+ * Same decode from bytes already in memory; `path` labels errors and
+ * `cancel` may be NULL.
+ */
+int png_decode_memory (
+    const uint8_t *buf,
+    size_t size,
+    const char *path,
+    image_t *img,
+    const png_cancel_t *cancel
+);
+
+/*
+ * Reads `fd` to EOF into one malloc'd buffer (NULL when empty), growing
+ * it as data arrives, so pipes and stdin work; nothing is seeked.
+ */
+int png_read_fd_bytes (int fd, uint8_t **out, size_t *out_size);
+
+/*
+ * Low-memory decode: streams `path` through pread windows and a
+ * streaming inflate, keeping only two unfiltered rows resident, and
+ * writes row-major RGBA into `out_fd`, which is resized to
+ * width * height * 4 bytes for the caller to mmap.  Everything the
+ * decoder holds stays within `budget` bytes (0 picks the default), so
+ * peak RSS does not grow with the image.  On success img gets width,
+ * height and has_alpha; rgba and row_alpha stay NULL.  Needs zlib.
+ */
+#define PNG_LOWMEM_DEFAULT_BUDGET (4U << 20)
+
+int png_decode_file_to_fd (
+    const char *path, int out_fd, size_t budget, image_t *img
+);
+
+/*
+ * Progressive decode: calls on_rows with each batch of finished rows, in
+ * order, while the rest of the image is still being inflated.  `rgba`
+ * holds `count` contiguous rows of info->width * 4 bytes starting at row
+ * `y`, and is only valid during the call.  info carries width and height
+ * from the first call on, and has_alpha for the rows seen so far.
+ * Returning 0 stops the decode, which then fails.  On success img is
+ * filled as for png_decode_file_to_fd.  Needs zlib.
+ */
+typedef int (*png_rows_fn) (
+    void *ctx,
+    const image_t *info,
+    const uint8_t *rgba,
+    uint32_t y,
+    uint32_t count
+);
+
+int png_decode_stream (
+    const char *path, png_rows_fn on_rows, void *ctx, image_t *img
+);
+
+void png_get_tuning (png_tuning_t *out);
+void png_set_tuning (const png_tuning_t *tuning);
 
 #endif
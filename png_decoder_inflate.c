@@ -1,4 +1,6 @@
 #include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -189,3 +191,265 @@ png_inflate_idat_fast (
     );
     return r == LIBDEFLATE_SUCCESS && actual_out_nbytes == dst_size;
 }
+
+/* ------------------------------------------------------------------ */
+/* Streaming inflate (runtime-loaded zlib)                             */
+/* ------------------------------------------------------------------ */
+
+/*
+ * libdeflate only decompresses whole buffers, so the pipelined decoder
+ * streams through zlib's inflate() instead.  Like libdeflate it is
+ * loaded at runtime; only the stable z_stream ABI is declared here.
+ */
+
+typedef struct
+{
+    const uint8_t *next_in;
+    unsigned int avail_in;
+    unsigned long total_in;
+    uint8_t *next_out;
+    unsigned int avail_out;
+    unsigned long total_out;
+    const char *msg;
+    void *state;
+    void *zalloc;
+    void *zfree;
+    void *opaque;
+    int data_type;
+    unsigned long adler;
+    unsigned long reserved;
+} zlib_stream_t;
+
+#define ZLIB_OK 0
+#define ZLIB_STREAM_END 1
+#define ZLIB_NO_FLUSH 0
+#define ZLIB_RAW_WINDOW_BITS (-15)
+
+typedef int (*zlib_inflate_init2_fn) (
+    zlib_stream_t *strm,
+    int window_bits,
+    const char *version,
+    int stream_size
+);
+typedef int (*zlib_inflate_fn) (zlib_stream_t *strm, int flush);
+typedef int (*zlib_inflate_end_fn) (zlib_stream_t *strm);
+
+typedef struct
+{
+    int ready;
+    void *handle;
+    zlib_inflate_init2_fn inflate_init2;
+    zlib_inflate_fn inflate;
+    zlib_inflate_end_fn inflate_end;
+} zlib_api_t;
+
+static zlib_api_t g_zlib = { 0 };
+static pthread_once_t g_zlib_once = PTHREAD_ONCE_INIT;
+
+static void
+shutdown_zlib_api (void)
+{
+    if (g_zlib.handle)
+        dlclose (g_zlib.handle);
+
+    memset (&g_zlib, 0, sizeof (g_zlib));
+}
+
+static void
+init_zlib_api_once (void)
+{
+    g_zlib.handle = dlopen ("libz.so.1", RTLD_LAZY | RTLD_LOCAL);
+    if (!g_zlib.handle)
+        return;
+
+    LOAD_FN (&g_zlib, inflate_init2, "inflateInit2_");
+    LOAD_FN (&g_zlib, inflate, "inflate");
+    LOAD_FN (&g_zlib, inflate_end, "inflateEnd");
+
+    if (!g_zlib.inflate_init2 || !g_zlib.inflate || !g_zlib.inflate_end)
+        {
+            shutdown_zlib_api ();
+            return;
+        }
+
+    atexit (shutdown_zlib_api);
+    g_zlib.ready = 1;
+}
+
+struct png_inflate_stream
+{
+    zlib_stream_t z;
+    int header_done;
+    int finished;
+};
+
+int
+png_inflate_stream_available (void)
+{
+    pthread_once (&g_zlib_once, init_zlib_api_once);
+    return g_zlib.ready;
+}
+
+png_inflate_stream_t *
+png_inflate_stream_new (void)
+{
+    png_inflate_stream_t *s;
+
+    if (!png_inflate_stream_available ())
+        return NULL;
+
+    s = (png_inflate_stream_t *)calloc (1, sizeof (*s));
+    if (!s)
+        return NULL;
+
+    /* Raw deflate: the zlib header is checked by hand below and the
+       Adler-32 trailer is skipped, matching png_inflate_idat_fast. */
+    if (g_zlib.inflate_init2 (
+            &s->z, ZLIB_RAW_WINDOW_BITS, "1.2.11", (int)sizeof (s->z)
+        )
+        != ZLIB_OK)
+        {
+            free (s);
+            return NULL;
+        }
+    return s;
+}
+
+void
+png_inflate_stream_free (png_inflate_stream_t *s)
+{
+    if (!s)
+        return;
+
+    g_zlib.inflate_end (&s->z);
+    free (s);
+}
+
+png_inflate_status_t
+png_inflate_stream_step (
+    png_inflate_stream_t *s,
+    const uint8_t **in,
+    size_t *in_left,
+    uint8_t **out,
+    size_t *out_left
+)
+{
+    if (s->finished)
+        return PNG_INFLATE_DONE;
+
+    if (!s->header_done)
+        {
+            uint8_t cmf;
+            uint8_t flg;
+
+            if (*in_left < 2U)
+                return PNG_INFLATE_NEED_INPUT;
+
+            cmf = (*in)[0];
+            flg = (*in)[1];
+            if ((cmf & 0x0fU) != 8U || ((cmf >> 4U) & 0x0fU) > 7U
+                || (((unsigned int)cmf << 8U | (unsigned int)flg) % 31U) != 0U
+                || (flg & 0x20U) != 0U)
+                return PNG_INFLATE_ERROR;
+
+            *in += 2U;
+            *in_left -= 2U;
+            s->header_done = 1;
+        }
+
+    while (*out_left > 0U)
+        {
+            unsigned int in_chunk
+                = *in_left > UINT_MAX ? UINT_MAX : (unsigned int)*in_left;
+            unsigned int out_chunk
+                = *out_left > UINT_MAX ? UINT_MAX : (unsigned int)*out_left;
+            int r;
+
+            s->z.next_in = *in;
+            s->z.avail_in = in_chunk;
+            s->z.next_out = *out;
+            s->z.avail_out = out_chunk;
+
+            r = g_zlib.inflate (&s->z, ZLIB_NO_FLUSH);
+
+            *in += in_chunk - s->z.avail_in;
+            *in_left -= in_chunk - s->z.avail_in;
+            *out += out_chunk - s->z.avail_out;
+            *out_left -= out_chunk - s->z.avail_out;
+
+            if (r == ZLIB_STREAM_END)
+                {
+                    s->finished = 1;
+                    return PNG_INFLATE_DONE;
+                }
+            if (r != ZLIB_OK)
+                {
+                    /* Z_BUF_ERROR with no input left just means "feed me". */
+                    if (*in_left == 0U && s->z.avail_out > 0U)
+                        return PNG_INFLATE_NEED_INPUT;
+                    return PNG_INFLATE_ERROR;
+                }
+            if (*in_left == 0U && *out_left > 0U)
+                return PNG_INFLATE_NEED_INPUT;
+        }
+    return PNG_INFLATE_OK;
+}
+
+/* ------------------------------------------------------------------ */
+/* Cancellable whole-buffer inflate                                    */
+/* ------------------------------------------------------------------ */
+
+int
+png_inflate_idat_cancellable (
+    uint8_t *dst,
+    size_t dst_size,
+    const uint8_t *idat,
+    size_t idat_size,
+    const png_cancel_t *cancel
+)
+{
+    png_inflate_stream_t *s = png_inflate_stream_new ();
+    const uint8_t *in = idat;
+    size_t in_left = idat_size;
+    size_t done = 0;
+    int ok = 0;
+
+    if (!s)
+        return 0;
+
+    while (done < dst_size)
+        {
+            size_t want = dst_size - done;
+            uint8_t *out = dst + done;
+            size_t out_left;
+
+            if (png_cancel_requested (cancel))
+                {
+                    ok = PNG_DECODE_CANCELLED;
+                    goto out;
+                }
+            if (want > PNG_CANCEL_STRIP_BYTES)
+                want = PNG_CANCEL_STRIP_BYTES;
+            out_left = want;
+            if (png_inflate_stream_step (s, &in, &in_left, &out, &out_left)
+                    == PNG_INFLATE_ERROR
+                || out_left != 0U)
+                goto out;
+            done += want;
+        }
+
+    /* The deflate stream must end exactly at the last scanline. */
+    {
+        uint8_t extra;
+        uint8_t *out = &extra;
+        size_t out_left = 1U;
+
+        ok = png_inflate_stream_step (s, &in, &in_left, &out, &out_left)
+                 == PNG_INFLATE_DONE
+             && out_left == 1U;
+    }
+
+out:
+    png_inflate_stream_free (s);
+    return ok;
+}
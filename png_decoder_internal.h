@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "png_decoder.h"
+
 /* ------------------------------------------------------------------ */
 /* PNG signature                                                       */
 /* ------------------------------------------------------------------ */
@@ -57,6 +59,32 @@ typedef struct
     uint8_t b;
 } png_trns_t;
 
+/* ------------------------------------------------------------------ */
+/* Cancellation strips                                                 */
+/* ------------------------------------------------------------------ */
+
+/* Output bytes between two polls of a png_cancel_t. */
+#define PNG_CANCEL_STRIP_BYTES (256U * 1024U)
+
+static inline size_t
+png_cancel_strip_rows (size_t out_row_bytes)
+{
+    size_t rows = PNG_CANCEL_STRIP_BYTES / out_row_bytes;
+
+    return rows > 0 ? rows : 1U;
+}
+
+/* ------------------------------------------------------------------ */
+/* Chunk parsers (png_decoder.c)                                      */
+/* ------------------------------------------------------------------ */
+
+int png_parse_ihdr (const uint8_t *data, uint32_t length, png_ihdr_t *out);
+void png_parse_trns_rgb (
+    const uint8_t *data, uint32_t length, png_trns_t *out
+);
+/* Prints the reason to stderr when the image cannot be decoded. */
+int png_validate_ihdr (const png_ihdr_t *ihdr, const char *path);
+
 /* ------------------------------------------------------------------ */
 /* I/O helpers (png_decoder_io.c)                                     */
 /* ------------------------------------------------------------------ */
@@ -81,10 +109,53 @@ int png_inflate_idat_fast (
     size_t idat_size
 );
 
+/*
+ * Streaming inflate over a runtime-loaded zlib.  Each step consumes from
+ * *in and fills *out, advancing both; it returns once *out is full, the
+ * input runs dry or the deflate stream ends.
+ */
+typedef enum
+{
+    PNG_INFLATE_OK = 0,
+    PNG_INFLATE_NEED_INPUT = 1,
+    PNG_INFLATE_DONE = 2,
+    PNG_INFLATE_ERROR = -1
+} png_inflate_status_t;
+
+typedef struct png_inflate_stream png_inflate_stream_t;
+
+int png_inflate_stream_available (void);
+png_inflate_stream_t *png_inflate_stream_new (void);
+void png_inflate_stream_free (png_inflate_stream_t *s);
+png_inflate_status_t png_inflate_stream_step (
+    png_inflate_stream_t *s,
+    const uint8_t **in,
+    size_t *in_left,
+    uint8_t **out,
+    size_t *out_left
+);
+
+/*
+ * Whole-buffer inflate through the streaming inflater, polling `cancel`
+ * once per strip.  Returns 1, 0 or PNG_DECODE_CANCELLED.
+ */
+int png_inflate_idat_cancellable (
+    uint8_t *dst,
+    size_t dst_size,
+    const uint8_t *idat,
+    size_t idat_size,
+    const png_cancel_t *cancel
+);
+
 /* ------------------------------------------------------------------ */
 /* Pixel pipeline (png_decoder_pixels.c)                              */
 /* ------------------------------------------------------------------ */
 
+/*
+ * Unfilters the inflated scanlines into RGBA.  When `row_alpha` is not
+ * NULL it receives one IMAGE_ROW_* alpha class per row.  Returns 1, 0
+ * on a bad filter byte, or PNG_DECODE_CANCELLED once `cancel` fires.
+ */
 int png_decode_raw_to_rgba (
     uint8_t *rgba,
     const uint8_t *raw,
@@ -94,7 +165,111 @@ int png_decode_raw_to_rgba (
     int has_trns,
     uint8_t tr,
     uint8_t tg,
+    uint8_t tb,
+    uint8_t *row_alpha,
+    const png_cancel_t *cancel
+);
+
+/* ------------------------------------------------------------------ */
+/* Row kernels (png_decoder_pixels.c)                                 */
+/* Exposed so bench_kernels can time them without a full decode;      */
+/* the kernels themselves are picked through pixel_kernels.h.         */
+/* ------------------------------------------------------------------ */
+
+void png_init_tables (void);
+
+int png_unfilter_row (
+    uint8_t *row_dst,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    size_t row_bytes,
+    size_t bpp
+);
+/*
+ * Unfilters one colour type 2 row straight into RGBA; `prev` is the
+ * previous RGBA output row (stride 4), or NULL for the first row.
+ */
+int png_unfilter_row_rgb_to_rgba (
+    uint8_t *out,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    uint32_t width,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
     uint8_t tb
 );
+void png_convert_rgb_rows_to_rgba (
+    uint8_t *rgba,
+    const uint8_t *scan,
+    uint32_t width,
+    size_t y0,
+    size_t y1,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+);
+
+/*
+ * Incremental row decoder: unfilters filtered scanlines into the RGBA
+ * image one batch at a time, in order.  Used wherever rows arrive
+ * progressively instead of as one inflated buffer.
+ */
+typedef struct
+{
+    uint8_t *rgba;
+    uint32_t width;
+    size_t src_channels;
+    size_t row_bytes;
+    int has_trns;
+    uint8_t tr;
+    uint8_t tg;
+    uint8_t tb;
+    uint8_t *row_alpha; /* optional IMAGE_ROW_* map, NULL after init */
+    size_t y;
+} png_row_decoder_t;
+
+void png_row_decoder_init (
+    png_row_decoder_t *dec,
+    uint8_t *rgba,
+    uint32_t width,
+    size_t src_channels,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+);
+int png_row_decoder_push (
+    png_row_decoder_t *dec, const uint8_t *rows, size_t count
+);
+
+/* ------------------------------------------------------------------ */
+/* Inflate/unfilter pipeline (png_decoder_pipeline.c)                 */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Decode the concatenated IDAT stream with a streaming inflater on a
+ * producer thread while the calling thread unfilters.  Returns 1 on
+ * success, 0 on corrupt data, and -1 when the pipeline could not be set
+ * up (no zlib, thread creation failed); nothing has been written to
+ * rgba in that case and the caller should take the whole-buffer path.
+ * `row_alpha` and `cancel` behave as for png_decode_raw_to_rgba; the
+ * token is polled once per queue slot.
+ */
+int png_decode_pipelined (
+    uint8_t *rgba,
+    const uint8_t *idat,
+    size_t idat_size,
+    uint32_t width,
+    uint32_t height,
+    size_t src_channels,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb,
+    uint8_t *row_alpha,
+    const png_cancel_t *cancel
+);
 
 #endif /* PNG_DECODER_INTERNAL_H */
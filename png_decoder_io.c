@@ -1,76 +1,17 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include "png_decoder_internal.h"
 
 const uint8_t g_png_sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
 
-int
-png_load_file_bytes (const char *path, uint8_t **out, size_t *out_size)
-{
-    FILE *f;
-    long end_pos;
-    size_t size;
-    uint8_t *buf;
-
-    *out = NULL;
-    *out_size = 0;
-
-    f = fopen (path, "rb");
-    if (!f)
-        {
-            return 0;
-        }
-    if (fseek (f, 0, SEEK_END) != 0)
-        {
-            fclose (f);
-            return 0;
-        }
-    end_pos = ftell (f);
-    if (end_pos < 0)
-        {
-            fclose (f);
-            return 0;
-        }
-    if ((unsigned long)end_pos > (unsigned long)SIZE_MAX)
-        {
-            fclose (f);
-            return 0;
-        }
-    if (fseek (f, 0, SEEK_SET) != 0)
-        {
-            fclose (f);
-            return 0;
-        }
-
-    size = (size_t)end_pos;
-    if (size == 0)
-        {
-            fclose (f);
-            return 1;
-        }
-
-    buf = (uint8_t *)malloc (size);
-    if (!buf)
-        {
-            fclose (f);
-            return 0;
-        }
-    if (fread (buf, 1, size, f) != size)
-        {
-            free (buf);
-            fclose (f);
-            return 0;
-        }
-    fclose (f);
-
-    *out = buf;
-    *out_size = size;
-    return 1;
-}
-
 static int
 ensure_capacity (uint8_t **buf, size_t *cap, size_t need)
 {
@@ -103,6 +44,87 @@ ensure_capacity (uint8_t **buf, size_t *cap, size_t need)
     return 1;
 }
 
+int
+png_load_file_bytes (const char *path, uint8_t **out, size_t *out_size)
+{
+    int fd;
+    int ok;
+
+    *out = NULL;
+    *out_size = 0;
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+        {
+            return 0;
+        }
+    ok = png_read_fd_bytes (fd, out, out_size);
+    close (fd);
+    return ok;
+}
+
+/* Growth step when the total size is not known up front (pipes). */
+#define PNG_READ_CHUNK (64U * 1024U)
+
+int
+png_read_fd_bytes (int fd, uint8_t **out, size_t *out_size)
+{
+    struct stat st;
+    uint8_t *buf = NULL;
+    size_t size = 0;
+    size_t cap = 0;
+
+    *out = NULL;
+    *out_size = 0;
+
+    /* Regular files are read into one exact allocation; the spare byte
+       lets the final read see EOF without growing the buffer. */
+    if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0
+        && (unsigned long long)st.st_size < (unsigned long long)SIZE_MAX)
+        {
+            if (!ensure_capacity (&buf, &cap, (size_t)st.st_size + 1U))
+                {
+                    return 0;
+                }
+        }
+
+    for (;;)
+        {
+            ssize_t got;
+
+            if (size == cap
+                && !ensure_capacity (&buf, &cap, size + PNG_READ_CHUNK))
+                {
+                    free (buf);
+                    return 0;
+                }
+            got = read (fd, buf + size, cap - size);
+            if (got < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+            if (got < 0)
+                {
+                    free (buf);
+                    return 0;
+                }
+            if (got == 0)
+                {
+                    break;
+                }
+            size += (size_t)got;
+        }
+
+    if (size == 0)
+        {
+            free (buf);
+            return 1;
+        }
+    *out = buf;
+    *out_size = size;
+    return 1;
+}
+
 int
 png_append_bytes (
     uint8_t **dst,
@@ -0,0 +1,241 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "png_decoder_internal.h"
+
+/* ------------------------------------------------------------------ */
+/* Single-producer / single-consumer row queue                         */
+/* ------------------------------------------------------------------ */
+
+/*
+ * The producer inflates straight into ring slots of whole filtered rows
+ * and publishes them by bumping `head`; the consumer unfilters a slot
+ * and hands it back by bumping `tail`.  Each index has exactly one
+ * writer, so release/acquire ordering on the two counters is all the
+ * synchronisation the ring needs.  Slots are sized to stay cache
+ * resident while they move between the two cores.
+ */
+#define PIPE_SLOTS 8U
+#define PIPE_SLOT_TARGET_BYTES (64U * 1024U)
+#define PIPE_SPINS_BEFORE_YIELD 64U
+#define PIPE_CACHE_LINE 64U
+
+enum
+{
+    PIPE_RUNNING = 0,
+    PIPE_DONE = 1,
+    PIPE_FAILED = 2
+};
+
+typedef struct
+{
+    uint8_t *slots;
+    size_t slot_bytes;
+    size_t rows_per_slot;
+    size_t row_stride;
+    size_t height;
+    const uint8_t *idat;
+    size_t idat_size;
+    png_inflate_stream_t *stream;
+
+    /* Producer-written. */
+    char pad0[PIPE_CACHE_LINE];
+    size_t head;
+    int status;
+
+    /* Consumer-written. */
+    char pad1[PIPE_CACHE_LINE];
+    size_t tail;
+    int abort;
+    char pad2[PIPE_CACHE_LINE];
+} row_queue_t;
+
+static void
+pipe_backoff (unsigned int *spins)
+{
+    if (++*spins >= PIPE_SPINS_BEFORE_YIELD)
+        {
+            *spins = 0;
+            sched_yield ();
+        }
+}
+
+static void *
+inflate_producer (void *arg)
+{
+    row_queue_t *q = (row_queue_t *)arg;
+    const uint8_t *in = q->idat;
+    size_t in_left = q->idat_size;
+    size_t rows_done = 0;
+    size_t head = 0;
+
+    while (rows_done < q->height)
+        {
+            size_t rows = q->height - rows_done;
+            uint8_t *out;
+            size_t out_left;
+            unsigned int spins = 0;
+
+            if (rows > q->rows_per_slot)
+                rows = q->rows_per_slot;
+            if (__atomic_load_n (&q->abort, __ATOMIC_RELAXED))
+                return NULL;
+
+            while (head - __atomic_load_n (&q->tail, __ATOMIC_ACQUIRE)
+                   >= PIPE_SLOTS)
+                {
+                    if (__atomic_load_n (&q->abort, __ATOMIC_RELAXED))
+                        return NULL;
+                    pipe_backoff (&spins);
+                }
+
+            out = q->slots + (head % PIPE_SLOTS) * q->slot_bytes;
+            out_left = rows * q->row_stride;
+            if (png_inflate_stream_step (
+                    q->stream, &in, &in_left, &out, &out_left
+                )
+                    == PNG_INFLATE_ERROR
+                || out_left != 0U)
+                goto fail;
+
+            rows_done += rows;
+            head++;
+            __atomic_store_n (&q->head, head, __ATOMIC_RELEASE);
+        }
+
+    /* The deflate stream must end exactly at the last scanline. */
+    {
+        uint8_t extra;
+        uint8_t *out = &extra;
+        size_t out_left = 1U;
+
+        if (png_inflate_stream_step (
+                q->stream, &in, &in_left, &out, &out_left
+            )
+                != PNG_INFLATE_DONE
+            || out_left != 1U)
+            goto fail;
+    }
+
+    __atomic_store_n (&q->status, PIPE_DONE, __ATOMIC_RELEASE);
+    return NULL;
+
+fail:
+    __atomic_store_n (&q->status, PIPE_FAILED, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
+
+int
+png_decode_pipelined (
+    uint8_t *rgba,
+    const uint8_t *idat,
+    size_t idat_size,
+    uint32_t width,
+    uint32_t height,
+    size_t src_channels,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb,
+    uint8_t *row_alpha,
+    const png_cancel_t *cancel
+)
+{
+    row_queue_t q;
+    png_row_decoder_t dec;
+    pthread_t producer;
+    size_t rows_done = 0;
+    size_t tail = 0;
+    int ok = 1;
+
+    memset (&q, 0, sizeof (q));
+    q.row_stride = (size_t)width * src_channels + 1U;
+    q.rows_per_slot = PIPE_SLOT_TARGET_BYTES / q.row_stride;
+    if (q.rows_per_slot == 0)
+        q.rows_per_slot = 1;
+    q.slot_bytes = q.rows_per_slot * q.row_stride;
+    q.height = (size_t)height;
+    q.idat = idat;
+    q.idat_size = idat_size;
+
+    q.stream = png_inflate_stream_new ();
+    if (!q.stream)
+        return -1;
+
+    q.slots = (uint8_t *)malloc (q.slot_bytes * PIPE_SLOTS);
+    if (!q.slots)
+        {
+            png_inflate_stream_free (q.stream);
+            return -1;
+        }
+
+    png_row_decoder_init (
+        &dec, rgba, width, src_channels, has_trns, tr, tg, tb
+    );
+    dec.row_alpha = row_alpha;
+
+    if (pthread_create (&producer, NULL, inflate_producer, &q) != 0)
+        {
+            free (q.slots);
+            png_inflate_stream_free (q.stream);
+            return -1;
+        }
+
+    while (rows_done < q.height)
+        {
+            size_t rows = q.height - rows_done;
+            unsigned int spins = 0;
+
+            if (rows > q.rows_per_slot)
+                rows = q.rows_per_slot;
+
+            if (png_cancel_requested (cancel))
+                {
+                    ok = PNG_DECODE_CANCELLED;
+                    __atomic_store_n (&q.abort, 1, __ATOMIC_RELAXED);
+                    break;
+                }
+
+            while (__atomic_load_n (&q.head, __ATOMIC_ACQUIRE) == tail)
+                {
+                    if (__atomic_load_n (&q.status, __ATOMIC_ACQUIRE)
+                        == PIPE_FAILED)
+                        {
+                            ok = 0;
+                            break;
+                        }
+                    pipe_backoff (&spins);
+                }
+            if (!ok)
+                break;
+
+            if (!png_row_decoder_push (
+                    &dec,
+                    q.slots + (tail % PIPE_SLOTS) * q.slot_bytes,
+                    rows
+                ))
+                {
+                    ok = 0;
+                    __atomic_store_n (&q.abort, 1, __ATOMIC_RELAXED);
+                    break;
+                }
+
+            rows_done += rows;
+            tail++;
+            __atomic_store_n (&q.tail, tail, __ATOMIC_RELEASE);
+        }
+
+    pthread_join (producer, NULL);
+    if (ok == 1 && q.status != PIPE_DONE)
+        ok = 0;
+
+    free (q.slots);
+    png_inflate_stream_free (q.stream);
+    return ok;
+}
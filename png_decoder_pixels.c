@@ -1,91 +1,20 @@
+/* _POSIX_C_SOURCE exposes clock_gettime / struct timespec under -std=c99 */
+#define _POSIX_C_SOURCE 199309L
+
+#include <limits.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-
-/* ------------------------------------------------------------------ */
-/* CPU feature detection                                               */
-/* ------------------------------------------------------------------ */
+#include <time.h>
 
 #if defined(__x86_64__) || defined(__i386__)
 #include <immintrin.h>
 #endif
 
+#include "pixel_kernels.h"
 #include "png_decoder_internal.h"
 
-#if defined(__x86_64__) || defined(__i386__)
-static int
-cpu_has_avx2 (void)
-{
-#if defined(__GNUC__) || defined(__clang__)
-    static int init = 0;
-    static int has = 0;
-    if (!init)
-        {
-            __builtin_cpu_init ();
-            has = __builtin_cpu_supports ("avx2");
-            init = 1;
-        }
-    return has;
-#else
-    return 0;
-#endif
-}
-
-#if defined(__GNUC__) || defined(__clang__)
-__attribute__ ((target ("avx2")))
-#endif
-static void
-add_bytes_avx2 (uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t n)
-{
-    size_t i = 0;
-
-    for (; i + 32U <= n; i += 32U)
-        {
-            __m256i va = _mm256_loadu_si256 ((const __m256i *)(a + i));
-            __m256i vb = _mm256_loadu_si256 ((const __m256i *)(b + i));
-            __m256i vc = _mm256_add_epi8 (va, vb);
-            _mm256_storeu_si256 ((__m256i *)(dst + i), vc);
-        }
-    for (; i < n; i++)
-        {
-            dst[i] = (uint8_t)(a[i] + b[i]);
-        }
-}
-#else
-static int
-cpu_has_avx2 (void)
-{
-    return 0;
-}
-#endif
-
-#if defined(__x86_64__) || defined(__i386__)
-static int
-cpu_has_ssse3 (void)
-{
-#if defined(__GNUC__) || defined(__clang__)
-    static int init = 0;
-    static int has = 0;
-    if (!init)
-        {
-            __builtin_cpu_init ();
-            has = __builtin_cpu_supports ("ssse3");
-            init = 1;
-        }
-    return has;
-#else
-    return 0;
-#endif
-}
-#else
-static int
-cpu_has_ssse3 (void)
-{
-    return 0;
-}
-#endif
-
 /* ------------------------------------------------------------------ */
 /* Paeth predictor lookup tables                                       */
 /* ------------------------------------------------------------------ */
@@ -109,6 +38,12 @@ init_paeth_tables_once (void)
         }
 }
 
+void
+png_init_tables (void)
+{
+    pthread_once (&g_paeth_once, init_paeth_tables_once);
+}
+
 #ifdef PAETH_USE_ARITHMETIC
 static inline __attribute__ ((always_inline)) uint8_t
 paeth_predictor (uint8_t a, uint8_t b, uint8_t c)
@@ -141,700 +76,1895 @@ paeth_predictor (uint8_t a, uint8_t b, uint8_t c)
 #endif
 
 /* ------------------------------------------------------------------ */
-/* Row unfiltering  (PNG filter types 0-4, bpp-specialised)           */
+/* Scalar row unfiltering  (PNG filter types 0-4)                      */
 /* ------------------------------------------------------------------ */
 
-static int
-unfilter_row_bpp4 (
-    uint8_t *row_dst,
-    const uint8_t *row_src,
-    const uint8_t *prev,
-    size_t row_bytes
-)
+/*
+ * Each body takes `bpp` as a parameter but is always inlined into a
+ * wrapper with a constant bpp, so the compiler specialises the loops.
+ *
+ * Sub and Avg carry the left pixel `a` as one 64-bit word and do the
+ * per-byte arithmetic SWAR-style, so the serial dependency from one
+ * pixel to the next stays in a register instead of going through a
+ * store and reload of dst, whatever the bpp and however far the
+ * compiler unrolls.  Rows are whole pixels.
+ */
+
+#define SWAR_HI 0x8080808080808080ULL
+#define SWAR_LO7 0x7F7F7F7F7F7F7F7FULL
+
+static inline uint64_t
+swar_add8 (uint64_t x, uint64_t y)
 {
-    uint8_t filter = row_src[0];
-    const uint8_t *src = row_src + 1U;
-    size_t x;
+    return ((x & SWAR_LO7) + (y & SWAR_LO7)) ^ ((x ^ y) & SWAR_HI);
+}
 
-    switch (filter)
+/* floor((x + y) / 2) per byte. */
+static inline uint64_t
+swar_avg8 (uint64_t x, uint64_t y)
+{
+    return (x & y) + (((x ^ y) >> 1) & SWAR_LO7);
+}
+
+/*
+ * Pixel <-> word.  3 and 6 byte pixels are split into power-of-two
+ * pieces: a partial memcpy into the word would go through the stack
+ * and stall on store forwarding.  Byte order within the word does not
+ * matter to the SWAR helpers as long as loads and stores agree.
+ */
+static inline __attribute__ ((always_inline)) uint64_t
+load_pixel (const uint8_t *p, size_t bpp)
+{
+    uint64_t v8;
+    uint32_t v4;
+    uint16_t v2;
+
+    switch (bpp)
         {
-        case 0:
-            memcpy (row_dst, src, row_bytes);
-            return 1;
         case 1:
-            if (row_bytes == 0)
-                {
-                    return 1;
-                }
-            row_dst[0] = src[0];
-            row_dst[1] = src[1];
-            row_dst[2] = src[2];
-            row_dst[3] = src[3];
-            for (x = 4; x < row_bytes; x += 4)
-                {
-                    row_dst[x + 0] = (uint8_t)(src[x + 0] + row_dst[x - 4]);
-                    row_dst[x + 1] = (uint8_t)(src[x + 1] + row_dst[x - 3]);
-                    row_dst[x + 2] = (uint8_t)(src[x + 2] + row_dst[x - 2]);
-                    row_dst[x + 3] = (uint8_t)(src[x + 3] + row_dst[x - 1]);
-                }
-            return 1;
+            return p[0];
         case 2:
-            if (!prev)
-                {
-                    memcpy (row_dst, src, row_bytes);
-                    return 1;
-                }
-#if defined(__x86_64__) || defined(__i386__)
-            if (row_bytes >= 64U && cpu_has_avx2 ())
-                {
-                    add_bytes_avx2 (row_dst, src, prev, row_bytes);
-                    return 1;
-                }
-#endif
-            for (x = 0; x < row_bytes; x++)
-                {
-                    row_dst[x] = (uint8_t)(src[x] + prev[x]);
-                }
-            return 1;
+            memcpy (&v2, p, 2);
+            return v2;
         case 3:
-            if (!prev)
-                {
-                    if (row_bytes == 0)
-                        {
-                            return 1;
-                        }
-                    row_dst[0] = src[0];
-                    row_dst[1] = src[1];
-                    row_dst[2] = src[2];
-                    row_dst[3] = src[3];
-                    for (x = 4; x < row_bytes; x += 4)
-                        {
-                            row_dst[x + 0]
-                                = (uint8_t)(src[x + 0]
-                                            + (uint8_t)(row_dst[x - 4] >> 1));
-                            row_dst[x + 1]
-                                = (uint8_t)(src[x + 1]
-                                            + (uint8_t)(row_dst[x - 3] >> 1));
-                            row_dst[x + 2]
-                                = (uint8_t)(src[x + 2]
-                                            + (uint8_t)(row_dst[x - 2] >> 1));
-                            row_dst[x + 3]
-                                = (uint8_t)(src[x + 3]
-                                            + (uint8_t)(row_dst[x - 1] >> 1));
-                        }
-                    return 1;
-                }
-            row_dst[0] = (uint8_t)(src[0] + (uint8_t)(prev[0] >> 1));
-            row_dst[1] = (uint8_t)(src[1] + (uint8_t)(prev[1] >> 1));
-            row_dst[2] = (uint8_t)(src[2] + (uint8_t)(prev[2] >> 1));
-            row_dst[3] = (uint8_t)(src[3] + (uint8_t)(prev[3] >> 1));
-            for (x = 4; x < row_bytes; x += 4)
-                {
-                    row_dst[x + 0] = (uint8_t)(src[x + 0]
-                                               + (uint8_t)(((int)row_dst[x - 4]
-                                                            + (int)prev[x + 0])
-                                                           >> 1));
-                    row_dst[x + 1] = (uint8_t)(src[x + 1]
-                                               + (uint8_t)(((int)row_dst[x - 3]
-                                                            + (int)prev[x + 1])
-                                                           >> 1));
-                    row_dst[x + 2] = (uint8_t)(src[x + 2]
-                                               + (uint8_t)(((int)row_dst[x - 2]
-                                                            + (int)prev[x + 2])
-                                                           >> 1));
-                    row_dst[x + 3] = (uint8_t)(src[x + 3]
-                                               + (uint8_t)(((int)row_dst[x - 1]
-                                                            + (int)prev[x + 3])
-                                                           >> 1));
-                }
-            return 1;
+            memcpy (&v2, p, 2);
+            return (uint64_t)v2 | ((uint64_t)p[2] << 16);
         case 4:
-            if (!prev)
-                {
-                    if (row_bytes == 0)
-                        {
-                            return 1;
-                        }
-                    row_dst[0] = src[0];
-                    row_dst[1] = src[1];
-                    row_dst[2] = src[2];
-                    row_dst[3] = src[3];
-                    for (x = 4; x < row_bytes; x += 4)
-                        {
-                            row_dst[x + 0]
-                                = (uint8_t)(src[x + 0] + row_dst[x - 4]);
-                            row_dst[x + 1]
-                                = (uint8_t)(src[x + 1] + row_dst[x - 3]);
-                            row_dst[x + 2]
-                                = (uint8_t)(src[x + 2] + row_dst[x - 2]);
-                            row_dst[x + 3]
-                                = (uint8_t)(src[x + 3] + row_dst[x - 1]);
-                        }
-                    return 1;
-                }
-            row_dst[0] = (uint8_t)(src[0] + prev[0]);
-            row_dst[1] = (uint8_t)(src[1] + prev[1]);
-            row_dst[2] = (uint8_t)(src[2] + prev[2]);
-            row_dst[3] = (uint8_t)(src[3] + prev[3]);
-            for (x = 4; x < row_bytes; x += 4)
-                {
-                    row_dst[x + 0] = (uint8_t)(src[x + 0]
-                                               + paeth_predictor (
-                                                   row_dst[x - 4],
-                                                   prev[x + 0],
-                                                   prev[x - 4]
-                                               ));
-                    row_dst[x + 1] = (uint8_t)(src[x + 1]
-                                               + paeth_predictor (
-                                                   row_dst[x - 3],
-                                                   prev[x + 1],
-                                                   prev[x - 3]
-                                               ));
-                    row_dst[x + 2] = (uint8_t)(src[x + 2]
-                                               + paeth_predictor (
-                                                   row_dst[x - 2],
-                                                   prev[x + 2],
-                                                   prev[x - 2]
-                                               ));
-                    row_dst[x + 3] = (uint8_t)(src[x + 3]
-                                               + paeth_predictor (
-                                                   row_dst[x - 1],
-                                                   prev[x + 3],
-                                                   prev[x - 1]
-                                               ));
-                }
-            return 1;
+            memcpy (&v4, p, 4);
+            return v4;
+        case 6:
+            memcpy (&v4, p, 4);
+            memcpy (&v2, p + 4, 2);
+            return (uint64_t)v4 | ((uint64_t)v2 << 32);
         default:
-            return 0;
+            v8 = 0;
+            memcpy (&v8, p, bpp);
+            return v8;
         }
 }
 
-static int
-unfilter_row_bpp3 (
-    uint8_t *row_dst,
-    const uint8_t *row_src,
-    const uint8_t *prev,
-    size_t row_bytes
-)
+static inline __attribute__ ((always_inline)) void
+store_pixel_bytes (uint8_t *p, uint64_t v, size_t bpp)
 {
-    uint8_t filter = row_src[0];
-    const uint8_t *src = row_src + 1U;
-    size_t x;
+    uint32_t v4;
+    uint16_t v2;
 
-    switch (filter)
+    switch (bpp)
         {
-        case 0:
-            memcpy (row_dst, src, row_bytes);
-            return 1;
         case 1:
-            if (row_bytes < 3U)
-                {
-                    return 1;
-                }
-            row_dst[0] = src[0];
-            row_dst[1] = src[1];
-            row_dst[2] = src[2];
-            {
-                const uint8_t *s = src + 3U;
-                uint8_t *d = row_dst + 3U;
-                uint8_t *d_end = row_dst + row_bytes;
-                for (; d < d_end; d += 3, s += 3)
-                    {
-                        d[0] = (uint8_t)(s[0] + d[-3]);
-                        d[1] = (uint8_t)(s[1] + d[-2]);
-                        d[2] = (uint8_t)(s[2] + d[-1]);
-                    }
-            }
-            return 1;
+            p[0] = (uint8_t)v;
+            break;
         case 2:
-            if (!prev)
+            v2 = (uint16_t)v;
+            memcpy (p, &v2, 2);
+            break;
+        case 3:
+            v2 = (uint16_t)v;
+            memcpy (p, &v2, 2);
+            p[2] = (uint8_t)(v >> 16);
+            break;
+        case 4:
+            v4 = (uint32_t)v;
+            memcpy (p, &v4, 4);
+            break;
+        case 6:
+            v4 = (uint32_t)v;
+            v2 = (uint16_t)(v >> 32);
+            memcpy (p, &v4, 4);
+            memcpy (p + 4, &v2, 2);
+            break;
+        default:
+            memcpy (p, &v, bpp);
+            break;
+        }
+}
+
+static inline __attribute__ ((always_inline)) void
+unfilter_sub_n (uint8_t *dst, const uint8_t *src, size_t row_bytes, size_t bpp)
+{
+    uint64_t a = 0;
+    size_t x;
+
+    if (bpp > PIXEL_MAX_BPP)
+        {
+            for (x = 0; x < bpp && x < row_bytes; x++)
                 {
-                    memcpy (row_dst, src, row_bytes);
-                    return 1;
+                    dst[x] = src[x];
                 }
-#if defined(__x86_64__) || defined(__i386__)
-            if (row_bytes >= 64U && cpu_has_avx2 ())
+            for (; x < row_bytes; x++)
                 {
-                    add_bytes_avx2 (row_dst, src, prev, row_bytes);
-                    return 1;
+                    dst[x] = (uint8_t)(src[x] + dst[x - bpp]);
                 }
-#endif
-            for (x = 0; x < row_bytes; x++)
+            return;
+        }
+    for (x = 0; x + bpp <= row_bytes; x += bpp)
+        {
+            a = swar_add8 (a, load_pixel (src + x, bpp));
+            store_pixel_bytes (dst + x, a, bpp);
+        }
+}
+
+static inline __attribute__ ((always_inline)) void
+unfilter_avg_n (
+    uint8_t *dst,
+    const uint8_t *src,
+    const uint8_t *prev,
+    size_t row_bytes,
+    size_t bpp
+)
+{
+    uint64_t a = 0;
+    size_t x;
+
+    if (bpp > PIXEL_MAX_BPP)
+        {
+            for (x = 0; x < bpp && x < row_bytes; x++)
                 {
-                    row_dst[x] = (uint8_t)(src[x] + prev[x]);
+                    dst[x] = (uint8_t)(src[x] + (prev ? prev[x] >> 1 : 0));
                 }
-            return 1;
-        case 3:
-            if (!prev)
+            for (; x < row_bytes; x++)
                 {
-                    if (row_bytes < 3U)
-                        {
-                            return 1;
-                        }
-                    row_dst[0] = src[0];
-                    row_dst[1] = src[1];
-                    row_dst[2] = src[2];
-                    {
-                        const uint8_t *s = src + 3U;
-                        uint8_t *d = row_dst + 3U;
-                        uint8_t *d_end = row_dst + row_bytes;
-                        for (; d < d_end; d += 3, s += 3)
-                            {
-                                d[0] = (uint8_t)(s[0] + (uint8_t)(d[-3] >> 1));
-                                d[1] = (uint8_t)(s[1] + (uint8_t)(d[-2] >> 1));
-                                d[2] = (uint8_t)(s[2] + (uint8_t)(d[-1] >> 1));
-                            }
-                    }
-                    return 1;
+                    dst[x] = (uint8_t)(src[x]
+                                       + (((int)dst[x - bpp]
+                                           + (prev ? (int)prev[x] : 0))
+                                          >> 1));
                 }
-            row_dst[0] = (uint8_t)(src[0] + (uint8_t)(prev[0] >> 1));
-            row_dst[1] = (uint8_t)(src[1] + (uint8_t)(prev[1] >> 1));
-            row_dst[2] = (uint8_t)(src[2] + (uint8_t)(prev[2] >> 1));
-            {
-                const uint8_t *s = src + 3U;
-                const uint8_t *p = prev + 3U;
-                uint8_t *d = row_dst + 3U;
-                uint8_t *d_end = row_dst + row_bytes;
-                for (; d < d_end; d += 3, s += 3, p += 3)
-                    {
-                        d[0] = (uint8_t)(s[0]
-                                         + (uint8_t)(((int)d[-3] + (int)p[0])
-                                                     >> 1));
-                        d[1] = (uint8_t)(s[1]
-                                         + (uint8_t)(((int)d[-2] + (int)p[1])
-                                                     >> 1));
-                        d[2] = (uint8_t)(s[2]
-                                         + (uint8_t)(((int)d[-1] + (int)p[2])
-                                                     >> 1));
-                    }
-            }
-            return 1;
-        case 4:
-            if (!prev)
+            return;
+        }
+    if (!prev)
+        {
+            for (x = 0; x + bpp <= row_bytes; x += bpp)
                 {
-                    if (row_bytes < 3U)
-                        {
-                            return 1;
-                        }
-                    row_dst[0] = src[0];
-                    row_dst[1] = src[1];
-                    row_dst[2] = src[2];
-                    {
-                        const uint8_t *s = src + 3U;
-                        uint8_t *d = row_dst + 3U;
-                        uint8_t *d_end = row_dst + row_bytes;
-                        for (; d < d_end; d += 3, s += 3)
-                            {
-                                d[0] = (uint8_t)(s[0] + d[-3]);
-                                d[1] = (uint8_t)(s[1] + d[-2]);
-                                d[2] = (uint8_t)(s[2] + d[-1]);
-                            }
-                    }
-                    return 1;
+                    a = swar_add8 (
+                        (a >> 1) & SWAR_LO7, load_pixel (src + x, bpp)
+                    );
+                    store_pixel_bytes (dst + x, a, bpp);
                 }
-            row_dst[0] = (uint8_t)(src[0] + prev[0]);
-            row_dst[1] = (uint8_t)(src[1] + prev[1]);
-            row_dst[2] = (uint8_t)(src[2] + prev[2]);
-            {
-                const uint8_t *s = src + 3U;
-                const uint8_t *p = prev + 3U;
-                uint8_t *d = row_dst + 3U;
-                uint8_t *d_end = row_dst + row_bytes;
-                for (; d < d_end; d += 3, s += 3, p += 3)
-                    {
-                        d[0] = (uint8_t)(s[0]
-                                         + paeth_predictor (
-                                             d[-3], p[0], p[-3]
-                                         ));
-                        d[1] = (uint8_t)(s[1]
-                                         + paeth_predictor (
-                                             d[-2], p[1], p[-2]
-                                         ));
-                        d[2] = (uint8_t)(s[2]
-                                         + paeth_predictor (
-                                             d[-1], p[2], p[-1]
-                                         ));
-                    }
-            }
-            return 1;
-        default:
-            return 0;
+            return;
+        }
+    for (x = 0; x + bpp <= row_bytes; x += bpp)
+        {
+            a = swar_add8 (
+                swar_avg8 (a, load_pixel (prev + x, bpp)),
+                load_pixel (src + x, bpp)
+            );
+            store_pixel_bytes (dst + x, a, bpp);
         }
 }
 
-static int
-unfilter_row (
-    uint8_t *row_dst,
-    const uint8_t *row_with_filter,
+static inline __attribute__ ((always_inline)) void
+unfilter_paeth_n (
+    uint8_t *dst,
+    const uint8_t *src,
     const uint8_t *prev,
     size_t row_bytes,
     size_t bpp
 )
 {
-    const uint8_t *row_src = row_with_filter;
     size_t x;
 
-    if (bpp == 4U)
+    if (!prev)
+        {
+            /* Paeth with no row above degenerates to Sub. */
+            unfilter_sub_n (dst, src, row_bytes, bpp);
+            return;
+        }
+    for (x = 0; x < bpp && x < row_bytes; x++)
+        {
+            dst[x] = (uint8_t)(src[x] + prev[x]);
+        }
+    for (; x < row_bytes; x++)
+        {
+            dst[x] = (uint8_t)(src[x]
+                               + paeth_predictor (
+                                   dst[x - bpp], prev[x], prev[x - bpp]
+                               ));
+        }
+}
+
+static void
+unfilter_none_scalar (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    (void)prev;
+    memcpy (dst, src, row_bytes);
+}
+
+static void
+unfilter_up_scalar (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    size_t x;
+
+    if (!prev)
         {
-            return unfilter_row_bpp4 (row_dst, row_src, prev, row_bytes);
+            memcpy (dst, src, row_bytes);
+            return;
         }
-    if (bpp == 3U)
+    for (x = 0; x < row_bytes; x++)
         {
-            return unfilter_row_bpp3 (row_dst, row_src, prev, row_bytes);
+            dst[x] = (uint8_t)(src[x] + prev[x]);
         }
+}
+
+/*
+ * Sub, Avg and Paeth for every bytes-per-pixel a PNG can have at 8 or
+ * 16 bits per sample: grey (1/2), grey+alpha (2/4), RGB (3/6) and RGBA
+ * (4/8).  Each instance inlines the body with a constant bpp, so the
+ * first pixel is peeled into a fixed-length copy and the inner loop
+ * runs without the `x >= bpp` test.  None and Up do not depend on bpp.
+ */
+#define PNG_UNFILTER_BPPS(X) X (1) X (2) X (3) X (4) X (6) X (8)
 
-    row_src = row_with_filter + 1U;
-    switch (row_with_filter[0])
+#define DEFINE_UNFILTER_BPP(n)                                               \
+    static void unfilter_sub_bpp##n##_scalar (                               \
+        uint8_t *dst,                                                        \
+        const uint8_t *src,                                                  \
+        const uint8_t *prev,                                                 \
+        size_t row_bytes                                                     \
+    )                                                                        \
+    {                                                                        \
+        (void)prev;                                                          \
+        unfilter_sub_n (dst, src, row_bytes, n##U);                          \
+    }                                                                        \
+    static void unfilter_avg_bpp##n##_scalar (                               \
+        uint8_t *dst,                                                        \
+        const uint8_t *src,                                                  \
+        const uint8_t *prev,                                                 \
+        size_t row_bytes                                                     \
+    )                                                                        \
+    {                                                                        \
+        unfilter_avg_n (dst, src, prev, row_bytes, n##U);                    \
+    }                                                                        \
+    static void unfilter_paeth_bpp##n##_scalar (                             \
+        uint8_t *dst,                                                        \
+        const uint8_t *src,                                                  \
+        const uint8_t *prev,                                                 \
+        size_t row_bytes                                                     \
+    )                                                                        \
+    {                                                                        \
+        unfilter_paeth_n (dst, src, prev, row_bytes, n##U);                  \
+    }
+
+PNG_UNFILTER_BPPS (DEFINE_UNFILTER_BPP)
+
+#undef DEFINE_UNFILTER_BPP
+
+/* Any bpp without a table entry. */
+static void
+unfilter_row_generic (
+    uint8_t *dst,
+    const uint8_t *src,
+    const uint8_t *prev,
+    size_t row_bytes,
+    size_t bpp,
+    uint8_t filter
+)
+{
+    switch (filter)
         {
         case 0:
-            memcpy (row_dst, row_src, row_bytes);
-            return 1;
+            unfilter_none_scalar (dst, src, prev, row_bytes);
+            break;
         case 1:
-            for (x = 0; x < row_bytes; x++)
-                {
-                    uint8_t left = (x >= bpp) ? row_dst[x - bpp] : 0;
-                    row_dst[x] = (uint8_t)(row_src[x] + left);
-                }
-            return 1;
+            unfilter_sub_n (dst, src, row_bytes, bpp);
+            break;
         case 2:
-            if (!prev)
-                {
-                    memcpy (row_dst, row_src, row_bytes);
-                    return 1;
-                }
-            for (x = 0; x < row_bytes; x++)
-                {
-                    row_dst[x] = (uint8_t)(row_src[x] + prev[x]);
-                }
-            return 1;
+            unfilter_up_scalar (dst, src, prev, row_bytes);
+            break;
         case 3:
-            for (x = 0; x < row_bytes; x++)
-                {
-                    uint8_t left = (x >= bpp) ? row_dst[x - bpp] : 0;
-                    uint8_t up = prev ? prev[x] : 0;
-                    row_dst[x]
-                        = (uint8_t)(row_src[x]
-                                    + (uint8_t)(((int)left + (int)up) >> 1));
-                }
-            return 1;
-        case 4:
-            for (x = 0; x < row_bytes; x++)
-                {
-                    uint8_t left = (x >= bpp) ? row_dst[x - bpp] : 0;
-                    uint8_t up = prev ? prev[x] : 0;
-                    uint8_t up_left = (prev && x >= bpp) ? prev[x - bpp] : 0;
-                    row_dst[x]
-                        = (uint8_t)(row_src[x]
-                                    + paeth_predictor (left, up, up_left));
-                }
-            return 1;
+            unfilter_avg_n (dst, src, prev, row_bytes, bpp);
+            break;
         default:
-            return 0;
+            unfilter_paeth_n (dst, src, prev, row_bytes, bpp);
+            break;
         }
 }
 
 /* ------------------------------------------------------------------ */
-/* RGB -> RGBA expansion  (scalar + SSSE3 fast path)                  */
+/* Scalar RGB -> RGBA  (expansion, colour key, direct unfilter)        */
 /* ------------------------------------------------------------------ */
 
-#if defined(__x86_64__) || defined(__i386__)
-#if defined(__GNUC__) || defined(__clang__)
-__attribute__ ((target ("ssse3")))
-#endif
+/*
+ * Colour type 2 is unfiltered directly into the 4-byte RGBA slots: the
+ * predictors read the previous *output* row at stride 4, so no RGB
+ * scanline is ever materialised.  Alpha is written opaque and, with a
+ * tRNS chunk, keyed afterwards while the row is still in L1.
+ */
+
 static void
-convert_rgb_rows_to_rgba_ssse3 (
-    uint8_t *restrict rgba,
-    const uint8_t *restrict scan,
-    uint32_t width,
-    size_t y0,
-    size_t y1
-)
+expand_rgb_scalar (uint8_t *rgba, const uint8_t *rgb, size_t width)
 {
-    size_t row_bytes = (size_t)width * 3U;
-    size_t out_row_bytes = (size_t)width * 4U;
-    size_t y;
-    __m128i shuf
-        = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
-    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    size_t x;
 
-    for (y = y0; y < y1; y++)
+    for (x = 0; x < width; x++, rgb += 3, rgba += 4)
         {
-            const uint8_t *in = scan + y * row_bytes;
-            uint8_t *out = rgba + y * out_row_bytes;
-            size_t x = 0;
-
-            for (; x + 4 <= (size_t)width; x += 4)
-                {
-                    __m128i rgb
-                        = _mm_loadu_si128 ((const __m128i *)(in + x * 3));
-                    __m128i rgba_v = _mm_shuffle_epi8 (rgb, shuf);
-                    rgba_v = _mm_or_si128 (rgba_v, alpha);
-                    _mm_storeu_si128 ((__m128i *)(out + x * 4), rgba_v);
-                }
-            for (; x < (size_t)width; x++)
-                {
-                    out[x * 4 + 0] = in[x * 3 + 0];
-                    out[x * 4 + 1] = in[x * 3 + 1];
-                    out[x * 4 + 2] = in[x * 3 + 2];
-                    out[x * 4 + 3] = 255U;
-                }
+            rgba[0] = rgb[0];
+            rgba[1] = rgb[1];
+            rgba[2] = rgb[2];
+            rgba[3] = 255U;
         }
 }
-#endif
 
-static void __attribute__ ((hot))
-convert_rgb_rows_to_rgba (
-    uint8_t *restrict rgba,
-    const uint8_t *restrict scan,
-    uint32_t width,
-    size_t y0,
-    size_t y1,
-    int has_trns,
+static void
+expand_rgb_key_scalar (
+    uint8_t *rgba,
+    const uint8_t *rgb,
+    size_t width,
     uint8_t tr,
     uint8_t tg,
     uint8_t tb
 )
 {
-    size_t row_bytes = (size_t)width * 3U;
-    size_t out_row_bytes = (size_t)width * 4U;
-    size_t y;
+    size_t x;
 
-#if defined(__x86_64__) || defined(__i386__)
-    if (!has_trns && cpu_has_ssse3 ())
+    for (x = 0; x < width; x++, rgb += 3, rgba += 4)
         {
-            convert_rgb_rows_to_rgba_ssse3 (rgba, scan, width, y0, y1);
-            return;
+            uint8_t r = rgb[0];
+            uint8_t g = rgb[1];
+            uint8_t b = rgb[2];
+            rgba[0] = r;
+            rgba[1] = g;
+            rgba[2] = b;
+            rgba[3] = (r == tr && g == tg && b == tb) ? 0U : 255U;
         }
-#endif
+}
 
-    for (y = y0; y < y1; y++)
-        {
-            const uint8_t *in = scan + y * row_bytes;
-            uint8_t *out = rgba + y * out_row_bytes;
-            size_t x;
+static void
+key_rgba_scalar (
+    uint8_t *rgba, size_t width, uint8_t tr, uint8_t tg, uint8_t tb
+)
+{
+    size_t x;
 
-            if (has_trns)
-                {
-                    for (x = 0; x < (size_t)width; x++)
-                        {
-                            uint8_t r = in[0];
-                            uint8_t g = in[1];
-                            uint8_t b = in[2];
-                            out[0] = r;
-                            out[1] = g;
-                            out[2] = b;
-                            out[3]
-                                = (r == tr && g == tg && b == tb) ? 0U : 255U;
-                            in += 3;
-                            out += 4;
-                        }
-                }
-            else
+    for (x = 0; x < width; x++, rgba += 4)
+        {
+            if (rgba[0] == tr && rgba[1] == tg && rgba[2] == tb)
                 {
-                    for (x = 0; x < (size_t)width; x++)
-                        {
-                            out[0] = in[0];
-                            out[1] = in[1];
-                            out[2] = in[2];
-                            out[3] = 255U;
-                            in += 3;
-                            out += 4;
-                        }
+                    rgba[3] = 0U;
                 }
         }
 }
 
 /* ------------------------------------------------------------------ */
-/* Multi-threaded RGB -> RGBA dispatch                                 */
+/* Alpha coverage                                                      */
 /* ------------------------------------------------------------------ */
 
-static int
-configured_png_threads (void)
+/*
+ * Run on each RGBA row right after it is unfiltered, while it is still
+ * in L1: the AND of all alpha bytes is 255 only for an opaque row and
+ * the OR is 0 only for a fully transparent one.  The SIMD versions keep
+ * the two accumulators over whole vectors (colour lanes included) and
+ * fold only the alpha bytes at the end.
+ */
+
+static inline unsigned int
+alpha_flags (unsigned int all, unsigned int any)
 {
-    static int initialized = 0;
-    static int threads = 1;
+    return (all != 255U ? PIXEL_ALPHA_NOT_OPAQUE : 0U)
+           | (any != 0U ? PIXEL_ALPHA_NOT_CLEAR : 0U);
+}
 
-    if (!initialized)
-        {
-            const char *env = getenv ("SLICER_PNG_THREADS");
-            if (env && env[0] != '\0')
+static inline void
+alpha_fold (
+    const uint8_t *rgba, size_t width, unsigned int *all, unsigned int *any
+)
+{
+    size_t x;
+
+    for (x = 0; x < width; x++)
+        {
+            *all &= rgba[x * 4U + 3U];
+            *any |= rgba[x * 4U + 3U];
+        }
+}
+
+/* Folds the alpha bytes of a pair of AND / OR vector accumulators. */
+static inline void
+alpha_fold_lanes (
+    const uint8_t *all_lanes,
+    const uint8_t *any_lanes,
+    size_t bytes,
+    unsigned int *all,
+    unsigned int *any
+)
+{
+    size_t i;
+
+    for (i = 3U; i < bytes; i += 4U)
+        {
+            *all &= all_lanes[i];
+            *any |= any_lanes[i];
+        }
+}
+
+static unsigned int
+alpha_scan_scalar (const uint8_t *rgba, size_t width)
+{
+    unsigned int all = 255U;
+    unsigned int any = 0U;
+
+    alpha_fold (rgba, width, &all, &any);
+    return alpha_flags (all, any);
+}
+
+static void
+unfilter_rgb_sub_scalar (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    uint8_t *d = rgba;
+    uint8_t *d_end = rgba + width * 4U;
+    const uint8_t *s = src;
+
+    (void)prev;
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+    d[3] = 255U;
+    for (d += 4, s += 3; d < d_end; d += 4, s += 3)
+        {
+            d[0] = (uint8_t)(s[0] + d[-4]);
+            d[1] = (uint8_t)(s[1] + d[-3]);
+            d[2] = (uint8_t)(s[2] + d[-2]);
+            d[3] = 255U;
+        }
+}
+
+static void
+unfilter_rgb_up_scalar (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    size_t x;
+
+    if (!prev)
+        {
+            expand_rgb_scalar (rgba, src, width);
+            return;
+        }
+    for (x = 0; x < width; x++, rgba += 4, src += 3, prev += 4)
+        {
+            rgba[0] = (uint8_t)(src[0] + prev[0]);
+            rgba[1] = (uint8_t)(src[1] + prev[1]);
+            rgba[2] = (uint8_t)(src[2] + prev[2]);
+            rgba[3] = 255U;
+        }
+}
+
+static void
+unfilter_rgb_avg_scalar (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    uint8_t *d = rgba;
+    uint8_t *d_end = rgba + width * 4U;
+    const uint8_t *s = src;
+    const uint8_t *p;
+
+    if (!prev)
+        {
+            d[0] = s[0];
+            d[1] = s[1];
+            d[2] = s[2];
+            d[3] = 255U;
+            for (d += 4, s += 3; d < d_end; d += 4, s += 3)
+                {
+                    d[0] = (uint8_t)(s[0] + (uint8_t)(d[-4] >> 1));
+                    d[1] = (uint8_t)(s[1] + (uint8_t)(d[-3] >> 1));
+                    d[2] = (uint8_t)(s[2] + (uint8_t)(d[-2] >> 1));
+                    d[3] = 255U;
+                }
+            return;
+        }
+
+    d[0] = (uint8_t)(s[0] + (uint8_t)(prev[0] >> 1));
+    d[1] = (uint8_t)(s[1] + (uint8_t)(prev[1] >> 1));
+    d[2] = (uint8_t)(s[2] + (uint8_t)(prev[2] >> 1));
+    d[3] = 255U;
+    for (d += 4, s += 3, p = prev + 4; d < d_end; d += 4, s += 3, p += 4)
+        {
+            d[0] = (uint8_t)(s[0]
+                             + (uint8_t)(((int)d[-4] + (int)p[0]) >> 1));
+            d[1] = (uint8_t)(s[1]
+                             + (uint8_t)(((int)d[-3] + (int)p[1]) >> 1));
+            d[2] = (uint8_t)(s[2]
+                             + (uint8_t)(((int)d[-2] + (int)p[2]) >> 1));
+            d[3] = 255U;
+        }
+}
+
+static void
+unfilter_rgb_paeth_scalar (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    uint8_t *d = rgba;
+    uint8_t *d_end = rgba + width * 4U;
+    const uint8_t *s = src;
+    const uint8_t *p;
+
+    if (!prev)
+        {
+            unfilter_rgb_sub_scalar (rgba, src, prev, width);
+            return;
+        }
+
+    d[0] = (uint8_t)(s[0] + prev[0]);
+    d[1] = (uint8_t)(s[1] + prev[1]);
+    d[2] = (uint8_t)(s[2] + prev[2]);
+    d[3] = 255U;
+    for (d += 4, s += 3, p = prev + 4; d < d_end; d += 4, s += 3, p += 4)
+        {
+            d[0] = (uint8_t)(s[0] + paeth_predictor (d[-4], p[0], p[-4]));
+            d[1] = (uint8_t)(s[1] + paeth_predictor (d[-3], p[1], p[-3]));
+            d[2] = (uint8_t)(s[2] + paeth_predictor (d[-2], p[2], p[-2]));
+            d[3] = 255U;
+        }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* ------------------------------------------------------------------ */
+/* SSE2 kernels                                                        */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Sub, Avg and Paeth carry a dependency from one pixel to the next, so
+ * these work one pixel per 32-bit lane, as in libpng's SSE2 filters.
+ * The RGB variants read 3 source bytes and store a whole RGBA slot.
+ */
+
+#define TARGET_SSE2 __attribute__ ((target ("sse2")))
+
+static inline TARGET_SSE2 __m128i
+load_px4 (const uint8_t *p)
+{
+    int32_t v;
+    memcpy (&v, p, 4);
+    return _mm_cvtsi32_si128 (v);
+}
+
+/* Loads a 3-byte pixel; all but the last pixel of a row may read one
+   byte past it into the alpha lane, which the callers overwrite. */
+static inline TARGET_SSE2 __m128i
+load_px3 (const uint8_t *p, int last)
+{
+    int32_t v = 0;
+
+    if (last)
+        {
+            memcpy (&v, p, 3);
+        }
+    else
+        {
+            memcpy (&v, p, 4);
+        }
+    return _mm_cvtsi32_si128 (v);
+}
+
+static inline TARGET_SSE2 void
+store_px4 (uint8_t *p, __m128i v)
+{
+    int32_t t = _mm_cvtsi128_si32 (v);
+    memcpy (p, &t, 4);
+}
+
+static inline TARGET_SSE2 __m128i
+abs_epi16_sse2 (__m128i v)
+{
+    return _mm_max_epi16 (v, _mm_sub_epi16 (_mm_setzero_si128 (), v));
+}
+
+static inline TARGET_SSE2 __m128i
+select_sse2 (__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+/* floor((a + b) / 2) per byte; pavgb rounds up. */
+static inline TARGET_SSE2 __m128i
+avg_floor_sse2 (__m128i a, __m128i b)
+{
+    __m128i ones = _mm_set1_epi8 (1);
+    return _mm_sub_epi8 (
+        _mm_avg_epu8 (a, b), _mm_and_si128 (_mm_xor_si128 (a, b), ones)
+    );
+}
+
+/* Paeth on 16-bit lanes; tie-break order is a, b, then c. */
+static inline TARGET_SSE2 __m128i
+paeth_sse2 (__m128i a, __m128i b, __m128i c)
+{
+    __m128i pa = _mm_sub_epi16 (b, c);
+    __m128i pb = _mm_sub_epi16 (a, c);
+    __m128i pc = _mm_add_epi16 (pa, pb);
+    __m128i smallest;
+
+    pa = abs_epi16_sse2 (pa);
+    pb = abs_epi16_sse2 (pb);
+    pc = abs_epi16_sse2 (pc);
+    smallest = _mm_min_epi16 (pc, _mm_min_epi16 (pa, pb));
+    return select_sse2 (
+        _mm_cmpeq_epi16 (smallest, pa),
+        a,
+        select_sse2 (_mm_cmpeq_epi16 (smallest, pb), b, c)
+    );
+}
+
+static TARGET_SSE2 void
+unfilter_up_sse2 (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    size_t i = 0;
+
+    if (!prev)
+        {
+            memcpy (dst, src, row_bytes);
+            return;
+        }
+    for (; i + 16U <= row_bytes; i += 16U)
+        {
+            __m128i va = _mm_loadu_si128 ((const __m128i *)(src + i));
+            __m128i vb = _mm_loadu_si128 ((const __m128i *)(prev + i));
+            _mm_storeu_si128 ((__m128i *)(dst + i), _mm_add_epi8 (va, vb));
+        }
+    for (; i < row_bytes; i++)
+        {
+            dst[i] = (uint8_t)(src[i] + prev[i]);
+        }
+}
+
+static TARGET_SSE2 void
+unfilter_sub_bpp4_sse2 (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    __m128i a = _mm_setzero_si128 ();
+    size_t x;
+
+    (void)prev;
+    for (x = 0; x + 4U <= row_bytes; x += 4U)
+        {
+            a = _mm_add_epi8 (a, load_px4 (src + x));
+            store_px4 (dst + x, a);
+        }
+}
+
+static TARGET_SSE2 void
+unfilter_avg_bpp4_sse2 (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    __m128i a = _mm_setzero_si128 ();
+    size_t x;
+
+    if (!prev)
+        {
+            unfilter_avg_n (dst, src, prev, row_bytes, 4U);
+            return;
+        }
+    for (x = 0; x + 4U <= row_bytes; x += 4U)
+        {
+            a = _mm_add_epi8 (
+                avg_floor_sse2 (a, load_px4 (prev + x)), load_px4 (src + x)
+            );
+            store_px4 (dst + x, a);
+        }
+}
+
+static TARGET_SSE2 void
+unfilter_paeth_bpp4_sse2 (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i b = zero;
+    __m128i d = zero;
+    size_t x;
+
+    if (!prev)
+        {
+            unfilter_sub_bpp4_sse2 (dst, src, prev, row_bytes);
+            return;
+        }
+    for (x = 0; x + 4U <= row_bytes; x += 4U)
+        {
+            __m128i c = b;
+            __m128i a = d;
+
+            b = _mm_unpacklo_epi8 (load_px4 (prev + x), zero);
+            d = _mm_unpacklo_epi8 (load_px4 (src + x), zero);
+            /* _epi8 so the sum wraps modulo 256 in the low byte. */
+            d = _mm_add_epi8 (d, paeth_sse2 (a, b, c));
+            store_px4 (dst + x, _mm_packus_epi16 (d, d));
+        }
+}
+
+static TARGET_SSE2 void
+unfilter_rgb_sub_sse2 (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    __m128i a = _mm_setzero_si128 ();
+    size_t x;
+
+    (void)prev;
+    for (x = 0; x < width; x++)
+        {
+            a = _mm_add_epi8 (a, load_px3 (src + x * 3U, x + 1U == width));
+            store_px4 (rgba + x * 4U, _mm_or_si128 (a, alpha));
+        }
+}
+
+static TARGET_SSE2 void
+unfilter_rgb_avg_sse2 (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    __m128i a = _mm_setzero_si128 ();
+    size_t x;
+
+    if (!prev)
+        {
+            unfilter_rgb_avg_scalar (rgba, src, prev, width);
+            return;
+        }
+    for (x = 0; x < width; x++)
+        {
+            a = _mm_add_epi8 (
+                avg_floor_sse2 (a, load_px4 (prev + x * 4U)),
+                load_px3 (src + x * 3U, x + 1U == width)
+            );
+            store_px4 (rgba + x * 4U, _mm_or_si128 (a, alpha));
+        }
+}
+
+static TARGET_SSE2 void
+unfilter_rgb_paeth_sse2 (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    __m128i b = zero;
+    __m128i d = zero;
+    size_t x;
+
+    if (!prev)
+        {
+            unfilter_rgb_sub_sse2 (rgba, src, prev, width);
+            return;
+        }
+    for (x = 0; x < width; x++)
+        {
+            __m128i c = b;
+            __m128i a = d;
+
+            b = _mm_unpacklo_epi8 (load_px4 (prev + x * 4U), zero);
+            d = _mm_unpacklo_epi8 (
+                load_px3 (src + x * 3U, x + 1U == width), zero
+            );
+            d = _mm_add_epi8 (d, paeth_sse2 (a, b, c));
+            store_px4 (
+                rgba + x * 4U, _mm_or_si128 (_mm_packus_epi16 (d, d), alpha)
+            );
+        }
+}
+
+/*
+ * Colour keying works on whole RGBA words: with alpha forced to 0xFF a
+ * pixel matches the tRNS key exactly when its 32-bit lane equals
+ * key_word (), so one dword compare yields the mask and an and-not of
+ * the alpha byte under it is the blend.
+ */
+static inline uint32_t
+key_word (uint8_t tr, uint8_t tg, uint8_t tb)
+{
+    return (uint32_t)tr | ((uint32_t)tg << 8) | ((uint32_t)tb << 16)
+           | 0xFF000000U;
+}
+
+static TARGET_SSE2 void
+key_rgba_sse2 (
+    uint8_t *rgba, size_t width, uint8_t tr, uint8_t tg, uint8_t tb
+)
+{
+    __m128i key = _mm_set1_epi32 ((int)key_word (tr, tg, tb));
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    size_t x = 0;
+
+    for (; x + 4U <= width; x += 4U)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4U));
+            __m128i hit = _mm_cmpeq_epi32 (_mm_or_si128 (v, alpha), key);
+            v = _mm_andnot_si128 (_mm_and_si128 (hit, alpha), v);
+            _mm_storeu_si128 ((__m128i *)(rgba + x * 4U), v);
+        }
+    key_rgba_scalar (rgba + x * 4U, width - x, tr, tg, tb);
+}
+
+static TARGET_SSE2 unsigned int
+alpha_scan_sse2 (const uint8_t *rgba, size_t width)
+{
+    __m128i all_v = _mm_set1_epi8 ((char)0xFF);
+    __m128i any_v = _mm_setzero_si128 ();
+    uint8_t lanes[2][16];
+    unsigned int all = 255U;
+    unsigned int any = 0U;
+    size_t x = 0;
+
+    for (; x + 4U <= width; x += 4U)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(rgba + x * 4U));
+            all_v = _mm_and_si128 (all_v, v);
+            any_v = _mm_or_si128 (any_v, v);
+        }
+    _mm_storeu_si128 ((__m128i *)lanes[0], all_v);
+    _mm_storeu_si128 ((__m128i *)lanes[1], any_v);
+    alpha_fold_lanes (lanes[0], lanes[1], 16U, &all, &any);
+    alpha_fold (rgba + x * 4U, width - x, &all, &any);
+    return alpha_flags (all, any);
+}
+
+/* ------------------------------------------------------------------ */
+/* SSSE3 kernels                                                       */
+/* ------------------------------------------------------------------ */
+
+#define TARGET_SSSE3 __attribute__ ((target ("ssse3")))
+
+/* Each 16-byte load covers 4 pixels plus 4 bytes of the next; the loops
+   stop early enough that it never leaves the row. */
+
+static TARGET_SSSE3 void
+expand_rgb_ssse3 (uint8_t *rgba, const uint8_t *rgb, size_t width)
+{
+    __m128i shuf
+        = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    size_t x = 0;
+
+    for (; x + 6U <= width; x += 4U)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(rgb + x * 3U));
+            v = _mm_or_si128 (_mm_shuffle_epi8 (v, shuf), alpha);
+            _mm_storeu_si128 ((__m128i *)(rgba + x * 4U), v);
+        }
+    expand_rgb_scalar (rgba + x * 4U, rgb + x * 3U, width - x);
+}
+
+static TARGET_SSSE3 void
+expand_rgb_key_ssse3 (
+    uint8_t *rgba,
+    const uint8_t *rgb,
+    size_t width,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+)
+{
+    __m128i shuf
+        = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i key = _mm_set1_epi32 ((int)key_word (tr, tg, tb));
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    size_t x = 0;
+
+    for (; x + 6U <= width; x += 4U)
+        {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(rgb + x * 3U));
+            __m128i hit;
+
+            v = _mm_or_si128 (_mm_shuffle_epi8 (v, shuf), alpha);
+            hit = _mm_cmpeq_epi32 (v, key);
+            v = _mm_andnot_si128 (_mm_and_si128 (hit, alpha), v);
+            _mm_storeu_si128 ((__m128i *)(rgba + x * 4U), v);
+        }
+    expand_rgb_key_scalar (
+        rgba + x * 4U, rgb + x * 3U, width - x, tr, tg, tb
+    );
+}
+
+static TARGET_SSSE3 void
+unfilter_rgb_up_ssse3 (
+    uint8_t *rgba, const uint8_t *src, const uint8_t *prev, size_t width
+)
+{
+    __m128i shuf
+        = _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m128i alpha = _mm_set1_epi32 ((int)0xFF000000);
+    size_t x = 0;
+
+    if (!prev)
+        {
+            expand_rgb_ssse3 (rgba, src, width);
+            return;
+        }
+    for (; x + 6U <= width; x += 4U)
+        {
+            __m128i rgb = _mm_loadu_si128 ((const __m128i *)(src + x * 3U));
+            __m128i up = _mm_loadu_si128 ((const __m128i *)(prev + x * 4U));
+            __m128i v = _mm_add_epi8 (_mm_shuffle_epi8 (rgb, shuf), up);
+            v = _mm_or_si128 (v, alpha);
+            _mm_storeu_si128 ((__m128i *)(rgba + x * 4U), v);
+        }
+    unfilter_rgb_up_scalar (
+        rgba + x * 4U, src + x * 3U, prev + x * 4U, width - x
+    );
+}
+
+/* ------------------------------------------------------------------ */
+/* AVX2 kernels                                                        */
+/* ------------------------------------------------------------------ */
+
+static __attribute__ ((target ("avx2"))) void
+unfilter_up_avx2 (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    size_t i = 0;
+
+    if (!prev)
+        {
+            memcpy (dst, src, row_bytes);
+            return;
+        }
+    for (; i + 32U <= row_bytes; i += 32U)
+        {
+            __m256i va = _mm256_loadu_si256 ((const __m256i *)(src + i));
+            __m256i vb = _mm256_loadu_si256 ((const __m256i *)(prev + i));
+            _mm256_storeu_si256 (
+                (__m256i *)(dst + i), _mm256_add_epi8 (va, vb)
+            );
+        }
+    for (; i < row_bytes; i++)
+        {
+            dst[i] = (uint8_t)(src[i] + prev[i]);
+        }
+}
+
+static __attribute__ ((target ("avx2"))) void
+key_rgba_avx2 (
+    uint8_t *rgba, size_t width, uint8_t tr, uint8_t tg, uint8_t tb
+)
+{
+    __m256i key = _mm256_set1_epi32 ((int)key_word (tr, tg, tb));
+    __m256i alpha = _mm256_set1_epi32 ((int)0xFF000000);
+    size_t x = 0;
+
+    for (; x + 8U <= width; x += 8U)
+        {
+            __m256i v
+                = _mm256_loadu_si256 ((const __m256i *)(rgba + x * 4U));
+            __m256i hit
+                = _mm256_cmpeq_epi32 (_mm256_or_si256 (v, alpha), key);
+            v = _mm256_andnot_si256 (_mm256_and_si256 (hit, alpha), v);
+            _mm256_storeu_si256 ((__m256i *)(rgba + x * 4U), v);
+        }
+    key_rgba_sse2 (rgba + x * 4U, width - x, tr, tg, tb);
+}
+
+static __attribute__ ((target ("avx2"))) unsigned int
+alpha_scan_avx2 (const uint8_t *rgba, size_t width)
+{
+    __m256i all_v = _mm256_set1_epi8 ((char)0xFF);
+    __m256i any_v = _mm256_setzero_si256 ();
+    uint8_t lanes[2][32];
+    unsigned int all = 255U;
+    unsigned int any = 0U;
+    size_t x = 0;
+
+    for (; x + 8U <= width; x += 8U)
+        {
+            __m256i v
+                = _mm256_loadu_si256 ((const __m256i *)(rgba + x * 4U));
+            all_v = _mm256_and_si256 (all_v, v);
+            any_v = _mm256_or_si256 (any_v, v);
+        }
+    _mm256_storeu_si256 ((__m256i *)lanes[0], all_v);
+    _mm256_storeu_si256 ((__m256i *)lanes[1], any_v);
+    alpha_fold_lanes (lanes[0], lanes[1], 32U, &all, &any);
+    alpha_fold (rgba + x * 4U, width - x, &all, &any);
+    return alpha_flags (all, any);
+}
+
+/* ------------------------------------------------------------------ */
+/* AVX-512 kernels                                                     */
+/* ------------------------------------------------------------------ */
+
+#define TARGET_AVX512 __attribute__ ((target ("avx512f,avx512bw")))
+
+static TARGET_AVX512 void
+unfilter_up_avx512 (
+    uint8_t *dst, const uint8_t *src, const uint8_t *prev, size_t row_bytes
+)
+{
+    size_t i = 0;
+
+    if (!prev)
+        {
+            memcpy (dst, src, row_bytes);
+            return;
+        }
+    for (; i + 64U <= row_bytes; i += 64U)
+        {
+            __m512i va = _mm512_loadu_si512 ((const void *)(src + i));
+            __m512i vb = _mm512_loadu_si512 ((const void *)(prev + i));
+            _mm512_storeu_si512 ((void *)(dst + i), _mm512_add_epi8 (va, vb));
+        }
+    unfilter_up_avx2 (dst + i, src + i, prev + i, row_bytes - i);
+}
+
+/*
+ * 16 pixels per step: a dword permute moves each group of 12 source
+ * bytes to the start of its 128-bit lane, then the SSSE3 shuffle runs
+ * per lane.  The 64-byte load reads 16 bytes past the 48 it uses.
+ */
+static TARGET_AVX512 void
+expand_rgb_avx512 (uint8_t *rgba, const uint8_t *rgb, size_t width)
+{
+    __m512i perm = _mm512_setr_epi32 (
+        0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12
+    );
+    __m512i shuf = _mm512_broadcast_i32x4 (
+        _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)
+    );
+    __m512i alpha = _mm512_set1_epi32 ((int)0xFF000000);
+    size_t x = 0;
+
+    for (; x + 22U <= width; x += 16U)
+        {
+            __m512i v = _mm512_loadu_si512 ((const void *)(rgb + x * 3U));
+            v = _mm512_permutexvar_epi32 (perm, v);
+            v = _mm512_or_si512 (_mm512_shuffle_epi8 (v, shuf), alpha);
+            _mm512_storeu_si512 ((void *)(rgba + x * 4U), v);
+        }
+    expand_rgb_ssse3 (rgba + x * 4U, rgb + x * 3U, width - x);
+}
+
+/* As expand_rgb_avx512, with the key compare producing a lane mask that
+   selects which alpha bytes are cleared. */
+static TARGET_AVX512 void
+expand_rgb_key_avx512 (
+    uint8_t *rgba,
+    const uint8_t *rgb,
+    size_t width,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+)
+{
+    __m512i perm = _mm512_setr_epi32 (
+        0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12
+    );
+    __m512i shuf = _mm512_broadcast_i32x4 (
+        _mm_setr_epi8 (0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)
+    );
+    __m512i key = _mm512_set1_epi32 ((int)key_word (tr, tg, tb));
+    __m512i alpha = _mm512_set1_epi32 ((int)0xFF000000);
+    __m512i clear = _mm512_set1_epi32 (0x00FFFFFF);
+    size_t x = 0;
+
+    for (; x + 22U <= width; x += 16U)
+        {
+            __m512i v = _mm512_loadu_si512 ((const void *)(rgb + x * 3U));
+            __mmask16 hit;
+
+            v = _mm512_permutexvar_epi32 (perm, v);
+            v = _mm512_or_si512 (_mm512_shuffle_epi8 (v, shuf), alpha);
+            hit = _mm512_cmpeq_epi32_mask (v, key);
+            v = _mm512_mask_and_epi32 (v, hit, v, clear);
+            _mm512_storeu_si512 ((void *)(rgba + x * 4U), v);
+        }
+    expand_rgb_key_ssse3 (
+        rgba + x * 4U, rgb + x * 3U, width - x, tr, tg, tb
+    );
+}
+
+static TARGET_AVX512 void
+key_rgba_avx512 (
+    uint8_t *rgba, size_t width, uint8_t tr, uint8_t tg, uint8_t tb
+)
+{
+    __m512i key = _mm512_set1_epi32 ((int)key_word (tr, tg, tb));
+    __m512i alpha = _mm512_set1_epi32 ((int)0xFF000000);
+    __m512i clear = _mm512_set1_epi32 (0x00FFFFFF);
+    size_t x = 0;
+
+    for (; x + 16U <= width; x += 16U)
+        {
+            __m512i v = _mm512_loadu_si512 ((const void *)(rgba + x * 4U));
+            __mmask16 hit
+                = _mm512_cmpeq_epi32_mask (_mm512_or_si512 (v, alpha), key);
+            v = _mm512_mask_and_epi32 (v, hit, v, clear);
+            _mm512_storeu_si512 ((void *)(rgba + x * 4U), v);
+        }
+    key_rgba_avx2 (rgba + x * 4U, width - x, tr, tg, tb);
+}
+
+static TARGET_AVX512 unsigned int
+alpha_scan_avx512 (const uint8_t *rgba, size_t width)
+{
+    __m512i all_v = _mm512_set1_epi8 ((char)0xFF);
+    __m512i any_v = _mm512_setzero_si512 ();
+    uint8_t lanes[2][64];
+    unsigned int all = 255U;
+    unsigned int any = 0U;
+    size_t x = 0;
+
+    for (; x + 16U <= width; x += 16U)
+        {
+            __m512i v = _mm512_loadu_si512 ((const void *)(rgba + x * 4U));
+            all_v = _mm512_and_si512 (all_v, v);
+            any_v = _mm512_or_si512 (any_v, v);
+        }
+    _mm512_storeu_si512 ((void *)lanes[0], all_v);
+    _mm512_storeu_si512 ((void *)lanes[1], any_v);
+    alpha_fold_lanes (lanes[0], lanes[1], 64U, &all, &any);
+    alpha_fold (rgba + x * 4U, width - x, &all, &any);
+    return alpha_flags (all, any);
+}
+
+#endif /* x86 */
+
+/* ------------------------------------------------------------------ */
+/* Kernel registration                                                 */
+/* ------------------------------------------------------------------ */
+
+void
+png_register_kernels (pixel_kernels_t *k, cpu_isa_t isa)
+{
+    size_t bpp;
+
+    png_init_tables ();
+
+    for (bpp = 1; bpp <= PIXEL_MAX_BPP; bpp++)
+        {
+            k->unfilter[bpp][0] = unfilter_none_scalar;
+            k->unfilter[bpp][2] = unfilter_up_scalar;
+        }
+#define REGISTER_UNFILTER_BPP(n)                                             \
+    k->unfilter[n][1] = unfilter_sub_bpp##n##_scalar;                        \
+    k->unfilter[n][3] = unfilter_avg_bpp##n##_scalar;                        \
+    k->unfilter[n][4] = unfilter_paeth_bpp##n##_scalar;
+    PNG_UNFILTER_BPPS (REGISTER_UNFILTER_BPP)
+#undef REGISTER_UNFILTER_BPP
+
+    /* [0] stays NULL: None rows go through expand_rgb directly. */
+    k->unfilter_rgb_to_rgba[1] = unfilter_rgb_sub_scalar;
+    k->unfilter_rgb_to_rgba[2] = unfilter_rgb_up_scalar;
+    k->unfilter_rgb_to_rgba[3] = unfilter_rgb_avg_scalar;
+    k->unfilter_rgb_to_rgba[4] = unfilter_rgb_paeth_scalar;
+
+    k->expand_rgb = expand_rgb_scalar;
+    k->expand_rgb_key = expand_rgb_key_scalar;
+    k->key_rgba = key_rgba_scalar;
+    k->alpha_scan = alpha_scan_scalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (isa == CPU_ISA_NEON)
+        {
+            return;
+        }
+    if (isa >= CPU_ISA_SSE2)
+        {
+            for (bpp = 1; bpp <= PIXEL_MAX_BPP; bpp++)
+                {
+                    k->unfilter[bpp][2] = unfilter_up_sse2;
+                }
+            k->unfilter[4][1] = unfilter_sub_bpp4_sse2;
+            k->unfilter[4][3] = unfilter_avg_bpp4_sse2;
+            k->unfilter[4][4] = unfilter_paeth_bpp4_sse2;
+            k->unfilter_rgb_to_rgba[1] = unfilter_rgb_sub_sse2;
+            k->unfilter_rgb_to_rgba[3] = unfilter_rgb_avg_sse2;
+            k->unfilter_rgb_to_rgba[4] = unfilter_rgb_paeth_sse2;
+            k->key_rgba = key_rgba_sse2;
+            k->alpha_scan = alpha_scan_sse2;
+        }
+    if (isa >= CPU_ISA_SSSE3)
+        {
+            k->unfilter_rgb_to_rgba[2] = unfilter_rgb_up_ssse3;
+            k->expand_rgb = expand_rgb_ssse3;
+            k->expand_rgb_key = expand_rgb_key_ssse3;
+        }
+    if (isa >= CPU_ISA_AVX2)
+        {
+            for (bpp = 1; bpp <= PIXEL_MAX_BPP; bpp++)
+                {
+                    k->unfilter[bpp][2] = unfilter_up_avx2;
+                }
+            k->key_rgba = key_rgba_avx2;
+            k->alpha_scan = alpha_scan_avx2;
+        }
+    if (isa >= CPU_ISA_AVX512)
+        {
+            for (bpp = 1; bpp <= PIXEL_MAX_BPP; bpp++)
+                {
+                    k->unfilter[bpp][2] = unfilter_up_avx512;
+                }
+            k->expand_rgb = expand_rgb_avx512;
+            k->expand_rgb_key = expand_rgb_key_avx512;
+            k->key_rgba = key_rgba_avx512;
+            k->alpha_scan = alpha_scan_avx512;
+        }
+#endif
+    (void)isa;
+}
+
+/* ------------------------------------------------------------------ */
+/* Row entry points                                                    */
+/* ------------------------------------------------------------------ */
+
+static inline int
+unfilter_row_with (
+    const pixel_kernels_t *k,
+    uint8_t *row_dst,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    size_t row_bytes,
+    size_t bpp
+)
+{
+    uint8_t filter = row_with_filter[0];
+
+    if (filter > 4U)
+        {
+            return 0;
+        }
+    if (bpp >= 1U && bpp <= PIXEL_MAX_BPP && k->unfilter[bpp][filter])
+        {
+            k->unfilter[bpp][filter] (
+                row_dst, row_with_filter + 1U, prev, row_bytes
+            );
+            return 1;
+        }
+    unfilter_row_generic (
+        row_dst, row_with_filter + 1U, prev, row_bytes, bpp, filter
+    );
+    return 1;
+}
+
+static inline int
+unfilter_rgb_row_with (
+    const pixel_kernels_t *k,
+    uint8_t *out,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    uint32_t width,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+)
+{
+    uint8_t filter = row_with_filter[0];
+    const uint8_t *src = row_with_filter + 1U;
+
+    if (filter > 4U)
+        {
+            return 0;
+        }
+    if (width == 0)
+        {
+            return 1;
+        }
+    if (filter == 0 || (filter == 2 && !prev))
+        {
+            if (has_trns)
+                {
+                    k->expand_rgb_key (out, src, width, tr, tg, tb);
+                }
+            else
+                {
+                    k->expand_rgb (out, src, width);
+                }
+            return 1;
+        }
+
+    k->unfilter_rgb_to_rgba[filter] (out, src, prev, width);
+    if (has_trns)
+        {
+            k->key_rgba (out, width, tr, tg, tb);
+        }
+    return 1;
+}
+
+int
+png_unfilter_row (
+    uint8_t *row_dst,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    size_t row_bytes,
+    size_t bpp
+)
+{
+    return unfilter_row_with (
+        pixel_kernels (), row_dst, row_with_filter, prev, row_bytes, bpp
+    );
+}
+
+int
+png_unfilter_row_rgb_to_rgba (
+    uint8_t *out,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    uint32_t width,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+)
+{
+    return unfilter_rgb_row_with (
+        pixel_kernels (),
+        out,
+        row_with_filter,
+        prev,
+        width,
+        has_trns,
+        tr,
+        tg,
+        tb
+    );
+}
+
+void
+png_convert_rgb_rows_to_rgba (
+    uint8_t *rgba,
+    const uint8_t *scan,
+    uint32_t width,
+    size_t y0,
+    size_t y1,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb
+)
+{
+    const pixel_kernels_t *k = pixel_kernels ();
+    size_t row_bytes = (size_t)width * 3U;
+    size_t out_row_bytes = (size_t)width * 4U;
+    size_t y;
+
+    for (y = y0; y < y1; y++)
+        {
+            if (has_trns)
                 {
-                    char *end = NULL;
-                    long v = strtol (env, &end, 10);
-                    if (end && *end == '\0' && v > 0 && v <= 128)
-                        {
-                            threads = (int)v;
-                        }
+                    k->expand_rgb_key (
+                        rgba + y * out_row_bytes,
+                        scan + y * row_bytes,
+                        width,
+                        tr,
+                        tg,
+                        tb
+                    );
+                }
+            else
+                {
+                    k->expand_rgb (
+                        rgba + y * out_row_bytes, scan + y * row_bytes, width
+                    );
                 }
-            initialized = 1;
         }
-    return threads;
 }
 
+/* ------------------------------------------------------------------ */
+/* Threading configuration                                             */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Thread count and parallel cut-over thresholds.  Defaults come from the
+ * environment (read once) and can be replaced at runtime through
+ * png_set_tuning, e.g. with values calibrated by `bench_decode --sweep`.
+ */
+#define PNG_MAX_THREADS 128
+#define PNG_DEFAULT_MT_MIN_ROWS 64U
+#define PNG_DEFAULT_MT_MIN_PIXELS 400000U
+/* From 16 MiB inflated, two overlapped stages ran RGBA sprite sheets
+   about 1.8x faster and cost noisy, barely compressed sheets at most
+   20%; below it the losses on noisy content grow. */
+#define PNG_DEFAULT_PIPELINE_MIN_BYTES (16U << 20)
+
+static png_tuning_t g_tuning = { 1,
+                                 PNG_DEFAULT_MT_MIN_ROWS,
+                                 PNG_DEFAULT_MT_MIN_PIXELS,
+                                 PNG_DEFAULT_PIPELINE_MIN_BYTES };
+static pthread_once_t g_tuning_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_tuning_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+env_long (const char *name, long lo, long hi, long *out)
+{
+    const char *env = getenv (name);
+    char *end = NULL;
+    long v;
+
+    if (!env || env[0] == '\0')
+        {
+            return 0;
+        }
+    v = strtol (env, &end, 10);
+    if (!end || *end != '\0' || v < lo || v > hi)
+        {
+            return 0;
+        }
+    *out = v;
+    return 1;
+}
+
+static void
+init_tuning_once (void)
+{
+    long v;
+
+    if (env_long ("SLICER_PNG_THREADS", 1, PNG_MAX_THREADS, &v))
+        {
+            g_tuning.threads = (int)v;
+        }
+    if (env_long ("SLICER_PNG_MT_MIN_ROWS", 0, 1000000L, &v))
+        {
+            g_tuning.mt_min_rows = (size_t)v;
+        }
+    if (env_long ("SLICER_PNG_MT_MIN_PIXELS", 0, 1000000000L, &v))
+        {
+            g_tuning.mt_min_pixels = (size_t)v;
+        }
+    if (env_long ("SLICER_PNG_PIPELINE_MIN_BYTES", 0, LONG_MAX, &v))
+        {
+            g_tuning.pipeline_min_bytes = (size_t)v;
+        }
+}
+
+void
+png_get_tuning (png_tuning_t *out)
+{
+    pthread_once (&g_tuning_once, init_tuning_once);
+    pthread_mutex_lock (&g_tuning_lock);
+    *out = g_tuning;
+    pthread_mutex_unlock (&g_tuning_lock);
+}
+
+void
+png_set_tuning (const png_tuning_t *tuning)
+{
+    pthread_once (&g_tuning_once, init_tuning_once);
+    pthread_mutex_lock (&g_tuning_lock);
+    g_tuning = *tuning;
+    if (g_tuning.threads < 1)
+        {
+            g_tuning.threads = 1;
+        }
+    if (g_tuning.threads > PNG_MAX_THREADS)
+        {
+            g_tuning.threads = PNG_MAX_THREADS;
+        }
+    pthread_mutex_unlock (&g_tuning_lock);
+}
+
+/* ------------------------------------------------------------------ */
+/* Cancellation tokens                                                 */
+/* ------------------------------------------------------------------ */
+
+static uint64_t
+monotonic_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void
+png_cancel_init (png_cancel_t *cancel, unsigned long timeout_ms)
+{
+    cancel->cancelled = 0;
+    cancel->deadline_ns = 0;
+    if (timeout_ms > 0)
+        {
+            cancel->deadline_ns
+                = monotonic_ns () + (uint64_t)timeout_ms * 1000000ULL;
+        }
+}
+
+void
+png_cancel (png_cancel_t *cancel)
+{
+    __atomic_store_n (&cancel->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+int
+png_cancel_requested (const png_cancel_t *cancel)
+{
+    if (!cancel)
+        {
+            return 0;
+        }
+    if (__atomic_load_n (&cancel->cancelled, __ATOMIC_RELAXED))
+        {
+            return 1;
+        }
+    return cancel->deadline_ns != 0 && monotonic_ns () >= cancel->deadline_ns;
+}
+
+/* ------------------------------------------------------------------ */
+/* Dependency-aware parallel unfilter                                  */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Rows filtered with None (0) or Sub (1) never read the row above, so
+ * each one starts a chain of rows that can be unfiltered independently
+ * of everything before it.  One pass over the filter bytes splits the
+ * image at those rows; adjacent chains are then merged into jobs of a
+ * few rows each and the workers claim jobs until none are left.
+ */
+
+/*
+ * How filtered rows land in the output: RGBA is unfiltered at bpp 4,
+ * RGB is unfiltered straight into 4-byte slots.  With `row_alpha` set,
+ * each output row's alpha coverage is recorded as it is produced.
+ */
 typedef struct
 {
-    uint8_t *rgba;
-    const uint8_t *scan;
+    const pixel_kernels_t *kernels;
+    size_t row_bytes; /* filtered bytes per row, without the filter byte */
+    size_t bpp;
     uint32_t width;
-    size_t y0;
-    size_t y1;
     int has_trns;
     uint8_t tr;
     uint8_t tg;
     uint8_t tb;
-} rgb_expand_task_t;
+    uint8_t *row_alpha; /* IMAGE_ROW_* per row, or NULL */
+    const png_cancel_t *cancel; /* polled once per strip, or NULL */
+    size_t strip_rows;
+} row_layout_t;
+
+static inline uint8_t
+classify_alpha (unsigned int flags)
+{
+    if (!(flags & PIXEL_ALPHA_NOT_OPAQUE))
+        {
+            return IMAGE_ROW_OPAQUE;
+        }
+    if (!(flags & PIXEL_ALPHA_NOT_CLEAR))
+        {
+            return IMAGE_ROW_TRANSPARENT;
+        }
+    return IMAGE_ROW_MIXED;
+}
+
+static inline int
+unfilter_out_row (
+    const row_layout_t *layout,
+    uint8_t *dst,
+    const uint8_t *row_with_filter,
+    const uint8_t *prev,
+    size_t y
+)
+{
+    int ok;
+
+    if (layout->bpp == 3U)
+        {
+            ok = unfilter_rgb_row_with (
+                layout->kernels,
+                dst,
+                row_with_filter,
+                prev,
+                layout->width,
+                layout->has_trns,
+                layout->tr,
+                layout->tg,
+                layout->tb
+            );
+        }
+    else
+        {
+            ok = unfilter_row_with (
+                layout->kernels,
+                dst,
+                row_with_filter,
+                prev,
+                layout->row_bytes,
+                layout->bpp
+            );
+        }
+    if (ok && layout->row_alpha)
+        {
+            layout->row_alpha[y] = classify_alpha (
+                layout->kernels->alpha_scan (dst, layout->width)
+            );
+        }
+    return ok;
+}
+
+typedef struct
+{
+    uint8_t *dst;
+    size_t dst_stride;
+    const uint8_t *raw;
+    const row_layout_t *layout;
+    const size_t *job_start; /* job_count + 1 entries, last == height */
+    size_t job_count;
+    size_t next_job;
+    int cancelled;
+    pthread_mutex_t lock;
+} unfilter_sched_t;
+
+/*
+ * Returns the number of jobs written to `job_start` (plus the closing
+ * `height` entry), or 0 if a filter byte is invalid.  Chains shorter
+ * than `min_rows` are merged into their predecessor.
+ */
+static size_t
+plan_unfilter_jobs (
+    const uint8_t *raw,
+    size_t row_bytes,
+    size_t height,
+    size_t min_rows,
+    size_t *job_start
+)
+{
+    size_t jobs = 0;
+    size_t y;
+
+    for (y = 0; y < height; y++)
+        {
+            uint8_t filter = raw[y * (row_bytes + 1U)];
+
+            if (filter > 4U)
+                {
+                    return 0;
+                }
+            if (y == 0
+                || (filter <= 1U && y - job_start[jobs - 1U] >= min_rows))
+                {
+                    job_start[jobs++] = y;
+                }
+        }
+    job_start[jobs] = height;
+    return jobs;
+}
+
+/* Polled once per strip; one worker noticing a cancel stops them all. */
+static int
+unfilter_sched_cancelled (unfilter_sched_t *sched)
+{
+    if (__atomic_load_n (&sched->cancelled, __ATOMIC_RELAXED))
+        {
+            return 1;
+        }
+    if (!png_cancel_requested (sched->layout->cancel))
+        {
+            return 0;
+        }
+    __atomic_store_n (&sched->cancelled, 1, __ATOMIC_RELAXED);
+    return 1;
+}
 
 static void *
-rgb_expand_worker (void *arg)
-{
-    rgb_expand_task_t *task = (rgb_expand_task_t *)arg;
-    convert_rgb_rows_to_rgba (
-        task->rgba,
-        task->scan,
-        task->width,
-        task->y0,
-        task->y1,
-        task->has_trns,
-        task->tr,
-        task->tg,
-        task->tb
-    );
+unfilter_sched_worker (void *arg)
+{
+    unfilter_sched_t *sched = (unfilter_sched_t *)arg;
+    size_t strip_rows = sched->layout->strip_rows;
+
+    for (;;)
+        {
+            size_t job;
+            size_t y;
+            size_t y_end;
+
+            pthread_mutex_lock (&sched->lock);
+            job = sched->next_job++;
+            pthread_mutex_unlock (&sched->lock);
+            if (job >= sched->job_count)
+                {
+                    break;
+                }
+
+            y_end = sched->job_start[job + 1U];
+            for (y = sched->job_start[job]; y < y_end; y++)
+                {
+                    /* The first row of a job is None/Sub (or row 0) and
+                       must not touch the row above: another worker may
+                       still be writing it. */
+                    const uint8_t *prev
+                        = (y == sched->job_start[job])
+                              ? NULL
+                              : sched->dst + (y - 1U) * sched->dst_stride;
+
+                    if ((y - sched->job_start[job]) % strip_rows == 0
+                        && unfilter_sched_cancelled (sched))
+                        {
+                            return NULL;
+                        }
+                    unfilter_out_row (
+                        sched->layout,
+                        sched->dst + y * sched->dst_stride,
+                        sched->raw + y * (sched->layout->row_bytes + 1U),
+                        prev,
+                        y
+                    );
+                }
+        }
     return NULL;
 }
 
-static void
-convert_rgb_to_rgba_mt (
-    uint8_t *rgba,
-    const uint8_t *scan,
-    uint32_t width,
-    uint32_t height,
-    int has_trns,
-    uint8_t tr,
-    uint8_t tg,
-    uint8_t tb
+static int
+unfilter_rows_serial (
+    const row_layout_t *layout,
+    uint8_t *dst,
+    size_t dst_stride,
+    const uint8_t *raw,
+    size_t height
+)
+{
+    size_t y;
+
+    for (y = 0; y < height; y++)
+        {
+            const uint8_t *prev
+                = (y == 0) ? NULL : (dst + (y - 1U) * dst_stride);
+            if (y % layout->strip_rows == 0
+                && png_cancel_requested (layout->cancel))
+                {
+                    return PNG_DECODE_CANCELLED;
+                }
+            if (!unfilter_out_row (
+                    layout,
+                    dst + y * dst_stride,
+                    raw + y * (layout->row_bytes + 1U),
+                    prev,
+                    y
+                ))
+                {
+                    return 0;
+                }
+        }
+    return 1;
+}
+
+/*
+ * Unfilters `height` rows into `dst`, splitting the work across the
+ * tuned thread count when the image is large enough and has at least
+ * two independent chains; otherwise runs serially on the caller.
+ * Returns 1, 0 on a bad filter byte, or PNG_DECODE_CANCELLED.
+ */
+static int
+unfilter_rows (
+    const png_tuning_t *tuning,
+    const row_layout_t *layout,
+    uint8_t *dst,
+    size_t dst_stride,
+    const uint8_t *raw,
+    size_t height
 )
 {
-    int req_threads = configured_png_threads ();
-    size_t rows = (size_t)height;
-    size_t pixels = (size_t)width * rows;
+    size_t row_bytes = layout->row_bytes;
+    unfilter_sched_t sched;
+    size_t *job_start;
     size_t thread_count;
+    size_t min_rows;
+    size_t launched = 0;
+    pthread_t *threads;
     size_t i;
 
-    if (req_threads <= 1 || rows < 64U || pixels < 400000U)
+    if (tuning->threads <= 1 || height < 2U || height < tuning->mt_min_rows
+        || (size_t)layout->width * height < tuning->mt_min_pixels)
         {
-            convert_rgb_rows_to_rgba (
-                rgba, scan, width, 0, rows, has_trns, tr, tg, tb
+            return unfilter_rows_serial (
+                layout, dst, dst_stride, raw, height
             );
-            return;
         }
 
-    thread_count = (size_t)req_threads;
-    if (thread_count > rows)
+    job_start = (size_t *)malloc ((height + 1U) * sizeof (*job_start));
+    if (!job_start)
         {
-            thread_count = rows;
+            return unfilter_rows_serial (
+                layout, dst, dst_stride, raw, height
+            );
+        }
+
+    /* Aim for ~8 jobs per thread so uneven chains still balance. */
+    thread_count = (size_t)tuning->threads;
+    min_rows = height / (thread_count * 8U);
+    if (min_rows < 1U)
+        {
+            min_rows = 1U;
         }
 
-    if (thread_count <= 1)
+    sched.job_count
+        = plan_unfilter_jobs (raw, row_bytes, height, min_rows, job_start);
+    if (sched.job_count == 0)
         {
-            convert_rgb_rows_to_rgba (
-                rgba, scan, width, 0, rows, has_trns, tr, tg, tb
+            free (job_start);
+            return 0;
+        }
+    if (sched.job_count < 2U)
+        {
+            free (job_start);
+            return unfilter_rows_serial (
+                layout, dst, dst_stride, raw, height
             );
-            return;
+        }
+    if (thread_count > sched.job_count)
+        {
+            thread_count = sched.job_count;
         }
 
-    {
-        pthread_t *threads
-            = (pthread_t *)malloc ((thread_count - 1U) * sizeof (*threads));
-        rgb_expand_task_t *tasks
-            = (rgb_expand_task_t *)malloc (thread_count * sizeof (*tasks));
-        size_t launched = 0;
-        size_t chunk = (rows + thread_count - 1U) / thread_count;
-
-        if (!threads || !tasks)
-            {
-                free (tasks);
-                free (threads);
-                convert_rgb_rows_to_rgba (
-                    rgba, scan, width, 0, rows, has_trns, tr, tg, tb
-                );
-                return;
-            }
-
-        for (i = 0; i < thread_count; i++)
-            {
-                size_t y0 = i * chunk;
-                size_t y1 = y0 + chunk;
-                if (y0 > rows)
-                    {
-                        y0 = rows;
-                    }
-                if (y1 > rows)
-                    {
-                        y1 = rows;
-                    }
-                tasks[i].rgba = rgba;
-                tasks[i].scan = scan;
-                tasks[i].width = width;
-                tasks[i].y0 = y0;
-                tasks[i].y1 = y1;
-                tasks[i].has_trns = has_trns;
-                tasks[i].tr = tr;
-                tasks[i].tg = tg;
-                tasks[i].tb = tb;
-            }
-
-        for (i = 1; i < thread_count; i++)
-            {
-                if (pthread_create (
-                        &threads[i - 1U], NULL, rgb_expand_worker, &tasks[i]
-                    )
-                    != 0)
-                    {
-                        break;
-                    }
-                launched++;
-            }
-
-        rgb_expand_worker (&tasks[0]);
-        for (i = 0; i < launched; i++)
-            {
-                pthread_join (threads[i], NULL);
-            }
-
-        if (i < thread_count - 1U)
-            {
-                size_t failed_idx = i + 1U;
-                for (; failed_idx < thread_count; failed_idx++)
-                    {
-                        convert_rgb_rows_to_rgba (
-                            rgba,
-                            scan,
-                            width,
-                            tasks[failed_idx].y0,
-                            tasks[failed_idx].y1,
-                            has_trns,
-                            tr,
-                            tg,
-                            tb
-                        );
-                    }
-            }
-
-        free (tasks);
-        free (threads);
-    }
+    sched.dst = dst;
+    sched.dst_stride = dst_stride;
+    sched.raw = raw;
+    sched.layout = layout;
+    sched.job_start = job_start;
+    sched.next_job = 0;
+    sched.cancelled = 0;
+    pthread_mutex_init (&sched.lock, NULL);
+
+    /* If threads cannot be created the caller simply claims every job. */
+    threads = (pthread_t *)malloc ((thread_count - 1U) * sizeof (*threads));
+    if (threads)
+        {
+            for (i = 1; i < thread_count; i++)
+                {
+                    if (pthread_create (
+                            &threads[launched],
+                            NULL,
+                            unfilter_sched_worker,
+                            &sched
+                        )
+                        != 0)
+                        {
+                            break;
+                        }
+                    launched++;
+                }
+        }
+
+    unfilter_sched_worker (&sched);
+    for (i = 0; i < launched; i++)
+        {
+            pthread_join (threads[i], NULL);
+        }
+
+    pthread_mutex_destroy (&sched.lock);
+    free (threads);
+    free (job_start);
+    return sched.cancelled ? PNG_DECODE_CANCELLED : 1;
 }
 
 /* ------------------------------------------------------------------ */
-/* Public API                                                          */
+/* Incremental row decoder                                             */
 /* ------------------------------------------------------------------ */
 
-int
-png_decode_raw_to_rgba (
+void
+png_row_decoder_init (
+    png_row_decoder_t *dec,
     uint8_t *rgba,
-    const uint8_t *raw,
     uint32_t width,
-    uint32_t height,
     size_t src_channels,
     int has_trns,
     uint8_t tr,
@@ -842,104 +1972,103 @@ png_decode_raw_to_rgba (
     uint8_t tb
 )
 {
-    size_t row_bytes = (size_t)width * src_channels;
-    size_t out_row_bytes = (size_t)width * 4U;
-    size_t y;
-    pthread_once (&g_paeth_once, init_paeth_tables_once);
+    memset (dec, 0, sizeof (*dec));
+    dec->rgba = rgba;
+    dec->width = width;
+    dec->src_channels = src_channels;
+    dec->row_bytes = (size_t)width * src_channels;
+    dec->has_trns = has_trns;
+    dec->tr = tr;
+    dec->tg = tg;
+    dec->tb = tb;
+
+    png_init_tables ();
+}
 
-    if (src_channels == 4U)
+int
+png_row_decoder_push (
+    png_row_decoder_t *dec, const uint8_t *rows, size_t count
+)
+{
+    size_t out_row_bytes = (size_t)dec->width * 4U;
+    row_layout_t layout;
+    size_t i;
+
+    layout.kernels = pixel_kernels ();
+    layout.row_bytes = dec->row_bytes;
+    layout.bpp = dec->src_channels;
+    layout.width = dec->width;
+    layout.has_trns = dec->has_trns;
+    layout.tr = dec->tr;
+    layout.tg = dec->tg;
+    layout.tb = dec->tb;
+    layout.row_alpha = dec->row_alpha;
+    layout.cancel = NULL;
+    layout.strip_rows = 1U;
+
+    for (i = 0; i < count; i++)
         {
-            for (y = 0; y < (size_t)height; y++)
+            uint8_t *out = dec->rgba + dec->y * out_row_bytes;
+            const uint8_t *prev = (dec->y == 0) ? NULL : out - out_row_bytes;
+
+            if (!unfilter_out_row (
+                    &layout,
+                    out,
+                    rows + i * (dec->row_bytes + 1U),
+                    prev,
+                    dec->y
+                ))
                 {
-                    const uint8_t *row_src = raw + y * (row_bytes + 1U);
-                    const uint8_t *prev
-                        = (y == 0) ? NULL : (rgba + (y - 1U) * out_row_bytes);
-                    uint8_t *row_dst = rgba + y * out_row_bytes;
-                    if (!unfilter_row (row_dst, row_src, prev, row_bytes, 4U))
-                        {
-                            return 0;
-                        }
+                    return 0;
                 }
-            return 1;
+            dec->y++;
         }
+    return 1;
+}
 
-    if (src_channels == 3U)
-        {
-            if (configured_png_threads () <= 1)
-                {
-                    uint8_t *row_state
-                        = (uint8_t *)malloc (row_bytes * 2U + 16U);
-                    uint8_t *prev_row;
-                    uint8_t *cur_row;
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
 
-                    if (!row_state)
-                        {
-                            return 0;
-                        }
-                    prev_row = row_state;
-                    cur_row = row_state + row_bytes;
+int
+png_decode_raw_to_rgba (
+    uint8_t *rgba,
+    const uint8_t *raw,
+    uint32_t width,
+    uint32_t height,
+    size_t src_channels,
+    int has_trns,
+    uint8_t tr,
+    uint8_t tg,
+    uint8_t tb,
+    uint8_t *row_alpha,
+    const png_cancel_t *cancel
+)
+{
+    row_layout_t layout;
+    png_tuning_t tuning;
 
-                    for (y = 0; y < (size_t)height; y++)
-                        {
-                            const uint8_t *row_src
-                                = raw + y * (row_bytes + 1U);
-                            const uint8_t *prev = (y == 0) ? NULL : prev_row;
-                            uint8_t *row_dst = cur_row;
-                            uint8_t *out = rgba + y * out_row_bytes;
-
-                            if (!unfilter_row (
-                                    row_dst, row_src, prev, row_bytes, 3U
-                                ))
-                                {
-                                    free (row_state);
-                                    return 0;
-                                }
-                            convert_rgb_rows_to_rgba (
-                                out, row_dst, width, 0, 1, has_trns, tr, tg, tb
-                            );
-
-                            {
-                                uint8_t *tmp = prev_row;
-                                prev_row = cur_row;
-                                cur_row = tmp;
-                            }
-                        }
+    if (src_channels != 3U && src_channels != 4U)
+        {
+            return 0;
+        }
 
-                    free (row_state);
-                    return 1;
-                }
+    png_init_tables ();
+    png_get_tuning (&tuning);
 
-            {
-                size_t decoded_size = row_bytes * (size_t)height;
-                uint8_t *scan = (uint8_t *)malloc (decoded_size + 16U);
-
-                if (!scan)
-                    {
-                        return 0;
-                    }
-
-                for (y = 0; y < (size_t)height; y++)
-                    {
-                        const uint8_t *row_src = raw + y * (row_bytes + 1U);
-                        const uint8_t *prev
-                            = (y == 0) ? NULL : (scan + (y - 1U) * row_bytes);
-                        uint8_t *row_dst = scan + y * row_bytes;
-                        if (!unfilter_row (
-                                row_dst, row_src, prev, row_bytes, 3U
-                            ))
-                            {
-                                free (scan);
-                                return 0;
-                            }
-                    }
-
-                convert_rgb_to_rgba_mt (
-                    rgba, scan, width, height, has_trns, tr, tg, tb
-                );
-                free (scan);
-            }
-            return 1;
-        }
+    layout.kernels = pixel_kernels ();
+    layout.row_bytes = (size_t)width * src_channels;
+    layout.bpp = src_channels;
+    layout.width = width;
+    layout.has_trns = (src_channels == 3U) ? has_trns : 0;
+    layout.tr = tr;
+    layout.tg = tg;
+    layout.tb = tb;
+    layout.row_alpha = row_alpha;
+    layout.cancel = cancel;
+    layout.strip_rows = png_cancel_strip_rows ((size_t)width * 4U);
 
-    return 0;
+    return unfilter_rows (
+        &tuning, &layout, rgba, (size_t)width * 4U, raw, (size_t)height
+    );
 }
@@ -0,0 +1,681 @@
+/* _POSIX_C_SOURCE exposes pread / ftruncate / mmap under -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "pixel_kernels.h"
+#include "png_decoder.h"
+#include "png_decoder_internal.h"
+
+/* ------------------------------------------------------------------ */
+/* Memory budget                                                       */
+/* ------------------------------------------------------------------ */
+
+/*
+ * The budget covers everything the decoder keeps resident: the read
+ * window, one filtered row, the two RGBA rows unfiltering needs, the
+ * touched part of the output mapping and zlib's own state (32 KiB
+ * window plus the inflate struct).  What is left after the fixed parts
+ * is split between the read window and the output mapping.
+ */
+#define LOWMEM_ZLIB_RESERVE (64U * 1024U)
+#define LOWMEM_HEADER_WINDOW 4096U
+#define LOWMEM_MIN_READ_WINDOW (16U * 1024U)
+#define LOWMEM_MAX_READ_WINDOW (1U << 20)
+
+/* png_decode_stream: rows handed over per callback and read window. */
+#define STREAM_BATCH_BYTES (256U * 1024U)
+#define STREAM_READ_WINDOW (256U * 1024U)
+
+/* ------------------------------------------------------------------ */
+/* pread window reader                                                 */
+/* ------------------------------------------------------------------ */
+
+typedef struct
+{
+    int fd;
+    uint8_t *buf;
+    size_t cap;
+    size_t len;     /* valid bytes in buf */
+    size_t off;     /* bytes of buf already consumed */
+    off_t file_pos; /* file offset of buf[len] */
+} window_reader_t;
+
+/* Tops the window up; returns 0 on EOF with nothing buffered or on a
+   read error. */
+static int
+reader_fill (window_reader_t *r)
+{
+    ssize_t got;
+
+    if (r->off > 0)
+        {
+            memmove (r->buf, r->buf + r->off, r->len - r->off);
+            r->len -= r->off;
+            r->off = 0;
+        }
+    do
+        {
+            got = pread (r->fd, r->buf + r->len, r->cap - r->len, r->file_pos);
+        }
+    while (got < 0 && errno == EINTR);
+    if (got < 0)
+        return 0;
+    r->len += (size_t)got;
+    r->file_pos += (off_t)got;
+    return r->len > 0;
+}
+
+/* Up to `want` contiguous buffered bytes at *p; 0 at EOF or on error. */
+static size_t
+reader_peek (window_reader_t *r, size_t want, const uint8_t **p)
+{
+    size_t avail;
+
+    if (r->off == r->len && !reader_fill (r))
+        return 0;
+    avail = r->len - r->off;
+    *p = r->buf + r->off;
+    return avail < want ? avail : want;
+}
+
+static int
+reader_read (window_reader_t *r, uint8_t *dst, size_t n)
+{
+    while (n > 0)
+        {
+            const uint8_t *p;
+            size_t got = reader_peek (r, n, &p);
+
+            if (got == 0)
+                return 0;
+            memcpy (dst, p, got);
+            r->off += got;
+            dst += got;
+            n -= got;
+        }
+    return 1;
+}
+
+/* Skips without reading what is not already buffered. */
+static void
+reader_skip (window_reader_t *r, size_t n)
+{
+    size_t buffered = r->len - r->off;
+
+    if (n <= buffered)
+        {
+            r->off += n;
+            return;
+        }
+    r->file_pos += (off_t)(n - buffered);
+    r->off = r->len = 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Row-at-a-time inflate + unfilter                                    */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Rows are unfiltered into a ring of `ring_rows` RGBA rows and handed to
+ * the sink whenever the ring fills, so each batch is contiguous and
+ * starts at ring slot 0.  The row above the first of a batch is the
+ * ring's last slot, which the new batch has not reached yet.
+ */
+typedef struct
+{
+    png_inflate_stream_t *z;
+    uint8_t *filtered; /* one scanline including its filter byte */
+    size_t stride;
+    size_t fill;
+    uint8_t *ring;
+    size_t ring_rows;
+    size_t out_row;
+    uint32_t batch_y0;
+    uint32_t width;
+    uint32_t height;
+    uint32_t y;
+    size_t src_channels;
+    png_trns_t trns;
+    int maybe_alpha;
+    unsigned int alpha_flags;
+    uint8_t carry[2]; /* zlib header split across IDAT chunks */
+    size_t carry_len;
+    int finished;
+    image_t info;
+    png_rows_fn sink;
+    void *sink_ctx;
+} row_stream_t;
+
+static int
+row_stream_flush (row_stream_t *s)
+{
+    uint32_t count = s->y - s->batch_y0;
+
+    if (count == 0)
+        return 1;
+    s->info.has_alpha
+        = s->maybe_alpha && (s->alpha_flags & PIXEL_ALPHA_NOT_OPAQUE) != 0;
+    if (!s->sink (s->sink_ctx, &s->info, s->ring, s->batch_y0, count))
+        return 0;
+    s->batch_y0 = s->y;
+    return 1;
+}
+
+static int
+row_stream_emit (row_stream_t *s)
+{
+    uint8_t *cur = s->ring + (s->y % s->ring_rows) * s->out_row;
+    const uint8_t *prev = NULL;
+    int ok;
+
+    if (s->y > 0)
+        prev = s->ring + ((s->y - 1U) % s->ring_rows) * s->out_row;
+    if (s->src_channels == 4U)
+        {
+            ok = png_unfilter_row (cur, s->filtered, prev, s->out_row, 4U);
+        }
+    else
+        {
+            ok = png_unfilter_row_rgb_to_rgba (
+                cur,
+                s->filtered,
+                prev,
+                s->width,
+                s->trns.present,
+                s->trns.r,
+                s->trns.g,
+                s->trns.b
+            );
+        }
+    if (!ok)
+        return 0;
+    if (s->maybe_alpha)
+        s->alpha_flags |= pixel_kernels ()->alpha_scan (cur, s->width);
+    s->y++;
+    if (s->y - s->batch_y0 == s->ring_rows || s->y == s->height)
+        return row_stream_flush (s);
+    return 1;
+}
+
+/* Feeds one piece of the zlib stream; returns 0 on corrupt data. */
+static int
+row_stream_feed (row_stream_t *s, const uint8_t *in, size_t in_left)
+{
+    if (s->carry_len == 1U && in_left > 0)
+        {
+            const uint8_t *cp = s->carry;
+            size_t cl = 2U;
+            uint8_t *out = NULL;
+            size_t out_left = 0;
+
+            s->carry[1] = in[0];
+            in++;
+            in_left--;
+            s->carry_len = 0;
+            if (png_inflate_stream_step (s->z, &cp, &cl, &out, &out_left)
+                == PNG_INFLATE_ERROR)
+                return 0;
+        }
+
+    while (!s->finished && (in_left > 0 || s->y == s->height))
+        {
+            png_inflate_status_t st;
+            uint8_t scratch;
+            uint8_t *out;
+            size_t out_left;
+
+            if (s->y == s->height)
+                {
+                    /* All rows are out: the stream must end here.  zlib
+                       may still hold the last bytes in its bit buffer,
+                       so this also runs once the input is used up. */
+                    out = &scratch;
+                    out_left = 1U;
+                    st = png_inflate_stream_step (
+                        s->z, &in, &in_left, &out, &out_left
+                    );
+                    if (st == PNG_INFLATE_ERROR || out_left == 0)
+                        return 0;
+                    s->finished = st == PNG_INFLATE_DONE;
+                    if (!s->finished && in_left == 0)
+                        break;
+                    continue;
+                }
+
+            out = s->filtered + s->fill;
+            out_left = s->stride - s->fill;
+            st = png_inflate_stream_step (
+                s->z, &in, &in_left, &out, &out_left
+            );
+            s->fill = s->stride - out_left;
+            if (st == PNG_INFLATE_ERROR)
+                return 0;
+            if (s->fill == s->stride)
+                {
+                    s->fill = 0;
+                    if (!row_stream_emit (s))
+                        return 0;
+                    if (st == PNG_INFLATE_DONE)
+                        s->finished = s->y == s->height;
+                    if (st == PNG_INFLATE_DONE && !s->finished)
+                        return 0;
+                    continue;
+                }
+            if (st == PNG_INFLATE_DONE)
+                return 0;
+            if (st == PNG_INFLATE_NEED_INPUT && in_left == 1U)
+                {
+                    /* Only the two-byte zlib header stops short. */
+                    s->carry[0] = in[0];
+                    s->carry_len = 1U;
+                    in_left = 0;
+                }
+        }
+    return 1;
+}
+
+/* ------------------------------------------------------------------ */
+/* Output through a sliding file mapping                               */
+/* ------------------------------------------------------------------ */
+
+typedef struct
+{
+    int fd;
+    size_t row_bytes;
+    uint32_t height;
+    uint32_t window_rows;
+    size_t page;
+    uint8_t *map;
+    size_t map_len;
+    off_t map_off;
+    uint32_t y_end; /* first row past the mapped window */
+} out_map_t;
+
+static void
+out_map_release (out_map_t *m)
+{
+    if (m->map)
+        munmap (m->map, m->map_len);
+    m->map = NULL;
+}
+
+static int
+out_map_row (out_map_t *m, const uint8_t *rgba, uint32_t y)
+{
+    size_t row_off = (size_t)y * m->row_bytes;
+
+    if (!m->map || y >= m->y_end)
+        {
+            size_t end;
+            void *p;
+
+            /* Dropping the old window returns its pages to the page
+               cache, so they stop counting towards our RSS. */
+            out_map_release (m);
+            m->y_end = y + m->window_rows;
+            if (m->y_end > m->height || m->y_end < y)
+                m->y_end = m->height;
+            end = (size_t)m->y_end * m->row_bytes;
+            m->map_off = (off_t)(row_off - row_off % m->page);
+            m->map_len = end - (size_t)m->map_off;
+            p = mmap (
+                NULL, m->map_len, PROT_WRITE, MAP_SHARED, m->fd, m->map_off
+            );
+            if (p == MAP_FAILED)
+                return 0;
+            m->map = (uint8_t *)p;
+        }
+    memcpy (m->map + (row_off - (size_t)m->map_off), rgba, m->row_bytes);
+    return 1;
+}
+
+static int
+out_map_sink (
+    void *ctx,
+    const image_t *info,
+    const uint8_t *rgba,
+    uint32_t y,
+    uint32_t count
+)
+{
+    out_map_t *m = (out_map_t *)ctx;
+    uint32_t i;
+
+    (void)info;
+    for (i = 0; i < count; i++)
+        {
+            if (!out_map_row (m, rgba + (size_t)i * m->row_bytes, y + i))
+                return 0;
+        }
+    return 1;
+}
+
+/* ------------------------------------------------------------------ */
+/* Setup on the first IDAT                                             */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Splits the low-memory budget: two ring rows, the read window and the
+ * output mapping.  Returns 0, having printed why, if the fixed parts
+ * alone do not fit or the output file cannot be sized.
+ */
+static int
+lowmem_plan (
+    row_stream_t *s,
+    out_map_t *om,
+    size_t budget,
+    const char *path,
+    size_t *read_window
+)
+{
+    size_t fixed;
+    size_t rest;
+    size_t out_window;
+    size_t page;
+    long sc_page;
+
+    if ((size_t)s->height > SIZE_MAX / s->out_row
+        || (size_t)s->height * s->out_row > (size_t)INT64_MAX)
+        return 0;
+
+    sc_page = sysconf (_SC_PAGESIZE);
+    page = sc_page > 0 ? (size_t)sc_page : 4096U;
+
+    fixed = 2U * s->out_row + s->stride + LOWMEM_ZLIB_RESERVE + page;
+    if (fixed + LOWMEM_MIN_READ_WINDOW + s->out_row + page > budget)
+        {
+            fprintf (
+                stderr,
+                "png rows too wide for a %zu byte budget: '%s'\n",
+                budget,
+                path
+            );
+            return 0;
+        }
+    rest = budget - fixed;
+    *read_window = rest / 4U;
+    if (*read_window < LOWMEM_MIN_READ_WINDOW)
+        *read_window = LOWMEM_MIN_READ_WINDOW;
+    if (*read_window > LOWMEM_MAX_READ_WINDOW)
+        *read_window = LOWMEM_MAX_READ_WINDOW;
+    if (*read_window > rest - s->out_row - page)
+        *read_window = rest - s->out_row - page;
+    /* One page of slack: the window starts on a page boundary. */
+    out_window = rest - *read_window - page;
+
+    if (ftruncate (om->fd, (off_t)((size_t)s->height * s->out_row)) != 0)
+        {
+            fprintf (
+                stderr,
+                "failed to size output for '%s': %s\n",
+                path,
+                strerror (errno)
+            );
+            return 0;
+        }
+    om->row_bytes = s->out_row;
+    om->height = s->height;
+    om->page = page;
+    om->window_rows = (uint32_t)(out_window / s->out_row < s->height
+                                     ? out_window / s->out_row
+                                     : s->height);
+
+    s->ring_rows = 2U;
+    s->sink = out_map_sink;
+    s->sink_ctx = om;
+    return 1;
+}
+
+/* Allocates the row buffers and grows the read window. */
+static int
+stream_alloc (row_stream_t *s, window_reader_t *rd, size_t read_window)
+{
+    uint8_t *grown;
+
+    s->z = png_inflate_stream_new ();
+    s->filtered = (uint8_t *)malloc (s->stride);
+    s->ring = (uint8_t *)malloc (s->ring_rows * s->out_row);
+    if (!s->z || !s->filtered || !s->ring)
+        return 0;
+
+    if (read_window > rd->cap)
+        {
+            /* Compact first so nothing buffered is lost. */
+            memmove (rd->buf, rd->buf + rd->off, rd->len - rd->off);
+            rd->len -= rd->off;
+            rd->off = 0;
+            grown = (uint8_t *)realloc (rd->buf, read_window);
+            if (!grown)
+                return 0;
+            rd->buf = grown;
+            rd->cap = read_window;
+        }
+    return 1;
+}
+
+/* ------------------------------------------------------------------ */
+/* Chunk walk                                                          */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Shared by both entry points.  With `om` set the rows go to the output
+ * mapping under `budget`; otherwise to `on_rows` in STREAM_BATCH_BYTES
+ * batches.
+ */
+static int
+stream_decode (
+    const char *path,
+    out_map_t *om,
+    size_t budget,
+    png_rows_fn on_rows,
+    void *ctx,
+    image_t *img
+)
+{
+    window_reader_t rd;
+    row_stream_t s;
+    png_ihdr_t ihdr = { 0 };
+    uint8_t sig[8];
+    int seen_ihdr = 0;
+    int seen_iend = 0;
+    int started = 0;
+    int ok = 0;
+
+    img->width = 0;
+    img->height = 0;
+    img->rgba = NULL;
+    img->has_alpha = 0;
+    img->row_alpha = NULL;
+
+    memset (&rd, 0, sizeof (rd));
+    memset (&s, 0, sizeof (s));
+
+    if (!png_inflate_stream_available ())
+        {
+            fprintf (
+                stderr, "streaming decode needs zlib (libz.so.1): '%s'\n", path
+            );
+            return 0;
+        }
+
+    rd.fd = open (path, O_RDONLY);
+    if (rd.fd < 0)
+        {
+            fprintf (
+                stderr, "failed to open '%s': %s\n", path, strerror (errno)
+            );
+            return 0;
+        }
+    rd.cap = LOWMEM_HEADER_WINDOW;
+    rd.buf = (uint8_t *)malloc (rd.cap);
+    if (!rd.buf)
+        goto done;
+
+    if (!reader_read (&rd, sig, sizeof (sig))
+        || !png_is_signature (sig, sizeof (sig)))
+        {
+            fprintf (stderr, "not a png: '%s'\n", path);
+            goto done;
+        }
+
+    /* ---- chunk loop ---------------------------------------------- */
+
+    while (!seen_iend)
+        {
+            uint8_t hdr[8];
+            uint8_t small[256];
+            uint32_t length;
+            uint32_t chunk_type;
+
+            if (!reader_read (&rd, hdr, sizeof (hdr)))
+                goto corrupt;
+            length = png_read_be32 (hdr);
+            chunk_type = png_read_be32 (hdr + 4U);
+
+            switch (chunk_type)
+                {
+                case PNG_CHUNK_IHDR:
+                    if (seen_ihdr || length != 13U
+                        || !reader_read (&rd, small, 13U)
+                        || !png_parse_ihdr (small, length, &ihdr))
+                        goto corrupt;
+                    if (!png_validate_ihdr (&ihdr, path))
+                        goto done;
+                    seen_ihdr = 1;
+                    break;
+
+                case PNG_CHUNK_tRNS:
+                    if (length > sizeof (small))
+                        {
+                            reader_skip (&rd, length);
+                            break;
+                        }
+                    if (!reader_read (&rd, small, length))
+                        goto corrupt;
+                    if (seen_ihdr && !started && ihdr.color_type == 2)
+                        png_parse_trns_rgb (small, length, &s.trns);
+                    break;
+
+                case PNG_CHUNK_IDAT:
+                    if (!seen_ihdr)
+                        goto corrupt;
+                    if (!started)
+                        {
+                            size_t read_window = STREAM_READ_WINDOW;
+
+                            s.src_channels = ihdr.color_type == 6 ? 4U : 3U;
+                            s.width = ihdr.width;
+                            s.height = ihdr.height;
+                            s.maybe_alpha
+                                = ihdr.color_type == 6 || s.trns.present;
+                            s.stride = (size_t)s.width * s.src_channels + 1U;
+                            s.out_row = (size_t)s.width * 4U;
+                            s.info.width = (int)ihdr.width;
+                            s.info.height = (int)ihdr.height;
+                            if (om)
+                                {
+                                    if (!lowmem_plan (
+                                            &s, om, budget, path, &read_window
+                                        ))
+                                        goto done;
+                                }
+                            else
+                                {
+                                    s.ring_rows
+                                        = STREAM_BATCH_BYTES / s.out_row;
+                                    if (s.ring_rows < 2U)
+                                        s.ring_rows = 2U;
+                                    if (s.ring_rows > s.height)
+                                        s.ring_rows = s.height;
+                                    s.sink = on_rows;
+                                    s.sink_ctx = ctx;
+                                }
+                            if (!stream_alloc (&s, &rd, read_window))
+                                goto done;
+                            started = 1;
+                        }
+                    while (length > 0)
+                        {
+                            const uint8_t *p;
+                            size_t got = reader_peek (&rd, length, &p);
+
+                            if (got == 0)
+                                goto corrupt;
+                            if (!row_stream_feed (&s, p, got))
+                                goto corrupt;
+                            rd.off += got;
+                            length -= (uint32_t)got;
+                        }
+                    break;
+
+                case PNG_CHUNK_IEND:
+                    seen_iend = 1;
+                    reader_skip (&rd, length);
+                    break;
+
+                default:
+                    reader_skip (&rd, length); /* ancillary chunk */
+                    break;
+                }
+            reader_skip (&rd, 4U); /* CRC */
+        }
+
+    if (!started || s.y != s.height || !s.finished)
+        goto corrupt;
+
+    img->width = (int)ihdr.width;
+    img->height = (int)ihdr.height;
+    img->has_alpha
+        = s.maybe_alpha && (s.alpha_flags & PIXEL_ALPHA_NOT_OPAQUE) != 0;
+    ok = 1;
+    goto done;
+
+corrupt:
+    fprintf (stderr, "png decode failed: '%s'\n", path);
+
+done:
+    if (s.z)
+        png_inflate_stream_free (s.z);
+    free (s.filtered);
+    free (s.ring);
+    free (rd.buf);
+    close (rd.fd);
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
+
+int
+png_decode_file_to_fd (
+    const char *path, int out_fd, size_t budget, image_t *img
+)
+{
+    out_map_t om;
+    int ok;
+
+    memset (&om, 0, sizeof (om));
+    om.fd = out_fd;
+    if (budget == 0)
+        budget = PNG_LOWMEM_DEFAULT_BUDGET;
+    ok = stream_decode (path, &om, budget, NULL, NULL, img);
+    out_map_release (&om);
+    return ok;
+}
+
+int
+png_decode_stream (
+    const char *path, png_rows_fn on_rows, void *ctx, image_t *img
+)
+{
+    return stream_decode (path, NULL, 0, on_rows, ctx, img);
+}
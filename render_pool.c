@@ -0,0 +1,235 @@
+/* _DEFAULT_SOURCE exposes sysconf (_SC_NPROCESSORS_ONLN) under -std=c99 */
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "render_pool.h"
+
+/* Bands per thread, so a thread that finishes early can take another. */
+#define RENDER_POOL_BANDS_PER_THREAD 4
+
+typedef struct
+{
+    pthread_t threads[RENDER_POOL_MAX_THREADS];
+    int started;
+    int thread_count; /* including the caller */
+    int stop;
+
+    /* Current run; written under g_lock before `generation` moves. */
+    unsigned int generation;
+    render_band_fn fn;
+    void *ctx;
+    int height;
+    int band_count;
+    int next_band; /* claimed with atomic adds */
+    int busy;      /* workers inside the current run */
+} render_pool_t;
+
+static render_pool_t g_pool;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_work_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_done_cv = PTHREAD_COND_INITIALIZER;
+
+/* ------------------------------------------------------------------ */
+/* Workers                                                             */
+/* ------------------------------------------------------------------ */
+
+static void
+run_bands (int worker)
+{
+    for (;;)
+        {
+            int band = __atomic_fetch_add (
+                &g_pool.next_band, 1, __ATOMIC_RELAXED
+            );
+            int y0;
+            int y1;
+
+            if (band >= g_pool.band_count)
+                {
+                    return;
+                }
+            y0 = (int)((long long)g_pool.height * band / g_pool.band_count);
+            y1 = (int)((long long)g_pool.height * (band + 1)
+                       / g_pool.band_count);
+            g_pool.fn (g_pool.ctx, worker, y0, y1);
+        }
+}
+
+static void *
+pool_worker (void *arg)
+{
+    int worker = (int)(intptr_t)arg;
+    unsigned int seen;
+
+    pthread_mutex_lock (&g_lock);
+    seen = g_pool.generation;
+    for (;;)
+        {
+            while (!g_pool.stop && g_pool.generation == seen)
+                {
+                    pthread_cond_wait (&g_work_cv, &g_lock);
+                }
+            if (g_pool.stop)
+                {
+                    break;
+                }
+            seen = g_pool.generation;
+            g_pool.busy++;
+            pthread_mutex_unlock (&g_lock);
+
+            run_bands (worker);
+
+            pthread_mutex_lock (&g_lock);
+            if (--g_pool.busy == 0)
+                {
+                    pthread_cond_signal (&g_done_cv);
+                }
+        }
+    pthread_mutex_unlock (&g_lock);
+    return NULL;
+}
+
+static int
+wanted_threads (void)
+{
+    const char *env = getenv ("SLICER_THREADS");
+    long n = 0;
+
+    if (env)
+        {
+            n = strtol (env, NULL, 10);
+        }
+    if (n <= 0)
+        {
+            n = sysconf (_SC_NPROCESSORS_ONLN);
+        }
+    if (n < 1)
+        {
+            n = 1;
+        }
+    if (n > RENDER_POOL_MAX_THREADS)
+        {
+            n = RENDER_POOL_MAX_THREADS;
+        }
+    return (int)n;
+}
+
+/* Called with g_lock held. */
+static void
+pool_start (void)
+{
+    int want = wanted_threads ();
+    int i;
+
+    g_pool.started = 1;
+    g_pool.stop = 0;
+    g_pool.thread_count = 1;
+    for (i = 1; i < want; i++)
+        {
+            if (pthread_create (
+                    &g_pool.threads[i], NULL, pool_worker, (void *)(intptr_t)i
+                )
+                != 0)
+                {
+                    break;
+                }
+            g_pool.thread_count++;
+        }
+}
+
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
+
+int
+render_pool_threads (void)
+{
+    int count;
+
+    pthread_mutex_lock (&g_lock);
+    if (!g_pool.started)
+        {
+            pool_start ();
+        }
+    count = g_pool.thread_count;
+    pthread_mutex_unlock (&g_lock);
+    return count;
+}
+
+void
+render_pool_run (int height, render_band_fn fn, void *ctx)
+{
+    int bands;
+
+    if (height <= 0)
+        {
+            return;
+        }
+    bands = render_pool_threads () * RENDER_POOL_BANDS_PER_THREAD;
+    if (bands > height / RENDER_POOL_MIN_BAND_ROWS)
+        {
+            bands = height / RENDER_POOL_MIN_BAND_ROWS;
+        }
+    if (bands <= 1 || g_pool.thread_count == 1)
+        {
+            fn (ctx, 0, 0, height);
+            return;
+        }
+
+    pthread_mutex_lock (&g_lock);
+    /* A worker woken late for the previous run may still be leaving. */
+    while (g_pool.busy > 0)
+        {
+            pthread_cond_wait (&g_done_cv, &g_lock);
+        }
+    g_pool.fn = fn;
+    g_pool.ctx = ctx;
+    g_pool.height = height;
+    g_pool.band_count = bands;
+    g_pool.next_band = 0;
+    g_pool.generation++;
+    pthread_cond_broadcast (&g_work_cv);
+    pthread_mutex_unlock (&g_lock);
+
+    run_bands (0);
+
+    /* Every band is claimed; wait for the ones still being drawn. */
+    pthread_mutex_lock (&g_lock);
+    while (g_pool.busy > 0)
+        {
+            pthread_cond_wait (&g_done_cv, &g_lock);
+        }
+    pthread_mutex_unlock (&g_lock);
+}
+
+void
+render_pool_shutdown (void)
+{
+    int i;
+    int count;
+
+    pthread_mutex_lock (&g_lock);
+    if (!g_pool.started)
+        {
+            pthread_mutex_unlock (&g_lock);
+            return;
+        }
+    g_pool.stop = 1;
+    count = g_pool.thread_count;
+    pthread_cond_broadcast (&g_work_cv);
+    pthread_mutex_unlock (&g_lock);
+
+    for (i = 1; i < count; i++)
+        {
+            pthread_join (g_pool.threads[i], NULL);
+        }
+
+    pthread_mutex_lock (&g_lock);
+    g_pool.started = 0;
+    g_pool.thread_count = 0;
+    pthread_mutex_unlock (&g_lock);
+}
@@ -0,0 +1,35 @@
+#ifndef RENDER_POOL_H
+#define RENDER_POOL_H
+
+/*
+ * Persistent worker pool for drawing a frame in horizontal bands.
+ *
+ * render_pool_run splits rows [0, height) into contiguous bands and
+ * hands them out to the workers and the calling thread, returning once
+ * every band has been drawn.  There are a few bands per thread so that
+ * uneven rows balance out, but none thinner than
+ * RENDER_POOL_MIN_BAND_ROWS, so short frames use fewer threads.  The
+ * thread count follows the online cores; SLICER_THREADS=n overrides it.
+ * Workers start on first use and stay parked between frames until
+ * render_pool_shutdown.  Runs must not overlap or nest.
+ */
+
+#define RENDER_POOL_MAX_THREADS 32
+#define RENDER_POOL_MIN_BAND_ROWS 32
+
+/*
+ * Draws rows [y0, y1).  `worker` is in [0, render_pool_threads ()) and
+ * no two bands with the same index run at once, so it can pick
+ * per-thread scratch.
+ */
+typedef void (*render_band_fn) (void *ctx, int worker, int y0, int y1);
+
+/* Threads that may run bands, the caller included; starts the pool. */
+int render_pool_threads (void);
+
+void render_pool_run (int height, render_band_fn fn, void *ctx);
+
+/* Joins the workers; the next run starts them again. */
+void render_pool_shutdown (void);
+
+#endif
@@ -1,83 +1,256 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <xcb/xcb.h>
 
+#include "image_mips.h"
+#include "pixel_kernels.h"
+#include "render_pool.h"
 #include "renderer.h"
 
-static uint32_t
-pack_pixel (const pixel_format_t *format, uint8_t r, uint8_t g, uint8_t b)
+/* ------------------------------------------------------------------ */
+/* Row packers                                                         */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Rows are drawn as RGBA spans and converted to the visual's native
+ * pixels one span at a time.  The common LSB-first TrueColor layouts go
+ * through the dispatched SIMD blitters in pixel_kernels.h; anything else
+ * packs through per-channel lookup tables holding each value already
+ * scaled, shifted and masked, so a pixel costs three loads and two ORs.
+ */
+typedef enum
+{
+    PACK_GENERIC = 0,
+    PACK_XRGB8888,
+    PACK_RGB888,
+    PACK_RGB565
+} pack_layout_t;
+
+typedef struct
+{
+    int valid;
+    pixel_format_t format;
+    pack_layout_t layout;
+    uint32_t lut[3][256];
+} row_packer_t;
+
+static row_packer_t g_packer;
+
+static int
+format_is_lsb_truecolor (
+    const pixel_format_t *format,
+    int bytes_per_pixel,
+    uint32_t red_mask,
+    uint32_t green_mask,
+    uint32_t blue_mask
+)
+{
+    return format->bytes_per_pixel == bytes_per_pixel
+           && format->image_byte_order == XCB_IMAGE_ORDER_LSB_FIRST
+           && format->red_mask == red_mask
+           && format->green_mask == green_mask
+           && format->blue_mask == blue_mask;
+}
+
+static int
+format_equal (const pixel_format_t *a, const pixel_format_t *b)
 {
-    uint32_t rp
-        = ((uint32_t)((r * format->red_max + 127) / 255) << format->red_shift)
-          & format->red_mask;
-    uint32_t gp = ((uint32_t)((g * format->green_max + 127) / 255)
-                   << format->green_shift)
-                  & format->green_mask;
-    uint32_t bp = ((uint32_t)((b * format->blue_max + 127) / 255)
-                   << format->blue_shift)
-                  & format->blue_mask;
-    return rp | gp | bp;
+    return a->bytes_per_pixel == b->bytes_per_pixel
+           && a->image_byte_order == b->image_byte_order
+           && a->red_mask == b->red_mask && a->green_mask == b->green_mask
+           && a->blue_mask == b->blue_mask && a->red_shift == b->red_shift
+           && a->green_shift == b->green_shift
+           && a->blue_shift == b->blue_shift && a->red_max == b->red_max
+           && a->green_max == b->green_max && a->blue_max == b->blue_max;
 }
 
 static void
-store_pixel (const pixel_format_t *format, uint8_t *dst, uint32_t pixel)
+build_channel_lut (uint32_t *lut, int max, int shift, uint32_t mask)
 {
-    if (format->bytes_per_pixel == 4)
+    int v;
+
+    for (v = 0; v < 256; v++)
         {
-            if (format->image_byte_order == XCB_IMAGE_ORDER_MSB_FIRST)
-                {
-                    dst[0] = (uint8_t)((pixel >> 24) & 0xFFU);
-                    dst[1] = (uint8_t)((pixel >> 16) & 0xFFU);
-                    dst[2] = (uint8_t)((pixel >> 8) & 0xFFU);
-                    dst[3] = (uint8_t)(pixel & 0xFFU);
-                }
-            else
-                {
-                    dst[0] = (uint8_t)(pixel & 0xFFU);
-                    dst[1] = (uint8_t)((pixel >> 8) & 0xFFU);
-                    dst[2] = (uint8_t)((pixel >> 16) & 0xFFU);
-                    dst[3] = (uint8_t)((pixel >> 24) & 0xFFU);
-                }
-            return;
+            lut[v] = ((uint32_t)((v * max + 127) / 255) << shift) & mask;
         }
+}
+
+void
+renderer_set_format (const pixel_format_t *format)
+{
+    row_packer_t *p = &g_packer;
 
-    if (format->bytes_per_pixel == 3)
+    p->format = *format;
+    p->layout = PACK_GENERIC;
+    if (format_is_lsb_truecolor (
+            format, 4, 0x00FF0000U, 0x0000FF00U, 0x000000FFU
+        ))
         {
-            if (format->image_byte_order == XCB_IMAGE_ORDER_MSB_FIRST)
+            p->layout = PACK_XRGB8888;
+        }
+    else if (format_is_lsb_truecolor (
+                 format, 3, 0x00FF0000U, 0x0000FF00U, 0x000000FFU
+             ))
+        {
+            p->layout = PACK_RGB888;
+        }
+    else if (format_is_lsb_truecolor (format, 2, 0xF800U, 0x07E0U, 0x001FU))
+        {
+            p->layout = PACK_RGB565;
+        }
+
+    build_channel_lut (
+        p->lut[0], format->red_max, format->red_shift, format->red_mask
+    );
+    build_channel_lut (
+        p->lut[1], format->green_max, format->green_shift, format->green_mask
+    );
+    build_channel_lut (
+        p->lut[2], format->blue_max, format->blue_shift, format->blue_mask
+    );
+    p->valid = 1;
+}
+
+static const row_packer_t *
+packer_for (const pixel_format_t *format)
+{
+    if (!g_packer.valid || !format_equal (&g_packer.format, format))
+        {
+            renderer_set_format (format);
+        }
+    return &g_packer;
+}
+
+/* The blit kernel for the packer's layout, or NULL for the LUT path.
+   Looked up per frame so a benchmark's ISA switch takes effect. */
+static blit_row_fn
+packer_kernel (const row_packer_t *p)
+{
+    const pixel_kernels_t *k = pixel_kernels ();
+
+    switch (p->layout)
+        {
+        case PACK_XRGB8888:
+            return k->blit_xrgb8888;
+        case PACK_RGB888:
+            return k->blit_rgb888;
+        case PACK_RGB565:
+            return k->blit_rgb565;
+        default:
+            return NULL;
+        }
+}
+
+static void
+pack_row_lut (
+    const row_packer_t *p, uint8_t *dst, const uint8_t *rgba, size_t width
+)
+{
+    const uint32_t *lr = p->lut[0];
+    const uint32_t *lg = p->lut[1];
+    const uint32_t *lb = p->lut[2];
+    int msb = p->format.image_byte_order == XCB_IMAGE_ORDER_MSB_FIRST;
+    size_t x;
+
+    switch (p->format.bytes_per_pixel)
+        {
+        case 4:
+            for (x = 0; x < width; x++, dst += 4, rgba += 4)
                 {
-                    dst[0] = (uint8_t)((pixel >> 16) & 0xFFU);
-                    dst[1] = (uint8_t)((pixel >> 8) & 0xFFU);
-                    dst[2] = (uint8_t)(pixel & 0xFFU);
+                    uint32_t px = lr[rgba[0]] | lg[rgba[1]] | lb[rgba[2]];
+
+                    if (msb)
+                        {
+                            px = ((px >> 24) & 0xFFU) | ((px >> 8) & 0xFF00U)
+                                 | ((px << 8) & 0xFF0000U) | (px << 24);
+                        }
+                    memcpy (dst, &px, 4);
                 }
-            else
+            break;
+        case 3:
+            for (x = 0; x < width; x++, dst += 3, rgba += 4)
                 {
-                    dst[0] = (uint8_t)(pixel & 0xFFU);
-                    dst[1] = (uint8_t)((pixel >> 8) & 0xFFU);
-                    dst[2] = (uint8_t)((pixel >> 16) & 0xFFU);
-                }
-            return;
-        }
+                    uint32_t px = lr[rgba[0]] | lg[rgba[1]] | lb[rgba[2]];
 
-    if (format->bytes_per_pixel == 2)
-        {
-            if (format->image_byte_order == XCB_IMAGE_ORDER_MSB_FIRST)
+                    dst[msb ? 2 : 0] = (uint8_t)(px & 0xFFU);
+                    dst[1] = (uint8_t)((px >> 8) & 0xFFU);
+                    dst[msb ? 0 : 2] = (uint8_t)((px >> 16) & 0xFFU);
+                }
+            break;
+        case 2:
+            for (x = 0; x < width; x++, dst += 2, rgba += 4)
                 {
-                    dst[0] = (uint8_t)((pixel >> 8) & 0xFFU);
-                    dst[1] = (uint8_t)(pixel & 0xFFU);
+                    uint32_t px = lr[rgba[0]] | lg[rgba[1]] | lb[rgba[2]];
+
+                    dst[msb ? 1 : 0] = (uint8_t)(px & 0xFFU);
+                    dst[msb ? 0 : 1] = (uint8_t)((px >> 8) & 0xFFU);
                 }
-            else
+            break;
+        default:
+            for (x = 0; x < width; x++, dst++, rgba += 4)
                 {
-                    dst[0] = (uint8_t)(pixel & 0xFFU);
-                    dst[1] = (uint8_t)((pixel >> 8) & 0xFFU);
+                    *dst = (uint8_t)(lr[rgba[0]] | lg[rgba[1]] | lb[rgba[2]]);
                 }
+            break;
+        }
+}
+
+static void
+pack_row (
+    const row_packer_t *p,
+    blit_row_fn kernel,
+    uint8_t *dst,
+    const uint8_t *rgba,
+    size_t width
+)
+{
+    if (kernel)
+        {
+            kernel (dst, rgba, width);
             return;
         }
+    pack_row_lut (p, dst, rgba, width);
+}
 
-    dst[0] = (uint8_t)(pixel & 0xFFU);
+/* ------------------------------------------------------------------ */
+/* Scratch buffers                                                     */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Per-frame working memory, kept between frames and only grown, so
+ * steady-state redraws do not allocate: the source column of every
+ * visible destination column, shared by all bands, and one RGBA row
+ * per render_pool worker for gathered, blended or background spans.
+ */
+static uint32_t *g_col_table;
+static size_t g_col_table_cap;
+static uint8_t *g_row_rgba[RENDER_POOL_MAX_THREADS];
+static size_t g_row_rgba_cap[RENDER_POOL_MAX_THREADS];
+
+static void *
+grow_scratch (void *buf, size_t *cap, size_t need)
+{
+    void *grown;
+
+    if (need <= *cap)
+        {
+            return buf;
+        }
+    grown = realloc (buf, need);
+    if (grown)
+        {
+            *cap = need;
+        }
+    return grown;
 }
 
+/* ------------------------------------------------------------------ */
+/* Background and view geometry                                        */
+/* ------------------------------------------------------------------ */
+
 static void
 sample_checkered (int x, int y, uint8_t *r, uint8_t *g, uint8_t *b)
 {
@@ -106,6 +279,40 @@ sample_background (
     sample_checkered (x, y, r, g, b);
 }
 
+double
+renderer_fit_scale (int img_w, int img_h, int win_w, int win_h)
+{
+    double fit_scale;
+
+    if (img_w <= 0 || img_h <= 0 || win_w <= 0 || win_h <= 0)
+        {
+            return 0.0;
+        }
+    fit_scale = (double)win_w / (double)img_w;
+    if ((double)win_h / (double)img_h < fit_scale)
+        {
+            fit_scale = (double)win_h / (double)img_h;
+        }
+    return fit_scale;
+}
+
+double
+renderer_view_scale (
+    int img_w, int img_h, int win_w, int win_h, const view_params_t *view
+)
+{
+    double zoom = (view && view->zoom > 0.0f) ? (double)view->zoom : 1.0;
+    double scale = renderer_fit_scale (img_w, img_h, win_w, win_h) * zoom;
+
+    /* Snapped zoom steps already land on whole multiples; this keeps
+       them there when a resize changes the fit scale. */
+    if (view && view->integer_zoom && scale >= 1.0)
+        {
+            scale = (double)(long long)(scale + 0.5);
+        }
+    return scale;
+}
+
 static void
 compute_view_rect (
     int img_w,
@@ -119,8 +326,6 @@ compute_view_rect (
     int *out_y
 )
 {
-    double fit_scale;
-    double zoom;
     double scale;
     long long scaled_w;
     long long scaled_h;
@@ -136,13 +341,7 @@ compute_view_rect (
             return;
         }
 
-    fit_scale = (double)win_w / (double)img_w;
-    if ((double)win_h / (double)img_h < fit_scale)
-        {
-            fit_scale = (double)win_h / (double)img_h;
-        }
-    zoom = (view && view->zoom > 0.0f) ? (double)view->zoom : 1.0;
-    scale = fit_scale * zoom;
+    scale = renderer_view_scale (img_w, img_h, win_w, win_h, view);
 
     scaled_w = (long long)((double)img_w * scale + 0.5);
     scaled_h = (long long)((double)img_h * scale + 0.5);
@@ -168,40 +367,373 @@ compute_view_rect (
     *out_y = (win_h - *out_h) / 2 + pan_y;
 }
 
-static void
-fill_background (
-    const pixel_format_t *format,
+void
+renderer_image_rect (
+    int img_w,
+    int img_h,
     int win_w,
     int win_h,
-    uint8_t *dst,
-    const bg_config_t *bg
+    const view_params_t *view,
+    render_rect_t *out
 )
 {
+    compute_view_rect (
+        img_w, img_h, win_w, win_h, view, &out->w, &out->h, &out->x, &out->y
+    );
+}
+
+/*
+ * The background only varies along a row: the checkerboard flips every
+ * 16 rows and a solid fill never does.  So the whole layer is two rows,
+ * kept both as RGBA for compositing and pre-packed in the native format
+ * for memcpy, and rebuilt only when the window width, the visual or the
+ * background settings change.
+ */
+#define BG_CHECKER_SHIFT 4
+
+typedef struct
+{
+    int valid;
+    int width;
+    pixel_format_t format;
+    bg_config_t bg;
+    uint8_t *mem;
+    size_t mem_cap;
+    uint8_t *rgba[2];
+    uint8_t *packed[2];
+} bg_cache_t;
+
+static bg_cache_t g_bg;
+
+static int
+bg_config_equal (const bg_config_t *a, const bg_config_t *b)
+{
+    if (a->mode != b->mode)
+        {
+            return 0;
+        }
+    return a->mode != BG_MODE_SOLID
+           || (a->solid_r == b->solid_r && a->solid_g == b->solid_g
+               && a->solid_b == b->solid_b);
+}
+
+static const bg_cache_t *
+bg_cache_update (
+    const row_packer_t *p, blit_row_fn kernel, int win_w, const bg_config_t *bg
+)
+{
+    bg_cache_t *c = &g_bg;
+    size_t rgba_bytes = (size_t)win_w * 4U;
+    size_t packed_bytes
+        = (size_t)win_w * (size_t)p->format.bytes_per_pixel;
+    uint8_t *mem;
+    int band;
     int x;
-    int y;
-    size_t stride = (size_t)win_w * (size_t)format->bytes_per_pixel;
 
-    for (y = 0; y < win_h; y++)
+    if (c->valid && c->width == win_w && format_equal (&c->format, &p->format)
+        && bg_config_equal (&c->bg, bg))
         {
-            uint8_t *row = dst + (size_t)y * stride;
-            for (x = 0; x < win_w; x++)
+            return c;
+        }
+
+    c->valid = 0;
+    mem = (uint8_t *)grow_scratch (
+        c->mem, &c->mem_cap, 2U * (rgba_bytes + packed_bytes)
+    );
+    if (!mem)
+        {
+            return NULL;
+        }
+    c->mem = mem;
+    c->rgba[0] = mem;
+    c->rgba[1] = mem + rgba_bytes;
+    c->packed[0] = mem + 2U * rgba_bytes;
+    c->packed[1] = c->packed[0] + packed_bytes;
+
+    for (band = 0; band < 2; band++)
+        {
+            uint8_t *px = c->rgba[band];
+
+            for (x = 0; x < win_w; x++, px += 4)
                 {
-                    uint8_t br;
-                    uint8_t bgc;
-                    uint8_t bb;
-                    uint32_t pixel;
-
-                    sample_background (bg, x, y, &br, &bgc, &bb);
-                    pixel = pack_pixel (format, br, bgc, bb);
-                    store_pixel (
-                        format,
-                        row + (size_t)x * (size_t)format->bytes_per_pixel,
-                        pixel
+                    sample_background (
+                        bg, x, band << BG_CHECKER_SHIFT, &px[0], &px[1], &px[2]
                     );
+                    px[3] = 255U;
+                }
+            pack_row (
+                p, kernel, c->packed[band], c->rgba[band], (size_t)win_w
+            );
+        }
+
+    c->width = win_w;
+    c->format = p->format;
+    c->bg = *bg;
+    c->valid = 1;
+    return c;
+}
+
+static int
+bg_band (const bg_cache_t *c, int y)
+{
+    return c->bg.mode == BG_MODE_SOLID ? 0 : (y >> BG_CHECKER_SHIFT) & 1;
+}
+
+/*
+ * Composites `width` RGBA pixels over the matching span of a cached
+ * background row; `out` may alias `rgba`.  Output alpha is 255.
+ */
+static void
+blend_row (
+    uint8_t *out, const uint8_t *rgba, const uint8_t *under, size_t width
+)
+{
+    size_t i;
+
+    for (i = 0; i < width; i++, out += 4, rgba += 4, under += 4)
+        {
+            int a = rgba[3];
+
+            if (a == 255)
+                {
+                    memcpy (out, rgba, 4);
+                    continue;
+                }
+            out[0] = (uint8_t)(((int)rgba[0] * a + (int)under[0] * (255 - a)
+                                + 127)
+                               / 255);
+            out[1] = (uint8_t)(((int)rgba[1] * a + (int)under[1] * (255 - a)
+                                + 127)
+                               / 255);
+            out[2] = (uint8_t)(((int)rgba[2] * a + (int)under[2] * (255 - a)
+                                + 127)
+                               / 255);
+            out[3] = 255U;
+        }
+}
+
+/* ------------------------------------------------------------------ */
+/* Destination -> source index mapping                                 */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Steps floor(i * src / draw) for consecutive i with one add and one
+ * compare per step: the quotient and remainder of src / draw are taken
+ * once, and only the starting product needs 64-bit arithmetic.  Gives
+ * exactly the indices of the per-pixel divide it replaces.
+ */
+typedef struct
+{
+    uint32_t q;
+    uint32_t r;
+    uint32_t step_q;
+    uint32_t step_r;
+    uint32_t den;
+} index_step_t;
+
+static void
+index_step_init (index_step_t *s, int first, int draw, int src)
+{
+    uint64_t num = (uint64_t)first * (uint64_t)src;
+
+    s->den = (uint32_t)draw;
+    s->q = (uint32_t)(num / s->den);
+    s->r = (uint32_t)(num % s->den);
+    s->step_q = (uint32_t)src / s->den;
+    s->step_r = (uint32_t)src % s->den;
+}
+
+static uint32_t
+index_step_next (index_step_t *s)
+{
+    uint32_t v = s->q;
+
+    s->q += s->step_q;
+    s->r += s->step_r;
+    if (s->r >= s->den)
+        {
+            s->r -= s->den;
+            s->q++;
+        }
+    return v;
+}
+
+static const uint32_t *
+build_col_table (int start_x, int end_x, int offset_x, int draw_w, int src_w)
+{
+    size_t n = (size_t)(end_x - start_x);
+    uint32_t *table;
+    index_step_t step;
+    size_t i;
+
+    table = (uint32_t *)grow_scratch (
+        g_col_table, &g_col_table_cap, n * sizeof (*table)
+    );
+    if (!table)
+        {
+            return NULL;
+        }
+    g_col_table = table;
+
+    index_step_init (&step, start_x - offset_x, draw_w, src_w);
+    for (i = 0; i < n; i++)
+        {
+            table[i] = index_step_next (&step);
+        }
+    return table;
+}
+
+/* ------------------------------------------------------------------ */
+/* Whole-factor magnification                                          */
+/* ------------------------------------------------------------------ */
+
+/*
+ * When the view magnifies by a whole factor in both directions, each
+ * source pixel covers a factor x factor block.  Opaque rows are packed
+ * once at source resolution and widened by replicating native pixels,
+ * and output rows that sample the same source row are copied from the
+ * one above rather than rebuilt.
+ */
+static int
+whole_factor (const image_t *img, int draw_w, int draw_h)
+{
+    int factor;
+
+    if (draw_w % img->width != 0 || draw_h % img->height != 0)
+        {
+            return 0;
+        }
+    factor = draw_w / img->width;
+    if (factor < 2 || draw_h / img->height != factor)
+        {
+            return 0;
+        }
+    return factor;
+}
+
+static void
+replicate_generic (
+    uint8_t *dst,
+    const uint8_t *src,
+    size_t count,
+    size_t factor,
+    size_t bpp
+)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++, src += bpp)
+        {
+            for (j = 0; j < factor; j++, dst += bpp)
+                {
+                    memcpy (dst, src, bpp);
                 }
         }
 }
 
+/*
+ * Fills `span` output pixels from `native`, the packed source pixels
+ * they cover; the first one is already `skip` columns into its block.
+ */
+static void
+replicate_span (
+    uint8_t *dst,
+    const uint8_t *native,
+    size_t span,
+    size_t skip,
+    size_t factor,
+    size_t bpp,
+    replicate_fn replicate
+)
+{
+    size_t lead = factor - skip;
+    size_t whole;
+
+    if (lead > span)
+        {
+            lead = span;
+        }
+    replicate_generic (dst, native, 1, lead, bpp);
+    dst += lead * bpp;
+    native += bpp;
+    span -= lead;
+
+    whole = span / factor;
+    if (whole > 0)
+        {
+            if (replicate)
+                {
+                    replicate (dst, native, whole, factor);
+                }
+            else
+                {
+                    replicate_generic (dst, native, whole, factor, bpp);
+                }
+            dst += whole * factor * bpp;
+            native += whole * bpp;
+            span -= whole * factor;
+        }
+    if (span > 0)
+        {
+            replicate_generic (dst, native, 1, span, bpp);
+        }
+}
+
+/* ------------------------------------------------------------------ */
+/* Zoomed-out sampling                                                 */
+/* ------------------------------------------------------------------ */
+
+/*
+ * Point-sampling a much larger image aliases and strides across cache
+ * lines.  Once the view shrinks it by half or more, rows come from the
+ * mip level closest to the drawn size instead.  The chain is started on
+ * first need and built in the background; frames drawn before the level
+ * is ready use the deepest one that is, and the refresh hook tells the
+ * owner when a redraw would pick up the finished chain.
+ */
+static image_mips_t *g_mips;
+static void (*g_refresh_hook) (void *ctx);
+static void *g_refresh_ctx;
+
+void
+renderer_set_refresh_hook (void (*hook) (void *ctx), void *ctx)
+{
+    g_refresh_hook = hook;
+    g_refresh_ctx = ctx;
+}
+
+static void
+mips_done (void *ctx)
+{
+    (void)ctx;
+    if (g_refresh_hook)
+        {
+            g_refresh_hook (g_refresh_ctx);
+        }
+}
+
+static const image_t *
+sample_source (const image_t *img, int draw_w, int draw_h)
+{
+    int level = image_mips_pick (img->width, img->height, draw_w, draw_h);
+
+    if (level == 0)
+        {
+            return img;
+        }
+    if (!image_mips_matches (g_mips, img))
+        {
+            image_mips_free (g_mips);
+            g_mips = image_mips_new (img, mips_done, NULL);
+            if (!g_mips)
+                {
+                    return img;
+                }
+        }
+    return image_mips_get (g_mips, level);
+}
+
 int
 renderer_ensure_buffer (
     uint8_t **buffer,
@@ -245,6 +777,179 @@ renderer_ensure_buffer (
     return 1;
 }
 
+/*
+ * Everything a band needs, worked out once per frame on the calling
+ * thread; bands only read it.
+ */
+typedef struct
+{
+    const image_t *img; /* the level actually sampled */
+    uint8_t *dst;
+    int win_w;
+    int clip_x0; /* only columns [clip_x0, clip_x1) and rows from */
+    int clip_x1; /* clip_y0 on are drawn; start/end are clipped to */
+    int clip_y0; /* them as well */
+    int offset_x;
+    int offset_y;
+    int draw_h;
+    int start_x;
+    int start_y;
+    int end_x;
+    int end_y;
+    size_t bpp;
+    const row_packer_t *packer;
+    blit_row_fn kernel;
+    const bg_cache_t *under;
+    const uint32_t *cols; /* NULL when columns are unscaled */
+    int factor;           /* whole magnification factor, or 0 */
+    replicate_fn replicate;
+} frame_t;
+
+static void
+draw_band (void *ctx, int worker, int y0, int y1)
+{
+    const frame_t *f = (const frame_t *)ctx;
+    const image_t *img = f->img;
+    const bg_cache_t *under = f->under;
+    uint8_t *rgba = g_row_rgba[worker];
+    size_t bpp = f->bpp;
+    size_t stride = (size_t)f->win_w * bpp;
+    size_t src_stride = (size_t)img->width * 4U;
+    size_t span = (size_t)(f->end_x - f->start_x);
+    size_t left = (size_t)f->clip_x0 * bpp;
+    size_t left_len = (size_t)(f->start_x - f->clip_x0) * bpp;
+    size_t right = (size_t)f->end_x * bpp;
+    size_t right_len = (size_t)(f->clip_x1 - f->end_x) * bpp;
+    size_t clip_len = (size_t)(f->clip_x1 - f->clip_x0) * bpp;
+    int img_y0;
+    int img_y1;
+    const uint8_t *prev_row = NULL;
+    uint32_t prev_src_y = 0;
+    int prev_band = 0;
+    index_step_t rows;
+    int y;
+
+    y0 += f->clip_y0;
+    y1 += f->clip_y0;
+    img_y0 = y0 > f->start_y ? y0 : f->start_y;
+    img_y1 = y1 < f->end_y ? y1 : f->end_y;
+    for (y = y0; y < y1; y++)
+        {
+            if (y < img_y0 || y >= img_y1)
+                {
+                    memcpy (
+                        f->dst + (size_t)y * stride + left,
+                        under->packed[bg_band (under, y)] + left,
+                        clip_len
+                    );
+                }
+        }
+    if (img_y0 >= img_y1)
+        {
+            return;
+        }
+
+    index_step_init (&rows, img_y0 - f->offset_y, f->draw_h, img->height);
+    for (y = img_y0; y < img_y1; y++)
+        {
+            int band = bg_band (under, y);
+            uint32_t src_y = index_step_next (&rows);
+            const uint8_t *src = img->rgba + (size_t)src_y * src_stride;
+            uint8_t *line = f->dst + (size_t)y * stride;
+            uint8_t *row = line + (size_t)f->start_x * bpp;
+            int row_class = IMAGE_ROW_OPAQUE;
+
+            /* Background only where the image does not cover. */
+            memcpy (line + left, under->packed[band] + left, left_len);
+            memcpy (line + right, under->packed[band] + right, right_len);
+
+            if (img->has_alpha)
+                {
+                    row_class = img->row_alpha ? img->row_alpha[src_y]
+                                               : IMAGE_ROW_MIXED;
+                }
+            if (row_class == IMAGE_ROW_TRANSPARENT)
+                {
+                    memcpy (
+                        row,
+                        under->packed[band] + (size_t)f->start_x * bpp,
+                        span * bpp
+                    );
+                    continue;
+                }
+
+            /* Same source row as the line above, and either opaque or
+               over the same background band: the pixels are identical. */
+            if (prev_row && src_y == prev_src_y
+                && (row_class == IMAGE_ROW_OPAQUE || band == prev_band))
+                {
+                    memcpy (row, prev_row, span * bpp);
+                    continue;
+                }
+            prev_row = row;
+            prev_src_y = src_y;
+            prev_band = band;
+
+            if (f->factor && row_class == IMAGE_ROW_OPAQUE)
+                {
+                    size_t rel = (size_t)(f->start_x - f->offset_x);
+                    size_t factor = (size_t)f->factor;
+                    size_t sx0 = rel / factor;
+                    size_t sx1 = (rel + span - 1U) / factor;
+
+                    pack_row (
+                        f->packer,
+                        f->kernel,
+                        rgba,
+                        src + sx0 * 4U,
+                        sx1 - sx0 + 1U
+                    );
+                    replicate_span (
+                        row,
+                        rgba,
+                        span,
+                        rel % factor,
+                        factor,
+                        bpp,
+                        f->replicate
+                    );
+                    continue;
+                }
+
+            if (!f->cols)
+                {
+                    src += (size_t)(f->start_x - f->offset_x) * 4U;
+                }
+            else
+                {
+                    size_t i;
+
+                    for (i = 0; i < span; i++)
+                        {
+                            memcpy (
+                                rgba + i * 4U,
+                                src + (size_t)f->cols[i] * 4U,
+                                4
+                            );
+                        }
+                    src = rgba;
+                }
+
+            if (row_class != IMAGE_ROW_OPAQUE)
+                {
+                    blend_row (
+                        rgba,
+                        src,
+                        under->rgba[band] + (size_t)f->start_x * 4U,
+                        span
+                    );
+                    src = rgba;
+                }
+
+            pack_row (f->packer, f->kernel, row, src, span);
+        }
+}
+
 void
 renderer_draw_image (
     const pixel_format_t *format,
@@ -256,25 +961,75 @@ renderer_draw_image (
     const view_params_t *view
 )
 {
+    render_rect_t all;
+
+    all.x = 0;
+    all.y = 0;
+    all.w = win_w;
+    all.h = win_h;
+    renderer_draw_image_rect (format, img, win_w, win_h, dst, bg, view, &all);
+}
+
+void
+renderer_draw_image_rect (
+    const pixel_format_t *format,
+    const image_t *img,
+    int win_w,
+    int win_h,
+    uint8_t *dst,
+    const bg_config_t *bg,
+    const view_params_t *view,
+    const render_rect_t *rect
+)
+{
+    frame_t f;
     int draw_w;
     int draw_h;
-    int offset_x;
-    int offset_y;
-    int start_x;
-    int start_y;
-    int end_x;
-    int end_y;
-    int x;
-    int y;
-    size_t stride;
+    int clip_y1;
+    int threads;
+    int i;
 
-    if (!format || !img || !img->rgba || !dst || !bg || win_w <= 0
+    if (!format || !img || !img->rgba || !dst || !bg || !rect || win_w <= 0
         || win_h <= 0)
         {
             return;
         }
 
-    fill_background (format, win_w, win_h, dst, bg);
+    memset (&f, 0, sizeof (f));
+    f.clip_x0 = rect->x > 0 ? rect->x : 0;
+    f.clip_y0 = rect->y > 0 ? rect->y : 0;
+    f.clip_x1 = rect->w > win_w - rect->x ? win_w : rect->x + rect->w;
+    clip_y1 = rect->h > win_h - rect->y ? win_h : rect->y + rect->h;
+    if (f.clip_x0 >= f.clip_x1 || f.clip_y0 >= clip_y1)
+        {
+            return;
+        }
+
+    threads = render_pool_threads ();
+    for (i = 0; i < threads; i++)
+        {
+            uint8_t *rgba = (uint8_t *)grow_scratch (
+                g_row_rgba[i], &g_row_rgba_cap[i], (size_t)win_w * 4U
+            );
+
+            if (!rgba)
+                {
+                    return;
+                }
+            g_row_rgba[i] = rgba;
+        }
+
+    f.dst = dst;
+    f.win_w = win_w;
+    f.bpp = (size_t)format->bytes_per_pixel;
+    f.packer = packer_for (format);
+    f.kernel = packer_kernel (f.packer);
+    f.under = bg_cache_update (f.packer, f.kernel, win_w, bg);
+    if (!f.under)
+        {
+            return;
+        }
+
     compute_view_rect (
         img->width,
         img->height,
@@ -283,86 +1038,80 @@ renderer_draw_image (
         view,
         &draw_w,
         &draw_h,
-        &offset_x,
-        &offset_y
+        &f.offset_x,
+        &f.offset_y
     );
-    if (draw_w <= 0 || draw_h <= 0)
+    if (draw_w > 0 && draw_h > 0)
         {
-            return;
+            img = sample_source (img, draw_w, draw_h);
+            f.start_x = f.offset_x > f.clip_x0 ? f.offset_x : f.clip_x0;
+            f.start_y = f.offset_y > f.clip_y0 ? f.offset_y : f.clip_y0;
+            f.end_x = f.offset_x + draw_w;
+            f.end_y = f.offset_y + draw_h;
+            if (f.end_x > f.clip_x1)
+                {
+                    f.end_x = f.clip_x1;
+                }
+            if (f.end_y > clip_y1)
+                {
+                    f.end_y = clip_y1;
+                }
         }
+    f.img = img;
+    f.draw_h = draw_h;
 
-    start_x = offset_x > 0 ? offset_x : 0;
-    start_y = offset_y > 0 ? offset_y : 0;
-    end_x = offset_x + draw_w;
-    end_y = offset_y + draw_h;
-    if (end_x > win_w)
+    /* Unscaled columns read the source span in place; otherwise each
+       row is gathered through the column table first. */
+    if (f.start_x < f.end_x && f.start_y < f.end_y && draw_w != img->width)
         {
-            end_x = win_w;
+            f.cols = build_col_table (
+                f.start_x, f.end_x, f.offset_x, draw_w, img->width
+            );
+            if (!f.cols)
+                {
+                    f.end_x = f.start_x;
+                }
         }
-    if (end_y > win_h)
+    if (f.start_x >= f.end_x || f.start_y >= f.end_y)
         {
-            end_y = win_h;
+            /* Nothing of the image is visible: background only. */
+            f.start_x = f.end_x = f.clip_x0;
+            f.start_y = f.end_y = 0;
         }
-    if (start_x >= end_x || start_y >= end_y)
+
+    if (f.start_y < f.end_y)
         {
-            return;
+            f.factor = whole_factor (img, draw_w, draw_h);
         }
-
-    stride = (size_t)win_w * (size_t)format->bytes_per_pixel;
-    for (y = start_y; y < end_y; y++)
+    if (f.factor && f.bpp == 4U)
+        {
+            f.replicate = pixel_kernels ()->replicate32;
+        }
+    else if (f.factor && f.bpp == 2U)
         {
-            int src_y = ((y - offset_y) * img->height) / draw_h;
-            uint8_t *row = dst + (size_t)y * stride
-                           + (size_t)start_x
-                                 * (size_t)format->bytes_per_pixel;
+            f.replicate = pixel_kernels ()->replicate16;
+        }
 
-            for (x = start_x; x < end_x; x++)
-                {
-                    int src_x = ((x - offset_x) * img->width) / draw_w;
-                    size_t src_idx
-                        = ((size_t)src_y * (size_t)img->width + (size_t)src_x)
-                          * 4U;
-                    uint8_t r = img->rgba[src_idx + 0U];
-                    uint8_t g = img->rgba[src_idx + 1U];
-                    uint8_t b = img->rgba[src_idx + 2U];
-                    uint8_t a = img->rgba[src_idx + 3U];
-                    uint32_t pixel;
-
-                    if (!img->has_alpha || a == 255U)
-                        {
-                            pixel = pack_pixel (format, r, g, b);
-                        }
-                    else
-                        {
-                            uint8_t br;
-                            uint8_t bgc;
-                            uint8_t bb;
-                            uint8_t out_r;
-                            uint8_t out_g;
-                            uint8_t out_b;
-
-                            sample_background (bg, x, y, &br, &bgc, &bb);
-                            out_r
-                                = (uint8_t)(((int)r * (int)a
-                                             + (int)br * (255 - (int)a) + 127)
-                                            / 255);
-                            out_g
-                                = (uint8_t)(((int)g * (int)a
-                                             + (int)bgc * (255 - (int)a) + 127)
-                                            / 255);
-                            out_b
-                                = (uint8_t)(((int)b * (int)a
-                                             + (int)bb * (255 - (int)a) + 127)
-                                            / 255);
-                            pixel = pack_pixel (format, out_r, out_g, out_b);
-                        }
+    render_pool_run (clip_y1 - f.clip_y0, draw_band, &f);
+}
 
-                    store_pixel (
-                        format,
-                        row + (size_t)(x - start_x)
-                                  * (size_t)format->bytes_per_pixel,
-                        pixel
-                    );
-                }
+void
+renderer_cleanup (void)
+{
+    int i;
+
+    render_pool_shutdown ();
+    image_mips_free (g_mips);
+    g_mips = NULL;
+    free (g_col_table);
+    g_col_table = NULL;
+    g_col_table_cap = 0;
+    for (i = 0; i < RENDER_POOL_MAX_THREADS; i++)
+        {
+            free (g_row_rgba[i]);
+            g_row_rgba[i] = NULL;
+            g_row_rgba_cap[i] = 0;
         }
+    free (g_bg.mem);
+    memset (&g_bg, 0, sizeof (g_bg));
 }
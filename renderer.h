@@ -41,8 +41,26 @@ typedef struct
     float zoom;
     int pan_x;
     int pan_y;
+    /* Round scales of 1:1 and up to whole multiples, for pixel art. */
+    int integer_zoom;
 } view_params_t;
 
+/* Scale at which the whole image fits the window (zoom 1). */
+double renderer_fit_scale (int img_w, int img_h, int win_w, int win_h);
+/* Image-to-window scale for `view`; every view_rect computation uses
+   this so that drawing and hit-testing agree. */
+double renderer_view_scale (
+    int img_w, int img_h, int win_w, int win_h, const view_params_t *view
+);
+
+/*
+ * Selects how RGBA rows are converted to `format`: a SIMD blitter for
+ * the common 32/24/16 bpp TrueColor visuals, lookup tables otherwise.
+ * Called once the visual is known; renderer_draw_image re-selects if it
+ * is later handed a different format.
+ */
+void renderer_set_format (const pixel_format_t *format);
+
 int renderer_ensure_buffer (
     uint8_t **buffer,
     size_t *buffer_size,
@@ -51,6 +69,16 @@ int renderer_ensure_buffer (
     int bytes_per_pixel
 );
 
+/* Window-space rectangle. */
+typedef struct
+{
+    int x;
+    int y;
+    int w;
+    int h;
+} render_rect_t;
+
+/* Draws in horizontal bands across the render_pool workers. */
 void renderer_draw_image (
     const pixel_format_t *format,
     const image_t *img,
@@ -61,4 +89,47 @@ void renderer_draw_image (
     const view_params_t *view
 );
 
+/*
+ * Where the image lands in the window under `view`; may reach past the
+ * window edges.  Pixels inside depend only on their offset from it, so
+ * a pan shifts them exactly.
+ */
+void renderer_image_rect (
+    int img_w,
+    int img_h,
+    int win_w,
+    int win_h,
+    const view_params_t *view,
+    render_rect_t *out
+);
+
+/*
+ * Redraws only the pixels of `dst` inside `rect` (clipped to the
+ * window), exactly as a full renderer_draw_image would; the rest of the
+ * buffer is left alone.
+ */
+void renderer_draw_image_rect (
+    const pixel_format_t *format,
+    const image_t *img,
+    int win_w,
+    int win_h,
+    uint8_t *dst,
+    const bg_config_t *bg,
+    const view_params_t *view,
+    const render_rect_t *rect
+);
+
+/*
+ * Zoomed-out views sample a mip chain built in the background; `hook`
+ * is called from the builder thread once it is complete, so the owner
+ * can schedule a redraw.
+ */
+void renderer_set_refresh_hook (void (*hook) (void *ctx), void *ctx);
+
+/*
+ * Stops background work, including the render_pool workers, and frees
+ * every cache kept between frames.
+ */
+void renderer_cleanup (void);
+
 #endif
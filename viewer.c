@@ -1,10 +1,19 @@
+/* _DEFAULT_SOURCE exposes clock_gettime under -std=c99 */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <xcb/xcb.h>
 
+#include "damage.h"
 #include "viewer.h"
 #include "viewer_editor.h"
 
@@ -47,18 +56,18 @@ find_root_visual (xcb_screen_t *screen)
     return NULL;
 }
 
-static int
-bits_per_pixel_for_depth (const xcb_setup_t *setup, uint8_t depth)
+static const xcb_format_t *
+pixmap_format_for_depth (const xcb_setup_t *setup, uint8_t depth)
 {
     xcb_format_iterator_t fmt_it = xcb_setup_pixmap_formats_iterator (setup);
     for (; fmt_it.rem; xcb_format_next (&fmt_it))
         {
             if (fmt_it.data->depth == depth)
                 {
-                    return fmt_it.data->bits_per_pixel;
+                    return fmt_it.data;
                 }
         }
-    return 0;
+    return NULL;
 }
 
 static xcb_atom_t
@@ -79,54 +88,355 @@ atom_intern (xcb_connection_t *conn, const char *name)
     return atom;
 }
 
+/*
+ * Renderer refresh hook, called from its background thread: queue a
+ * synthetic Expose so the event loop redraws.  XCB connections are
+ * thread-safe; the viewer state itself is not touched here.
+ */
 static void
-viewer_redraw (viewer_t *viewer, const image_t *img, const bg_config_t *bg)
+viewer_request_refresh (void *ctx)
 {
-    int stride;
+    viewer_t *viewer = (viewer_t *)ctx;
+    xcb_expose_event_t expose;
+
+    memset (&expose, 0, sizeof (expose));
+    expose.response_type = XCB_EXPOSE;
+    expose.window = viewer->window;
+    expose.width = UINT16_MAX;
+    expose.height = UINT16_MAX;
+    xcb_send_event (
+        viewer->conn,
+        0,
+        viewer->window,
+        XCB_EVENT_MASK_EXPOSURE,
+        (const char *)&expose
+    );
+    xcb_flush (viewer->conn);
+}
 
-    if (viewer->win_w <= 0 || viewer->win_h <= 0)
+/*
+ * Uploads one rectangle of draw_buf.  Rows are padded to the server's
+ * scanline unit and sent in as many PutImage requests as the maximum
+ * request length needs; whole-width rows that are already padded go
+ * straight from draw_buf, anything else is packed into upload_buf.
+ */
+static void
+viewer_put_rect (viewer_t *viewer, const render_rect_t *r)
+{
+    size_t bpp = (size_t)viewer->pixel_format.bytes_per_pixel;
+    size_t stride = (size_t)viewer->win_w * bpp;
+    size_t row_bytes = (size_t)r->w * bpp;
+    size_t pad = (size_t)viewer->scanline_pad;
+    size_t pitch = (row_bytes + pad - 1U) / pad * pad;
+    size_t max_bytes
+        = (size_t)xcb_get_maximum_request_length (viewer->conn) * 4U;
+    int direct = row_bytes == stride && pitch == stride;
+    int rows_per_put;
+    int y;
+
+    /* PutImage carries a 24-byte header. */
+    rows_per_put = max_bytes > 24U + pitch ? (int)((max_bytes - 24U) / pitch)
+                                           : 1;
+    if (!direct)
         {
-            return;
+            size_t need = pitch
+                          * (size_t)(rows_per_put < r->h ? rows_per_put
+                                                         : r->h);
+
+            if (need > viewer->upload_buf_size)
+                {
+                    uint8_t *grown = (uint8_t *)realloc (
+                        viewer->upload_buf, need
+                    );
+
+                    if (!grown)
+                        {
+                            fprintf (
+                                stderr,
+                                "out of memory allocating upload buffer\n"
+                            );
+                            return;
+                        }
+                    viewer->upload_buf = grown;
+                    viewer->upload_buf_size = need;
+                }
         }
-    if (!renderer_ensure_buffer (
-            &viewer->draw_buf,
-            &viewer->draw_buf_size,
-            viewer->win_w,
-            viewer->win_h,
-            viewer->pixel_format.bytes_per_pixel
-        ))
+
+    for (y = 0; y < r->h; y += rows_per_put)
         {
-            fprintf (stderr, "out of memory allocating draw buffer\n");
+            int rows = r->h - y < rows_per_put ? r->h - y : rows_per_put;
+            const uint8_t *src = viewer->draw_buf
+                                 + (size_t)(r->y + y) * stride
+                                 + (size_t)r->x * bpp;
+            const uint8_t *data = src;
+            int i;
+
+            if (!direct)
+                {
+                    for (i = 0; i < rows; i++)
+                        {
+                            memcpy (
+                                viewer->upload_buf + (size_t)i * pitch,
+                                src + (size_t)i * stride,
+                                row_bytes
+                            );
+                        }
+                    data = viewer->upload_buf;
+                }
+            xcb_put_image (
+                viewer->conn,
+                XCB_IMAGE_FORMAT_Z_PIXMAP,
+                viewer->window,
+                viewer->gc,
+                (uint16_t)r->w,
+                (uint16_t)rows,
+                (int16_t)r->x,
+                (int16_t)(r->y + y),
+                0,
+                viewer->pixel_format.root_depth,
+                (uint32_t)(pitch * (size_t)rows),
+                data
+            );
+        }
+}
+
+/*
+ * Sizes draw_buf for the window.  With MIT-SHM it lives in the shared
+ * segment, once the server has finished with the previous frame; if no
+ * segment can be had the viewer drops back to a private buffer and
+ * PutImage for good.
+ */
+static int
+viewer_ensure_draw_buf (viewer_t *viewer)
+{
+    if (viewer->use_shm)
+        {
+            size_t need = (size_t)viewer->win_w * (size_t)viewer->win_h
+                          * (size_t)viewer->pixel_format.bytes_per_pixel;
+
+            viewer_shm_wait (&viewer->shm, viewer->conn);
+            if (viewer_shm_reserve (&viewer->shm, viewer->conn, need))
+                {
+                    viewer->draw_buf = viewer->shm.addr;
+                    viewer->draw_buf_size = viewer->shm.size;
+                    return 1;
+                }
+            fprintf (stderr, "MIT-SHM unavailable, using PutImage\n");
+            viewer_shm_release (&viewer->shm, viewer->conn);
+            viewer->use_shm = 0;
+            viewer->draw_buf = NULL;
+            viewer->draw_buf_size = 0;
+        }
+    return renderer_ensure_buffer (
+        &viewer->draw_buf,
+        &viewer->draw_buf_size,
+        viewer->win_w,
+        viewer->win_h,
+        viewer->pixel_format.bytes_per_pixel
+    );
+}
+
+/*
+ * Presents one rectangle of draw_buf.  ShmPutImage needs draw_buf rows
+ * to match the server's padding, which holds for 32-bit pixels and for
+ * most window widths otherwise; the rest go through PutImage.
+ */
+static void
+viewer_present_rect (viewer_t *viewer, const render_rect_t *r)
+{
+    size_t stride = (size_t)viewer->win_w
+                    * (size_t)viewer->pixel_format.bytes_per_pixel;
+
+    if (viewer->use_shm && stride % (size_t)viewer->scanline_pad == 0U)
+        {
+            viewer_shm_put (
+                &viewer->shm,
+                viewer->conn,
+                viewer->window,
+                viewer->gc,
+                viewer->pixel_format.root_depth,
+                viewer->win_w,
+                viewer->win_h,
+                r
+            );
             return;
         }
+    viewer_put_rect (viewer, r);
+}
+
+/*
+ * Applies the scroll in `damage`: the part of the previous frame that
+ * stays in the window moves within draw_buf and, through CopyArea, on
+ * the window itself, and the strips it uncovers become damage, so a pan
+ * renders and uploads in proportion to its distance.  Returns 0 when
+ * the frame cannot be shifted and must be redrawn whole: nothing stays
+ * in view, or a checkerboard shows through a translucent image and
+ * would have to stay put while the image moves.
+ */
+static int
+viewer_scroll (
+    viewer_t *viewer,
+    const image_t *img,
+    const bg_config_t *bg,
+    damage_t *damage
+)
+{
+    size_t bpp = (size_t)viewer->pixel_format.bytes_per_pixel;
+    size_t stride = (size_t)viewer->win_w * bpp;
+    int dx = damage->scroll_dx;
+    int dy = damage->scroll_dy;
+    render_rect_t image;
+    render_rect_t strip;
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+    int y;
+
+    if (img->has_alpha && bg->mode != BG_MODE_SOLID)
+        {
+            return 0;
+        }
 
-    stride = viewer->win_w * viewer->pixel_format.bytes_per_pixel;
-    renderer_draw_image (
-        &viewer->pixel_format,
-        img,
+    /* Kept: image pixels in the window both before and after. */
+    renderer_image_rect (
+        img->width,
+        img->height,
         viewer->win_w,
         viewer->win_h,
-        viewer->draw_buf,
-        bg,
-        &viewer->view
+        &viewer->view,
+        &image
     );
+    x0 = image.x > 0 ? image.x : 0;
+    y0 = image.y > 0 ? image.y : 0;
+    x1 = image.x + image.w < viewer->win_w ? image.x + image.w
+                                           : viewer->win_w;
+    y1 = image.y + image.h < viewer->win_h ? image.y + image.h
+                                           : viewer->win_h;
+    x0 = x0 > dx ? x0 : dx;
+    y0 = y0 > dy ? y0 : dy;
+    x1 = x1 < viewer->win_w + dx ? x1 : viewer->win_w + dx;
+    y1 = y1 < viewer->win_h + dy ? y1 : viewer->win_h + dy;
+    if (x1 <= x0 || y1 <= y0)
+        {
+            return 0;
+        }
+
+    strip.x = 0;
+    strip.y = 0;
+    strip.w = viewer->win_w;
+    strip.h = y0;
+    damage_add (damage, &strip, viewer->win_w, viewer->win_h);
+    strip.y = y1;
+    strip.h = viewer->win_h - y1;
+    damage_add (damage, &strip, viewer->win_w, viewer->win_h);
+    strip.y = y0;
+    strip.w = x0;
+    strip.h = y1 - y0;
+    damage_add (damage, &strip, viewer->win_w, viewer->win_h);
+    strip.x = x1;
+    strip.w = viewer->win_w - x1;
+    damage_add (damage, &strip, viewer->win_w, viewer->win_h);
+    viewer_editor_scroll_damage (viewer, dx, dy, damage);
+    if (damage->full)
+        {
+            return 1;
+        }
+
+    /* Rows are walked away from the direction of travel so that each
+       source row is read before it is overwritten. */
+    for (y = 0; y < y1 - y0; y++)
+        {
+            int row = dy > 0 ? y1 - 1 - y : y0 + y;
 
-    viewer_editor_draw_overlay (viewer, img, viewer->draw_buf);
-    xcb_put_image (
+            memmove (
+                viewer->draw_buf + (size_t)row * stride + (size_t)x0 * bpp,
+                viewer->draw_buf + (size_t)(row - dy) * stride
+                    + (size_t)(x0 - dx) * bpp,
+                (size_t)(x1 - x0) * bpp
+            );
+        }
+    xcb_copy_area (
         viewer->conn,
-        XCB_IMAGE_FORMAT_Z_PIXMAP,
+        viewer->window,
         viewer->window,
         viewer->gc,
-        (uint16_t)viewer->win_w,
-        (uint16_t)viewer->win_h,
-        0,
-        0,
-        0,
-        viewer->pixel_format.root_depth,
-        (uint32_t)((size_t)stride * (size_t)viewer->win_h),
-        viewer->draw_buf
+        (int16_t)(x0 - dx),
+        (int16_t)(y0 - dy),
+        (int16_t)x0,
+        (int16_t)y0,
+        (uint16_t)(x1 - x0),
+        (uint16_t)(y1 - y0)
     );
+    return 1;
+}
+
+/*
+ * Re-renders and uploads what `damage` covers: the whole window, or
+ * just its rectangles, image first and overlay blended on top.  A
+ * partial redraw relies on draw_buf holding the previous frame at the
+ * current size, so size changes must come with full damage.
+ */
+static void
+viewer_redraw_damage (
+    viewer_t *viewer,
+    const image_t *img,
+    const bg_config_t *bg,
+    const damage_t *damage
+)
+{
+    damage_t work = *damage;
+    render_rect_t all;
+    const render_rect_t *rects;
+    int count;
+    int i;
 
+    if (viewer->win_w <= 0 || viewer->win_h <= 0 || damage_empty (damage))
+        {
+            return;
+        }
+    if (!viewer_ensure_draw_buf (viewer))
+        {
+            fprintf (stderr, "out of memory allocating draw buffer\n");
+            return;
+        }
+
+    if ((work.scroll_dx != 0 || work.scroll_dy != 0)
+        && !viewer_scroll (viewer, img, bg, &work))
+        {
+            damage_add_all (&work);
+        }
+    rects = work.rects;
+    count = work.count;
+    if (work.full)
+        {
+            all.x = 0;
+            all.y = 0;
+            all.w = viewer->win_w;
+            all.h = viewer->win_h;
+            rects = &all;
+            count = 1;
+        }
+    for (i = 0; i < count; i++)
+        {
+            renderer_draw_image_rect (
+                &viewer->pixel_format,
+                img,
+                viewer->win_w,
+                viewer->win_h,
+                viewer->draw_buf,
+                bg,
+                &viewer->view,
+                &rects[i]
+            );
+            viewer_editor_draw_overlay_rect (
+                viewer, img, viewer->draw_buf, &rects[i]
+            );
+            viewer_present_rect (viewer, &rects[i]);
+        }
+
+    /* Uploads paint over text in their rectangles; redrawing it all is
+       cheap and leaves unchanged text as it was. */
     viewer_editor_draw_overlay_text (viewer);
     xcb_flush (viewer->conn);
 }
@@ -143,6 +453,7 @@ viewer_init (viewer_t *viewer, int initial_w, int initial_h)
           | XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_POINTER_MOTION;
     uint32_t win_values[2];
     uint8_t root_depth;
+    const xcb_format_t *pixmap_format;
     int bits_per_pixel;
 
     viewer->conn = xcb_connect (NULL, NULL);
@@ -164,7 +475,8 @@ viewer_init (viewer_t *viewer, int initial_w, int initial_h)
     viewer->screen = screen_it.data;
 
     root_depth = viewer->screen->root_depth;
-    bits_per_pixel = bits_per_pixel_for_depth (setup, root_depth);
+    pixmap_format = pixmap_format_for_depth (setup, root_depth);
+    bits_per_pixel = pixmap_format ? pixmap_format->bits_per_pixel : 0;
     if (bits_per_pixel == 0 || (bits_per_pixel % 8) != 0)
         {
             fprintf (
@@ -186,6 +498,9 @@ viewer_init (viewer_t *viewer, int initial_w, int initial_h)
         }
 
     viewer->pixel_format.root_depth = root_depth;
+    viewer->scanline_pad = pixmap_format->scanline_pad >= 8
+                               ? pixmap_format->scanline_pad / 8
+                               : 1;
     viewer->pixel_format.bytes_per_pixel = bits_per_pixel / 8;
     viewer->pixel_format.image_byte_order = setup->image_byte_order;
     viewer->pixel_format.red_mask = visual->red_mask;
@@ -206,6 +521,7 @@ viewer_init (viewer_t *viewer, int initial_w, int initial_h)
     viewer->pixel_format.blue_max = max_from_mask (
         viewer->pixel_format.blue_mask, viewer->pixel_format.blue_shift
     );
+    renderer_set_format (&viewer->pixel_format);
 
     viewer->win_w = initial_w > 0 ? initial_w : 1;
     viewer->win_h = initial_h > 0 ? initial_h : 1;
@@ -247,118 +563,260 @@ viewer_init (viewer_t *viewer, int initial_w, int initial_h)
 
     viewer->gc = xcb_generate_id (viewer->conn);
     xcb_create_gc (viewer->conn, viewer->gc, viewer->window, 0, NULL);
+    viewer->use_shm = viewer_shm_supported (viewer->conn);
     xcb_map_window (viewer->conn, viewer->window);
     xcb_flush (viewer->conn);
     keybinds_init (&viewer->keybinds, &viewer->view);
+    renderer_set_refresh_hook (viewer_request_refresh, viewer);
 
     return 1;
 }
 
+/* ------------------------------------------------------------------ */
+/* Event loop                                                          */
+/* ------------------------------------------------------------------ */
+
+static long long
+monotonic_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Wakes the loop at `when` on the monotonic clock. */
+static void
+arm_frame_timer (int timer_fd, long long when)
+{
+    struct itimerspec at;
+
+    memset (&at, 0, sizeof (at));
+    at.it_value.tv_sec = (time_t)(when / 1000000000LL);
+    at.it_value.tv_nsec = (long)(when % 1000000000LL);
+    timerfd_settime (timer_fd, TFD_TIMER_ABSTIME, &at, NULL);
+}
+
+/*
+ * Folds one event into `damage`.  `expose_more` is left set while an
+ * Expose series is still arriving.  Returns 0 once the window is being
+ * closed.
+ */
+static int
+viewer_handle_event (
+    viewer_t *viewer,
+    const image_t *img,
+    const xcb_generic_event_t *event,
+    damage_t *damage,
+    int *expose_more
+)
+{
+    render_rect_t r;
+
+    switch (event->response_type & 0x7FU)
+        {
+        case XCB_EXPOSE:
+            {
+                const xcb_expose_event_t *expose
+                    = (const xcb_expose_event_t *)event;
+
+                /* The renderer's refresh requests cover the whole window
+                   and come out as full damage. */
+                r.x = expose->x;
+                r.y = expose->y;
+                r.w = expose->width;
+                r.h = expose->height;
+                damage_add (damage, &r, viewer->win_w, viewer->win_h);
+                *expose_more = expose->count > 0;
+                break;
+            }
+        case XCB_GRAPHICS_EXPOSURE:
+            {
+                /* Part of a scroll's CopyArea source was hidden, so that
+                   part of the window was not copied. */
+                const xcb_graphics_exposure_event_t *gexp
+                    = (const xcb_graphics_exposure_event_t *)event;
+
+                r.x = gexp->x;
+                r.y = gexp->y;
+                r.w = gexp->width;
+                r.h = gexp->height;
+                damage_add (damage, &r, viewer->win_w, viewer->win_h);
+                break;
+            }
+        case XCB_CONFIGURE_NOTIFY:
+            {
+                const xcb_configure_notify_event_t *cfg
+                    = (const xcb_configure_notify_event_t *)event;
+
+                if ((int)cfg->width != viewer->win_w
+                    || (int)cfg->height != viewer->win_h)
+                    {
+                        viewer->win_w = cfg->width;
+                        viewer->win_h = cfg->height;
+                        damage_add_all (damage);
+                    }
+                break;
+            }
+        case XCB_CLIENT_MESSAGE:
+            {
+                const xcb_client_message_event_t *msg
+                    = (const xcb_client_message_event_t *)event;
+
+                if (msg->data.data32[0] == viewer->wm_delete_window)
+                    {
+                        return 0;
+                    }
+                break;
+            }
+        case XCB_KEY_PRESS:
+        case XCB_BUTTON_PRESS:
+        case XCB_BUTTON_RELEASE:
+        case XCB_MOTION_NOTIFY:
+            viewer_editor_handle_event (viewer, img, event, damage);
+            break;
+        default:
+            break;
+        }
+    return 1;
+}
+
+/*
+ * Events are drained as they come and only accumulate damage; a frame
+ * is drawn once the queue is empty, at most once per frame interval.
+ * A resize drag, a burst of Exposes or a held key therefore costs one
+ * redraw per frame rather than one per event.  The first change after
+ * an idle spell is drawn at once; later ones wait on a timerfd for the
+ * next frame slot.  Without a timerfd every drained batch is drawn.
+ */
 int
 viewer_run (viewer_t *viewer, const image_t *img, const bg_config_t *bg)
 {
-    int should_exit = 0;
-    xcb_generic_event_t *pending = NULL;
+    long long interval = 1000000000LL
+                         / (viewer->frame_rate > 0 ? viewer->frame_rate
+                                                   : VIEWER_DEFAULT_FPS);
+    long long next_frame = 0;
+    xcb_generic_event_t *motion = NULL;
+    xcb_generic_event_t *event;
+    struct pollfd fds[2];
+    damage_t damage;
+    int expose_more = 0;
+    int running = 1;
+    int status = 1;
+    int timer_fd;
 
     viewer_editor_reset_for_image (img);
-    viewer_redraw (viewer, img, bg);
-    while (!should_exit)
-        {
-            xcb_generic_event_t *event;
-            xcb_generic_event_t *next;
-            uint8_t type;
-            int request_redraw = 0;
+    keybinds_set_image_size (&viewer->keybinds, img->width, img->height);
+    damage_clear (&damage);
+    damage_add_all (&damage);
+
+    timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    fds[0].fd = xcb_get_file_descriptor (viewer->conn);
+    fds[0].events = POLLIN;
+    fds[1].fd = timer_fd;
+    fds[1].events = POLLIN;
 
-            if (pending)
+    while (running)
+        {
+            /* Only the last of a run of pointer motions is handled; the
+               editor and keybinds work from absolute positions. */
+            while (running
+                   && (event = xcb_poll_for_event (viewer->conn)) != NULL)
                 {
-                    event = pending;
-                    pending = NULL;
+                    if ((event->response_type & 0x7FU) == XCB_MOTION_NOTIFY)
+                        {
+                            free (motion);
+                            motion = event;
+                            continue;
+                        }
+                    if (motion)
+                        {
+                            viewer_handle_event (
+                                viewer, img, motion, &damage, &expose_more
+                            );
+                            free (motion);
+                            motion = NULL;
+                        }
+                    running = viewer_handle_event (
+                        viewer, img, event, &damage, &expose_more
+                    );
+                    free (event);
                 }
-            else
+            if (motion)
                 {
-                    event = xcb_wait_for_event (viewer->conn);
+                    viewer_handle_event (
+                        viewer, img, motion, &damage, &expose_more
+                    );
+                    free (motion);
+                    motion = NULL;
                 }
-
-            if (!event)
+            if (!running)
+                {
+                    break;
+                }
+            if (xcb_connection_has_error (viewer->conn))
                 {
-                    return 0;
+                    status = 0;
+                    break;
                 }
 
-            type = event->response_type & 0x7FU;
-
-            if (type == XCB_MOTION_NOTIFY)
+            if (!damage_empty (&damage) && !expose_more)
                 {
-                    while ((next = xcb_poll_for_event (viewer->conn)) != NULL)
+                    long long now = monotonic_ns ();
+
+                    if (timer_fd < 0 || now >= next_frame)
                         {
-                            if ((next->response_type & 0x7FU)
-                                == XCB_MOTION_NOTIFY)
-                                {
-                                    free (event);
-                                    event = next;
-                                }
-                            else
-                                {
-                                    pending = next;
-                                    break;
-                                }
+                            viewer_redraw_damage (viewer, img, bg, &damage);
+                            damage_clear (&damage);
+                            next_frame = now + interval;
+                            /* Drawing may have read events off the
+                               socket; drain them before sleeping. */
+                            continue;
                         }
+                    arm_frame_timer (timer_fd, next_frame);
                 }
 
-            switch (type)
+            xcb_flush (viewer->conn);
+            if (poll (fds, timer_fd >= 0 ? 2U : 1U, -1) < 0 && errno != EINTR)
                 {
-                case XCB_EXPOSE:
-                    viewer_redraw (viewer, img, bg);
-                    break;
-                case XCB_CONFIGURE_NOTIFY:
-                    {
-                        xcb_configure_notify_event_t *cfg
-                            = (xcb_configure_notify_event_t *)event;
-                        if ((int)cfg->width != viewer->win_w
-                            || (int)cfg->height != viewer->win_h)
-                            {
-                                viewer->win_w = cfg->width;
-                                viewer->win_h = cfg->height;
-                                viewer_redraw (viewer, img, bg);
-                            }
-                        break;
-                    }
-                case XCB_CLIENT_MESSAGE:
-                    {
-                        xcb_client_message_event_t *msg
-                            = (xcb_client_message_event_t *)event;
-                        if (msg->data.data32[0] == viewer->wm_delete_window)
-                            {
-                                should_exit = 1;
-                            }
-                        break;
-                    }
-                case XCB_KEY_PRESS:
-                case XCB_BUTTON_PRESS:
-                case XCB_BUTTON_RELEASE:
-                case XCB_MOTION_NOTIFY:
-                    viewer_editor_handle_event (
-                        viewer, img, event, &request_redraw
-                    );
-                    break;
-                default:
+                    status = 0;
                     break;
                 }
-            if (request_redraw)
+            if (timer_fd >= 0 && (fds[1].revents & POLLIN))
                 {
-                    viewer_redraw (viewer, img, bg);
+                    /* Only clears the readiness; the count is unused. */
+                    uint64_t expirations;
+                    ssize_t got
+                        = read (timer_fd, &expirations, sizeof (expirations));
+
+                    (void)got;
                 }
-            free (event);
         }
 
-    return 1;
+    if (timer_fd >= 0)
+        {
+            close (timer_fd);
+        }
+    return status;
 }
 
 void
 viewer_cleanup (viewer_t *viewer)
 {
+    /* Before the disconnect: the refresh hook may still be running. */
+    renderer_cleanup ();
+    renderer_set_refresh_hook (NULL, NULL);
+    if (viewer->shm.addr)
+        {
+            viewer_shm_release (&viewer->shm, viewer->conn);
+            viewer->draw_buf = NULL;
+        }
     free (viewer->draw_buf);
     viewer->draw_buf = NULL;
     viewer->draw_buf_size = 0;
+    free (viewer->upload_buf);
+    viewer->upload_buf = NULL;
+    viewer->upload_buf_size = 0;
 
     if (viewer->conn && viewer->gc)
         {
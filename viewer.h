@@ -9,6 +9,12 @@
 #include "image.h"
 #include "keybinds.h"
 #include "renderer.h"
+#include "viewer_shm.h"
+
+/* Redraw rate limits; events between frames are coalesced. */
+#define VIEWER_DEFAULT_FPS 60
+#define VIEWER_MIN_FPS 30
+#define VIEWER_MAX_FPS 240
 
 typedef struct
 {
@@ -18,14 +24,20 @@ typedef struct
     xcb_gcontext_t gc;
 
     pixel_format_t pixel_format;
+    int scanline_pad; /* bytes each uploaded row is padded to */
 
     int win_w;
     int win_h;
-    uint8_t *draw_buf;
+    uint8_t *draw_buf; /* inside shm.addr when use_shm is set */
     size_t draw_buf_size;
+    int use_shm;
+    viewer_shm_t shm;
+    uint8_t *upload_buf; /* rows of a partial upload, packed */
+    size_t upload_buf_size;
 
     view_params_t view;
     keybinds_state_t keybinds;
+    int frame_rate; /* frames per second; 0 for VIEWER_DEFAULT_FPS */
 
     xcb_atom_t wm_protocols;
     xcb_atom_t wm_delete_window;
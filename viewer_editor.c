@@ -4,6 +4,7 @@
 #include "editor_logic.h"
 #include "editor_render.h"
 #include "editor_types.h"
+#include "render_pool.h"
 
 /* ------------------------------------------------------------------ */
 /* Global editor state — shared across all editor_*.c translation      */
@@ -12,6 +13,9 @@
 
 editor_state_t g_editor = { 0 };
 
+/* State before the event being handled, to diff the overlay against. */
+static editor_state_t g_editor_before;
+
 /* ------------------------------------------------------------------ */
 /* Public API                                                          */
 /* ------------------------------------------------------------------ */
@@ -27,10 +31,68 @@ viewer_editor_handle_event (
     viewer_t *viewer,
     const image_t *img,
     const xcb_generic_event_t *event,
-    int *request_redraw
+    damage_t *damage
 )
 {
-    return editor_handle_event (viewer, img, event, request_redraw);
+    view_params_t view = viewer->view;
+    int request_redraw = 0;
+    int consumed;
+
+    /* The damage comes from comparing before and after rather than from
+       request_redraw, which some state changes (a section picked while
+       panning) do not set. */
+    g_editor_before = g_editor;
+    consumed = editor_handle_event (viewer, img, event, &request_redraw);
+
+    /* A new scale moves everything.  A pan shifts the previous frame,
+       after which the old overlay sits where the new view puts it, so
+       the comparison below is done in the new view either way. */
+    if (view.zoom != viewer->view.zoom
+        || view.integer_zoom != viewer->view.integer_zoom)
+        {
+            damage_add_all (damage);
+            return consumed;
+        }
+    if (view.pan_x != viewer->view.pan_x || view.pan_y != viewer->view.pan_y)
+        {
+            damage_scroll (
+                damage,
+                viewer->view.pan_x - view.pan_x,
+                viewer->view.pan_y - view.pan_y,
+                viewer->win_w,
+                viewer->win_h
+            );
+        }
+    editor_overlay_damage (viewer, img, &g_editor_before, damage);
+    return consumed;
+}
+
+typedef struct
+{
+    const viewer_t *viewer;
+    const image_t *img;
+    uint8_t *draw_buf;
+    render_rect_t clip;
+} overlay_frame_t;
+
+/* Each band draws every overlay clipped to its rows, in the same order
+   as a single pass, so blended pixels come out the same. */
+static void
+draw_overlay_band (void *ctx, int worker, int y0, int y1)
+{
+    const overlay_frame_t *frame = (const overlay_frame_t *)ctx;
+    draw_target_t target;
+
+    (void)worker;
+    target.viewer = frame->viewer;
+    target.buf = frame->draw_buf;
+    target.clip_x0 = frame->clip.x;
+    target.clip_x1 = frame->clip.x + frame->clip.w;
+    target.clip_y0 = frame->clip.y + y0;
+    target.clip_y1 = frame->clip.y + y1;
+    editor_draw_sections (&target, frame->img);
+    editor_draw_cuts (&target, frame->img);
+    editor_draw_hud (&target);
 }
 
 void
@@ -40,9 +102,41 @@ viewer_editor_draw_overlay (
     uint8_t *draw_buf
 )
 {
-    editor_draw_sections (viewer, img, draw_buf);
-    editor_draw_cuts (viewer, img, draw_buf);
-    editor_draw_hud (viewer, draw_buf);
+    render_rect_t all;
+
+    all.x = 0;
+    all.y = 0;
+    all.w = viewer->win_w;
+    all.h = viewer->win_h;
+    viewer_editor_draw_overlay_rect (viewer, img, draw_buf, &all);
+}
+
+void
+viewer_editor_draw_overlay_rect (
+    const viewer_t *viewer,
+    const image_t *img,
+    uint8_t *draw_buf,
+    const render_rect_t *rect
+)
+{
+    overlay_frame_t frame;
+    int x1 = rect->w > viewer->win_w - rect->x ? viewer->win_w
+                                                 : rect->x + rect->w;
+    int y1 = rect->h > viewer->win_h - rect->y ? viewer->win_h
+                                                 : rect->y + rect->h;
+
+    frame.viewer = viewer;
+    frame.img = img;
+    frame.draw_buf = draw_buf;
+    frame.clip.x = rect->x > 0 ? rect->x : 0;
+    frame.clip.y = rect->y > 0 ? rect->y : 0;
+    frame.clip.w = x1 - frame.clip.x;
+    frame.clip.h = y1 - frame.clip.y;
+    if (frame.clip.w <= 0 || frame.clip.h <= 0)
+        {
+            return;
+        }
+    render_pool_run (frame.clip.h, draw_overlay_band, &frame);
 }
 
 void
@@ -50,3 +144,11 @@ viewer_editor_draw_overlay_text (viewer_t *viewer)
 {
     editor_draw_hud_text (viewer);
 }
+
+void
+viewer_editor_scroll_damage (
+    const viewer_t *viewer, int dx, int dy, damage_t *damage
+)
+{
+    editor_scroll_damage (viewer, dx, dy, damage);
+}
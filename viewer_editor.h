@@ -5,16 +5,18 @@
 
 #include <xcb/xcb.h>
 
+#include "damage.h"
 #include "image.h"
 #include "viewer.h"
 
 void viewer_editor_reset_for_image (const image_t *img);
 
+/* Adds whatever the event changed on screen to `damage`. */
 int viewer_editor_handle_event (
     viewer_t *viewer,
     const image_t *img,
     const xcb_generic_event_t *event,
-    int *request_redraw
+    damage_t *damage
 );
 
 void viewer_editor_draw_overlay (
@@ -22,7 +24,19 @@ void viewer_editor_draw_overlay (
     const image_t *img,
     uint8_t *draw_buf
 );
+/* Redraws the overlay inside `rect` only, over freshly drawn pixels. */
+void viewer_editor_draw_overlay_rect (
+    const viewer_t *viewer,
+    const image_t *img,
+    uint8_t *draw_buf,
+    const render_rect_t *rect
+);
 
 void viewer_editor_draw_overlay_text (viewer_t *viewer);
 
+/* Adds the overlay a scroll of the previous frame puts out of place. */
+void viewer_editor_scroll_damage (
+    const viewer_t *viewer, int dx, int dy, damage_t *damage
+);
+
 #endif
@@ -0,0 +1,227 @@
+/* _DEFAULT_SOURCE exposes the System V shm calls under -std=c99 */
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+#include "viewer_shm.h"
+
+/* ------------------------------------------------------------------ */
+/* Protocol                                                            */
+/* ------------------------------------------------------------------ */
+
+/*
+ * The requests as the MIT-SHM 1.1 protocol lays them out.  libxcb fills
+ * in the opcodes and length when sending.
+ */
+enum
+{
+    SHM_ATTACH = 1,
+    SHM_DETACH = 2,
+    SHM_PUT_IMAGE = 3
+};
+
+typedef struct
+{
+    uint8_t major_opcode;
+    uint8_t minor_opcode;
+    uint16_t length;
+    uint32_t shmseg;
+    uint32_t shmid;
+    uint8_t read_only;
+    uint8_t pad[3];
+} shm_attach_request_t;
+
+typedef struct
+{
+    uint8_t major_opcode;
+    uint8_t minor_opcode;
+    uint16_t length;
+    uint32_t shmseg;
+} shm_detach_request_t;
+
+typedef struct
+{
+    uint8_t major_opcode;
+    uint8_t minor_opcode;
+    uint16_t length;
+    uint32_t drawable;
+    uint32_t gc;
+    uint16_t total_width;
+    uint16_t total_height;
+    uint16_t src_x;
+    uint16_t src_y;
+    uint16_t src_width;
+    uint16_t src_height;
+    int16_t dst_x;
+    int16_t dst_y;
+    uint8_t depth;
+    uint8_t format;
+    uint8_t send_event;
+    uint8_t pad;
+    uint32_t shmseg;
+    uint32_t offset;
+} shm_put_image_request_t;
+
+static xcb_extension_t g_shm_ext = { "MIT-SHM", 0 };
+
+/* Every request above is a whole number of 4-byte units, so no tail. */
+static unsigned int
+shm_send (
+    xcb_connection_t *conn, int flags, uint8_t opcode, void *req, size_t len
+)
+{
+    xcb_protocol_request_t proto;
+    struct iovec parts[3];
+
+    proto.count = 1;
+    proto.ext = &g_shm_ext;
+    proto.opcode = opcode;
+    proto.isvoid = 1;
+    /* xcb_send_request uses the two slots before the data itself. */
+    parts[2].iov_base = req;
+    parts[2].iov_len = len;
+    return xcb_send_request (conn, flags, parts + 2, &proto);
+}
+
+/* ------------------------------------------------------------------ */
+/* Public API                                                          */
+/* ------------------------------------------------------------------ */
+
+int
+viewer_shm_supported (xcb_connection_t *conn)
+{
+    const char *env = getenv ("SLICER_SHM");
+    const xcb_query_extension_reply_t *ext;
+
+    if (env && strcmp (env, "0") == 0)
+        {
+            return 0;
+        }
+    ext = xcb_get_extension_data (conn, &g_shm_ext);
+    return ext && ext->present;
+}
+
+int
+viewer_shm_reserve (viewer_shm_t *shm, xcb_connection_t *conn, size_t size)
+{
+    shm_attach_request_t req;
+    xcb_void_cookie_t cookie;
+    xcb_generic_error_t *error;
+    uint32_t seg;
+    void *addr;
+    int shmid;
+
+    if (shm->addr && size <= shm->size)
+        {
+            return 1;
+        }
+    shmid = shmget (IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shmid < 0)
+        {
+            return 0;
+        }
+    addr = shmat (shmid, NULL, 0);
+    if (addr == (void *)-1)
+        {
+            shmctl (shmid, IPC_RMID, NULL);
+            return 0;
+        }
+
+    seg = xcb_generate_id (conn);
+    memset (&req, 0, sizeof (req));
+    req.shmseg = seg;
+    req.shmid = (uint32_t)shmid;
+    req.read_only = 1;
+    cookie.sequence = shm_send (
+        conn, XCB_REQUEST_CHECKED, SHM_ATTACH, &req, sizeof (req)
+    );
+    error = xcb_request_check (conn, cookie);
+
+    /* Once both sides are attached (or have failed to), the id can go:
+       the kernel frees the memory when the last of them detaches, even
+       if the viewer dies first. */
+    shmctl (shmid, IPC_RMID, NULL);
+    if (error)
+        {
+            free (error);
+            shmdt (addr);
+            return 0;
+        }
+
+    viewer_shm_release (shm, conn);
+    shm->seg = seg;
+    shm->shmid = shmid;
+    shm->addr = (uint8_t *)addr;
+    shm->size = size;
+    return 1;
+}
+
+void
+viewer_shm_put (
+    viewer_shm_t *shm,
+    xcb_connection_t *conn,
+    xcb_drawable_t drawable,
+    xcb_gcontext_t gc,
+    uint8_t depth,
+    int total_w,
+    int total_h,
+    const render_rect_t *rect
+)
+{
+    shm_put_image_request_t req;
+
+    memset (&req, 0, sizeof (req));
+    req.drawable = drawable;
+    req.gc = gc;
+    req.total_width = (uint16_t)total_w;
+    req.total_height = (uint16_t)total_h;
+    req.src_x = (uint16_t)rect->x;
+    req.src_y = (uint16_t)rect->y;
+    req.src_width = (uint16_t)rect->w;
+    req.src_height = (uint16_t)rect->h;
+    req.dst_x = (int16_t)rect->x;
+    req.dst_y = (int16_t)rect->y;
+    req.depth = depth;
+    req.format = XCB_IMAGE_FORMAT_Z_PIXMAP;
+    req.shmseg = shm->seg;
+    shm_send (conn, 0, SHM_PUT_IMAGE, &req, sizeof (req));
+    shm->pending = 1;
+}
+
+void
+viewer_shm_wait (viewer_shm_t *shm, xcb_connection_t *conn)
+{
+    if (!shm->pending)
+        {
+            return;
+        }
+    /* Requests run in order, so once any reply is back the server has
+       finished every ShmPutImage sent before it.  This is cheaper than
+       asking for completion events and routing them through the event
+       loop, and by the next frame the reply is usually already there. */
+    free (xcb_get_input_focus_reply (conn, xcb_get_input_focus (conn), NULL));
+    shm->pending = 0;
+}
+
+void
+viewer_shm_release (viewer_shm_t *shm, xcb_connection_t *conn)
+{
+    shm_detach_request_t req;
+
+    if (!shm->addr)
+        {
+            return;
+        }
+    viewer_shm_wait (shm, conn);
+    memset (&req, 0, sizeof (req));
+    req.shmseg = shm->seg;
+    shm_send (conn, 0, SHM_DETACH, &req, sizeof (req));
+    shmdt (shm->addr);
+    memset (shm, 0, sizeof (*shm));
+}
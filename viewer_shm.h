@@ -0,0 +1,66 @@
+#ifndef VIEWER_SHM_H
+#define VIEWER_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xcb/xcb.h>
+
+#include "renderer.h"
+
+/*
+ * MIT-SHM frame buffer.
+ *
+ * The frame is rendered into a System V shared-memory segment that the
+ * X server has attached too, so presenting a rectangle is one fixed-size
+ * ShmPutImage request instead of the pixels themselves, and windows of
+ * any size fit in a single request.  The extension is spoken through
+ * xcbext.h, so nothing beyond libxcb is needed.  It only works with a
+ * local server; the viewer falls back to PutImage when the extension is
+ * missing or attaching fails, and SLICER_SHM=0 forces that fallback.
+ */
+
+typedef struct
+{
+    uint32_t seg; /* server-side id of the attached segment */
+    int shmid;
+    uint8_t *addr; /* NULL when no segment is attached */
+    size_t size;
+    int pending; /* the server may still be reading from addr */
+} viewer_shm_t;
+
+/* 1 if the server has MIT-SHM and SLICER_SHM does not turn it off. */
+int viewer_shm_supported (xcb_connection_t *conn);
+
+/*
+ * Grows the segment to at least `size` bytes; the contents are not kept.
+ * Returns 0, leaving the old segment in place, if a new one cannot be
+ * created or the server cannot attach it.
+ */
+int viewer_shm_reserve (
+    viewer_shm_t *shm, xcb_connection_t *conn, size_t size
+);
+
+/*
+ * Copies `rect` of a total_w x total_h image at the start of the segment
+ * to the same place in `drawable`.  Rows must already be padded the way
+ * the server expects for `depth`.
+ */
+void viewer_shm_put (
+    viewer_shm_t *shm,
+    xcb_connection_t *conn,
+    xcb_drawable_t drawable,
+    xcb_gcontext_t gc,
+    uint8_t depth,
+    int total_w,
+    int total_h,
+    const render_rect_t *rect
+);
+
+/* Blocks until the server has finished reading the segment. */
+void viewer_shm_wait (viewer_shm_t *shm, xcb_connection_t *conn);
+
+/* Detaches and frees the segment. */
+void viewer_shm_release (viewer_shm_t *shm, xcb_connection_t *conn);
+
+#endif